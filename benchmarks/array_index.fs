@@ -0,0 +1,13 @@
+# Indexed reads and writes of array elements
+exports = {};
+run = -> (
+    .size = 1000;
+    .arr = [0] * size;
+    .i = 0;
+    i < 300000 repeats (
+        .pos = i % size;
+        arr[pos] = (arr[pos] + arr[(pos + 1) % size] + 1) % 1000003;
+        i = i + 1;
+    );
+    print(arr[0]);
+);
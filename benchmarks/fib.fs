@@ -0,0 +1,4 @@
+# Recursive calls with integer arithmetic
+exports = {};
+.fib = .n -> (n < 2 then n else fib(n - 1) + fib(n - 2));
+run = -> print(fib(25));
@@ -0,0 +1,9 @@
+# Closure-heavy lazy pipelines of flows
+exports = {};
+run = -> (
+    .i, .sum = 0, 0;
+    Flow[integer].from_generator(-> (
+        i < 2000 then (i = i + 1; Result[integer][].ok(i)) else Result[integer][].err()
+    )).map[integer](.x -> x * 3).map[integer](.x -> x % 7).for_each(.x -> (sum = sum + x));
+    print(sum);
+);
@@ -0,0 +1,185 @@
+#include "catch2/catch_test_macros.hpp"
+#include "catch2/benchmark/catch_benchmark.hpp"
+
+#include "tokenizer.hpp"
+#include "ast.hpp"
+#include "data.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+using namespace funscript;
+
+namespace {
+
+    // Sizes (in bytes) of generated sources.
+    const std::vector<size_t> SOURCE_SIZES = {1024, 65536, 1048576, 10485760, 52428800};
+
+    /**
+     * @return The maximum source size to measure, set by `FUNSCRIPT_BENCH_MAX_SOURCE` (50 MiB by default).
+     */
+    size_t get_max_source() {
+        const char *str = getenv("FUNSCRIPT_BENCH_MAX_SOURCE");
+        return str ? std::stoull(str) : SOURCE_SIZES.back();
+    }
+
+    uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Generates a module-like source of at least the specified size: a sequence of function definitions which use
+     * arithmetic, object and array literals, strings, indexing, conditionals and loops.
+     */
+    std::string generate_source(size_t size) {
+        std::string src;
+        for (size_t id = 0; src.size() < size; id++) {
+            auto num = std::to_string(id);
+            src += ".f" + num + " = (.a: integer, .b) -> (\n"
+                   "    .x = a * " + num + " + b % 7;\n"
+                   "    .obj = {.name = 'item " + num + "'; .values = [1, 2.5, x, yes, no]};\n"
+                   "    x > 100 then obj.values[2] else (.i = 0; i < b repeats (i = i + 1); i)\n"
+                   ");\n";
+        }
+        return src;
+    }
+
+    /**
+     * Runs the function in a new thread with the specified stack size. The front-end is recursive, and its recursion
+     * depth grows with the amount of expressions in the source.
+     */
+    void run_with_stack(size_t stack_size, const std::function<void()> &fn) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, stack_size);
+        pthread_t thread;
+        int err = pthread_create(&thread, &attr, [](void *arg) -> void * {
+            (*static_cast<const std::function<void()> *>(arg))();
+            return nullptr;
+        }, const_cast<std::function<void()> *>(&fn));
+        pthread_attr_destroy(&attr);
+        REQUIRE(err == 0);
+        pthread_join(thread, nullptr);
+    }
+
+    /**
+     * Generates a literal-only data source of at least the specified size: an array of records with strings, numbers,
+     * booleans and nested arrays.
+     */
+    std::string generate_data(size_t size) {
+        std::string src = "[\n";
+        for (size_t id = 0; src.size() < size; id++) {
+            auto num = std::to_string(id);
+            src += "    {.id = " + num + "; .name = 'record " + num + "'; .score = " + num + ".5; .active = yes;"
+                   " .tags = ['a', 'b', -" + num + "]},\n";
+        }
+        return src + "]\n";
+    }
+
+    std::vector<Token> tokenize_source(const std::string &src) {
+        std::vector<Token> tokens;
+        tokenize("<bench>", src, [&tokens](auto token) { tokens.push_back(token); });
+        return tokens;
+    }
+
+    std::string assemble_ast(const ast_ptr &ast) {
+        Assembler as;
+        as.compile_expression(ast.get());
+        std::string bytes(as.total_size(), '\0');
+        as.assemble(bytes.data());
+        return bytes;
+    }
+}
+
+TEST_CASE("Front-end phases", "[frontend]") {
+    auto src = generate_source(65536);
+    auto tokens = tokenize_source(src);
+    auto ast = parse("<bench>", tokens);
+
+    BENCHMARK("tokenize 64 KiB") {
+        return tokenize_source(src);
+    };
+
+    BENCHMARK("parse 64 KiB") {
+        return parse("<bench>", tokens);
+    };
+
+    BENCHMARK("compile + assemble 64 KiB") {
+        return assemble_ast(ast);
+    };
+}
+
+TEST_CASE("Front-end throughput by source size", "[frontend-throughput]") {
+    size_t max_source = get_max_source();
+    std::cout << std::left << std::setw(12) << "bytes" << std::right << std::setw(12) << "tokens"
+              << std::setw(14) << "tokenize MB/s" << std::setw(14) << "parse MB/s" << std::setw(14) << "compile MB/s"
+              << std::setw(14) << "assemble MB/s" << std::setw(14) << "total MB/s" << std::endl;
+    for (size_t size : SOURCE_SIZES) {
+        if (size > max_source) break;
+        auto src = generate_source(size);
+        size_t repeats = size < 1048576 ? 5 : 1;
+        uint64_t tokenize_time = UINT64_MAX, parse_time = UINT64_MAX;
+        uint64_t compile_time = UINT64_MAX, assemble_time = UINT64_MAX;
+        size_t token_cnt = 0;
+        size_t bytecode_size = 0;
+        for (size_t rep = 0; rep < repeats; rep++) {
+            run_with_stack(std::max<size_t>(32 * size, 8388608), [&]() -> void {
+                uint64_t beg = now();
+                auto tokens = tokenize_source(src);
+                uint64_t tokenized = now();
+                token_cnt = tokens.size();
+                auto ast = parse("<bench>", std::move(tokens));
+                uint64_t parsed = now();
+                Assembler as;
+                as.compile_expression(ast.get());
+                uint64_t compiled = now();
+                std::string bytes(as.total_size(), '\0');
+                as.assemble(bytes.data());
+                uint64_t assembled = now();
+                bytecode_size = bytes.size();
+                tokenize_time = std::min(tokenize_time, tokenized - beg);
+                parse_time = std::min(parse_time, parsed - tokenized);
+                compile_time = std::min(compile_time, compiled - parsed);
+                assemble_time = std::min(assemble_time, assembled - compiled);
+            });
+            REQUIRE(bytecode_size != 0);
+        }
+        auto throughput = [&src](uint64_t time) -> double { return double(src.size()) / double(time) * 1e3; };
+        std::cout << std::left << std::setw(12) << src.size() << std::right << std::setw(12) << token_cnt
+                  << std::fixed << std::setprecision(1) << std::setw(14) << throughput(tokenize_time)
+                  << std::setw(14) << throughput(parse_time) << std::setw(14) << throughput(compile_time)
+                  << std::setw(14) << throughput(assemble_time)
+                  << std::setw(14) << throughput(tokenize_time + parse_time + compile_time + assemble_time)
+                  << std::endl;
+    }
+}
+
+TEST_CASE("Data loading", "[data]") {
+    auto src = generate_data(1048576);
+    DefaultAllocator allocator;
+    VM vm({.mm{.allocator = &allocator}});
+    auto scope = vm.mem.gc_new_auto<VM::Scope>(vm.mem.gc_new_auto<VM::Object>(vm).get(), nullptr);
+
+    // The front-end recursion depth grows with the amount of elements of the array
+    run_with_stack(268435456, [&]() -> void {
+        BENCHMARK("evaluate 1 MiB") {
+            return util::eval_expr(vm, nullptr, scope.get(), "<bench>", "<bench>", src);
+        };
+    });
+
+    BENCHMARK("load_data 1 MiB") {
+        auto stack = vm.mem.gc_new_auto<VM::Stack>(vm);
+        REQUIRE(load_data(*stack, "<bench>", src));
+        return stack;
+    };
+}
@@ -0,0 +1,10 @@
+# Tight loop over local integer variables
+exports = {};
+run = -> (
+    .i, .sum = 0, 0;
+    i < 1000000 repeats (
+        sum = (sum + i * 7) % 1000003;
+        i = i + 1;
+    );
+    print(sum);
+);
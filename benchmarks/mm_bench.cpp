@@ -0,0 +1,170 @@
+#include "catch2/catch_test_macros.hpp"
+#include "catch2/benchmark/catch_benchmark.hpp"
+
+#include "mm.hpp"
+#include "vm.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace funscript;
+
+namespace {
+
+    // Heap sizes (in allocations) at which GC pauses are measured.
+    const std::vector<size_t> HEAP_SIZES = {10000, 100000, 1000000, 10000000};
+
+    /**
+     * @return The maximum heap size to measure, set by `FUNSCRIPT_BENCH_MAX_OBJECTS` (10M by default).
+     */
+    size_t get_max_objects() {
+        const char *str = getenv("FUNSCRIPT_BENCH_MAX_OBJECTS");
+        return str ? std::stoull(str) : HEAP_SIZES.back();
+    }
+
+    uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Builder of a heap of a specific shape. Creates approximately `n` GC-tracked allocations and returns the pinned root
+     * of the live ones, or `nullptr` if all of them are garbage.
+     */
+    using heap_builder_t = std::function<MemoryManager::AutoPtr<Allocation>(VM &vm, size_t n)>;
+
+    // One array which references `n` empty objects.
+    MemoryManager::AutoPtr<Allocation> build_wide_array(VM &vm, size_t n) {
+        auto arr = vm.mem.gc_new_auto<VM::Array>(vm, n);
+        for (size_t pos = 0; pos < n; pos++) {
+            auto *obj = vm.mem.gc_new<VM::Object>(vm);
+            (*arr)[pos] = {Type::OBJ, {.obj = obj}};
+            vm.mem.gc_unpin(obj);
+        }
+        return MemoryManager::AutoPtr<Allocation>(arr.get());
+    }
+
+    // Singly linked list of `n` single-element arrays.
+    MemoryManager::AutoPtr<Allocation> build_linked_list(VM &vm, size_t n) {
+        auto head = vm.mem.gc_new_auto<VM::Array>(vm, 1);
+        for (size_t pos = 1; pos < n; pos++) {
+            auto node = vm.mem.gc_new_auto<VM::Array>(vm, 1);
+            (*node)[0] = {Type::ARR, {.arr = head.get()}};
+            head = std::move(node);
+        }
+        return MemoryManager::AutoPtr<Allocation>(head.get());
+    }
+
+    // `n` unreachable small strings.
+    MemoryManager::AutoPtr<Allocation> build_small_garbage(VM &vm, size_t n) {
+        for (size_t pos = 0; pos < n; pos++) {
+            vm.mem.gc_unpin(vm.mem.gc_new<VM::String>(vm, FStr("garbage", vm.mem.str_alloc())));
+        }
+        return MemoryManager::AutoPtr<Allocation>(nullptr);
+    }
+
+    // Chain of scopes, each of them holds a closure which references the scope back (3 allocations per scope).
+    MemoryManager::AutoPtr<Allocation> build_scope_cycles(VM &vm, size_t n) {
+        auto mod_obj = vm.mem.gc_new_auto<VM::Object>(vm);
+        auto mod = vm.mem.gc_new_auto<VM::Module>(vm, FStr("bench", vm.mem.str_alloc()), nullptr, mod_obj.get());
+        auto bytecode = vm.mem.gc_new_auto<VM::Bytecode>(vm, "");
+        auto scope = vm.mem.gc_new_auto<VM::Scope>(mod_obj.get(), nullptr);
+        for (size_t pos = 3; pos < n; pos += 3) {
+            auto vars = vm.mem.gc_new_auto<VM::Object>(vm);
+            auto inner = vm.mem.gc_new_auto<VM::Scope>(vars.get(), scope.get());
+            auto *fun = vm.mem.gc_new<VM::BytecodeFunction>(vm, mod.get(), inner.get(), bytecode.get());
+            vars->set_field(FStr("f", vm.mem.str_alloc()), {Type::FUN, {.fun = fun}});
+            vm.mem.gc_unpin(fun);
+            scope = std::move(inner);
+        }
+        return MemoryManager::AutoPtr<Allocation>(scope.get());
+    }
+}
+
+TEST_CASE("MemoryManager operations", "[mm]") {
+    DefaultAllocator allocator;
+    VM vm({.mm{.allocator = &allocator}});
+    auto obj = vm.mem.gc_new_auto<VM::Object>(vm);
+
+    BENCHMARK_ADVANCED("gc_new<Object>")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&vm]() -> void { vm.mem.gc_unpin(vm.mem.gc_new<VM::Object>(vm)); });
+        vm.mem.gc_cycle();
+    };
+
+    BENCHMARK_ADVANCED("gc_new<String>")(Catch::Benchmark::Chronometer meter) {
+        FStr str("some string", vm.mem.str_alloc());
+        meter.measure([&vm, &str]() -> void { vm.mem.gc_unpin(vm.mem.gc_new<VM::String>(vm, str)); });
+        vm.mem.gc_cycle();
+    };
+
+    BENCHMARK_ADVANCED("gc_new_arr<Value>(16)")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&vm]() -> void { vm.mem.gc_unpin(vm.mem.gc_new_arr<VM::Value>(vm, 16, Type::INT)); });
+        vm.mem.gc_cycle();
+    };
+
+    BENCHMARK("gc_pin + gc_unpin") {
+        vm.mem.gc_pin(obj.get());
+        vm.mem.gc_unpin(obj.get());
+        return obj.get();
+    };
+
+    BENCHMARK("AutoPtr move") {
+        MemoryManager::AutoPtr<VM::Object> moved(std::move(obj));
+        obj = std::move(moved);
+        return obj.get();
+    };
+
+    BENCHMARK("AutoPtr construct + destruct") {
+        MemoryManager::AutoPtr<VM::Object> ptr(obj.get());
+        return ptr.get();
+    };
+}
+
+TEST_CASE("GC pauses by heap size", "[gc]") {
+    const std::vector<std::pair<const char *, heap_builder_t>> shapes = {
+            {"wide array",    build_wide_array},
+            {"linked list",   build_linked_list},
+            {"small garbage", build_small_garbage},
+            {"scope cycles",  build_scope_cycles},
+    };
+    size_t max_objects = get_max_objects();
+    std::cout << std::left << std::setw(16) << "shape" << std::right << std::setw(12) << "objects"
+              << std::setw(12) << "ns/alloc" << std::setw(12) << "pause ms" << std::setw(12) << "mark ms"
+              << std::setw(12) << "sweep ms" << std::setw(16) << "mark obj/s" << std::endl;
+    for (const auto &[name, build] : shapes) {
+        for (size_t size : HEAP_SIZES) {
+            if (size > max_objects) break;
+            size_t repeats = size < 1000000 ? 5 : 1;
+            uint64_t build_time = UINT64_MAX;
+            MemoryManager::gc_stats_t best{.end_time = UINT64_MAX};
+            bool live = true;
+            for (size_t rep = 0; rep < repeats; rep++) {
+                DefaultAllocator allocator;
+                VM vm({.mm{.allocator = &allocator}});
+                MemoryManager::gc_stats_t stats{};
+                vm.mem.gc_stats_hook = [&stats](const MemoryManager::gc_stats_t &cycle) -> void { stats = cycle; };
+                uint64_t beg = now();
+                auto root = build(vm, size);
+                build_time = std::min(build_time, now() - beg);
+                vm.mem.gc_cycle();
+                REQUIRE(stats.freed_allocs == (root ? 0 : size));
+                live = root;
+                if (stats.end_time - stats.beg_time < best.end_time - best.beg_time) best = stats;
+            }
+            double mark_ms = double(best.mark_end_time - best.beg_time) / 1e6;
+            std::cout << std::left << std::setw(16) << name << std::right << std::setw(12) << size << std::fixed
+                      << std::setprecision(1) << std::setw(12) << double(build_time) / double(size)
+                      << std::setprecision(3) << std::setw(12) << double(best.end_time - best.beg_time) / 1e6
+                      << std::setw(12) << mark_ms << std::setw(12) << double(best.end_time - best.mark_end_time) / 1e6
+                      << std::setprecision(0) << std::setw(16);
+            if (live) std::cout << double(size) / (mark_ms / 1e3) << std::endl;
+            else std::cout << "-" << std::endl; // Nothing is marked in a heap of garbage
+        }
+    }
+}
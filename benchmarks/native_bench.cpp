@@ -0,0 +1,252 @@
+#include "catch2/catch_test_macros.hpp"
+#include "catch2/benchmark/catch_benchmark.hpp"
+
+#include "vm.hpp"
+#include "utils.hpp"
+#include "transfer.hpp"
+#include "kernels.hpp"
+
+#include <cstring>
+
+using namespace funscript;
+
+namespace {
+
+    // The same natives bound in both ways: a `bytes_paste_from_string`-like one and a trivial one.
+
+    void paste_bound(VM::Stack &stack, Allocation *data, fint pos, VM::String *str, fint beg, fint end) {
+        char *bytes = dynamic_cast<ArrayAllocation<char> *>(data)->data();
+        std::memcpy(bytes + pos, str->bytes.c_str() + beg, end - beg);
+    }
+
+    void paste_wrapped(VM::Stack &stack) {
+        std::function fn([](MemoryManager::AutoPtr<Allocation> data, fint pos, MemoryManager::AutoPtr<VM::String> str,
+                            fint beg, fint end) -> void {
+            char *bytes = dynamic_cast<ArrayAllocation<char> *>(data.get())->data();
+            std::memcpy(bytes + pos, str->bytes.c_str() + beg, end - beg);
+        });
+        util::call_native_function(stack, fn);
+    }
+
+    fint add_bound(VM::Stack &stack, fint a, fint b) {
+        return a + b;
+    }
+
+    void add_wrapped(VM::Stack &stack) {
+        std::function fn([](fint a, fint b) -> fint { return a + b; });
+        util::call_native_function(stack, fn);
+    }
+
+    void push_paste_args(VM::Stack &stack, Allocation *data, VM::String *str) {
+        stack.push_sep();
+        stack.push_ptr(data);
+        stack.push_int(0);
+        stack.push_str(str);
+        stack.push_int(0);
+        stack.push_int(fint(str->bytes.size()));
+    }
+
+    void push_add_args(VM::Stack &stack) {
+        stack.push_sep();
+        stack.push_int(2);
+        stack.push_int(3);
+    }
+}
+
+TEST_CASE("Native function binding", "[natives]") {
+    DefaultAllocator allocator;
+    VM vm({.mm{.allocator = &allocator}});
+    auto stack = vm.mem.gc_new_auto<VM::Stack>(vm);
+    auto data = vm.mem.gc_new_auto_arr(vm, 64, char(0));
+    auto str = vm.mem.gc_new_auto<VM::String>(vm, FStr("some string", vm.mem.str_alloc()));
+
+    // The cost of passing arguments through the stack, which is shared by both ways of binding
+    BENCHMARK("push + pop, 5 arguments") {
+        push_paste_args(*stack, data.get(), str.get());
+        stack->pop(stack->find_sep());
+        return stack->size();
+    };
+
+    BENCHMARK("call_native_function, 5 arguments") {
+        push_paste_args(*stack, data.get(), str.get());
+        paste_wrapped(*stack);
+        return stack->size();
+    };
+
+    BENCHMARK("bind_native, 5 arguments") {
+        push_paste_args(*stack, data.get(), str.get());
+        util::bind_native<paste_bound>(*stack);
+        return stack->size();
+    };
+
+    BENCHMARK("call_native_function, 2 arguments + result") {
+        push_add_args(*stack);
+        add_wrapped(*stack);
+        stack->pop();
+        return stack->size();
+    };
+
+    BENCHMARK("bind_native, 2 arguments + result") {
+        push_add_args(*stack);
+        util::bind_native<add_bound>(*stack);
+        stack->pop();
+        return stack->size();
+    };
+}
+
+TEST_CASE("Calls from C++", "[calls]") {
+    DefaultAllocator allocator;
+    VM vm({.mm{.allocator = &allocator}});
+    auto globals = vm.mem.gc_new_auto<VM::Object>(vm);
+    auto scope = vm.mem.gc_new_auto<VM::Scope>(globals.get(), nullptr);
+    auto def = util::eval_fn(vm, util::compile_fn(vm, nullptr, scope.get(), "<bench>", ".n -> n + 1").get());
+    REQUIRE(!def->is_panicked());
+    VM::Function *handler = (*def)[0].data.fun;
+    VM::Value arg(Type::INT, {.num = 41});
+
+    // New execution stack for every call, as `util::eval_fn()` does
+    BENCHMARK_ADVANCED("new stack per call")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&vm, handler, &arg]() -> fint {
+            auto stack = vm.mem.gc_new_auto<VM::Stack>(vm, handler);
+            stack->push_sep();
+            stack->push(arg);
+            stack->execute();
+            return (*stack)[-1].data.num;
+        });
+        vm.mem.gc_cycle();
+    };
+
+    BENCHMARK_ADVANCED("CallContext")(Catch::Benchmark::Chronometer meter) {
+        util::CallContext ctx(vm, handler);
+        meter.measure([&ctx, &arg]() -> fint {
+            ctx.call({arg});
+            return ctx.results()[0].data.num;
+        });
+        vm.mem.gc_cycle();
+    };
+}
+
+TEST_CASE("Panics", "[panics]") {
+    DefaultAllocator allocator;
+    VM vm({.mm{.allocator = &allocator}});
+    auto globals = vm.mem.gc_new_auto<VM::Object>(vm);
+    auto scope = vm.mem.gc_new_auto<VM::Scope>(globals.get(), nullptr);
+    auto throwing = vm.mem.gc_new_auto<VM::NativeFunction>(vm, nullptr, [](VM::Stack &stack) -> void {
+        stack.panic("invalid value");
+    });
+    auto raising = vm.mem.gc_new_auto<VM::NativeFunction>(vm, nullptr, [](VM::Stack &stack) -> void {
+        stack.raise_panic("invalid value");
+    });
+    globals->set_field(FStr("throwing", vm.mem.str_alloc()), {Type::FUN, {.fun = throwing.get()}});
+    globals->set_field(FStr("raising", vm.mem.str_alloc()), {Type::FUN, {.fun = raising.get()}});
+    // Every panic unwinds 8 bytecode frames
+    auto def = util::eval_fn(vm, util::compile_fn(vm, nullptr, scope.get(), "<bench>",
+                                                  ".v = (.n, .f) -> (n > 0 then v(n - 1, f) else f()); "
+                                                  ".d = (.n, .f) -> (n > 0 then d(n - 1, f) else 1 / 0); v, d").get());
+    REQUIRE(!def->is_panicked());
+    VM::Function *validate = (*def)[0].data.fun, *divide = (*def)[1].data.fun;
+    VM::Value depth(Type::INT, {.num = 7});
+
+    BENCHMARK_ADVANCED("interpreter panic")(Catch::Benchmark::Chronometer meter) {
+        util::CallContext ctx(vm, divide);
+        meter.measure([&ctx, &depth]() -> bool { return ctx.call({depth, VM::Value(Type::INT)}); });
+        vm.mem.gc_cycle();
+    };
+
+    BENCHMARK_ADVANCED("native raise_panic")(Catch::Benchmark::Chronometer meter) {
+        util::CallContext ctx(vm, validate);
+        VM::Value fn(Type::FUN, {.fun = raising.get()});
+        meter.measure([&ctx, &depth, &fn]() -> bool { return ctx.call({depth, fn}); });
+        vm.mem.gc_cycle();
+    };
+
+    BENCHMARK_ADVANCED("native panic (thrown)")(Catch::Benchmark::Chronometer meter) {
+        util::CallContext ctx(vm, validate);
+        VM::Value fn(Type::FUN, {.fun = throwing.get()});
+        meter.measure([&ctx, &depth, &fn]() -> bool { return ctx.call({depth, fn}); });
+        vm.mem.gc_cycle();
+    };
+}
+
+TEST_CASE("Serialization", "[serialization]") {
+    DefaultAllocator allocator;
+    VM vm({.mm{.allocator = &allocator}});
+    auto globals = vm.mem.gc_new_auto<VM::Object>(vm);
+    auto scope = vm.mem.gc_new_auto<VM::Scope>(globals.get(), nullptr);
+    // About 1 MiB of records with the same field names
+    auto def = util::eval_fn(vm, util::compile_fn(vm, nullptr, scope.get(), "<bench>",
+                                                  ".arr = [0] * 20000; .n = 0; n < 20000 repeats ("
+                                                  "arr[n] = {.id = n * 1000; .name = 'record'; .score = 0.5; "
+                                                  ".tags = ['first', 'second']; .ok = yes}; n = n + 1); arr").get());
+    REQUIRE(!def->is_panicked());
+    VM::Value records = (*def)[0];
+    Serializer serializer;
+    serializer.write(&records, &records + 1);
+    const std::string data = serializer.get_buffer();
+    auto stack = vm.mem.gc_new_auto<VM::Stack>(vm);
+
+    BENCHMARK("serialize") {
+        Serializer out;
+        out.write(&records, &records + 1);
+        return out.get_buffer().size();
+    };
+
+    BENCHMARK_ADVANCED("deserialize")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&stack, &data]() -> bool {
+            Deserializer in(data);
+            bool result = in.read(*stack);
+            stack->pop(0);
+            return result;
+        });
+        vm.mem.gc_cycle();
+    };
+
+    BENCHMARK("TransferBuffer::pack") {
+        return TransferBuffer::pack(&records, &records + 1).size();
+    };
+}
+
+TEST_CASE("Typed arrays", "[typed-arrays]") {
+    constexpr size_t LEN = 1 << 20;
+    DefaultAllocator allocator;
+    VM vm({.mm{.allocator = &allocator}});
+    auto boxed = vm.mem.gc_new_auto<VM::Array>(vm, LEN);
+    auto a = vm.mem.gc_new_auto<VM::TypedArray>(vm, VM::TypedArray::ElemType::FLOAT64, LEN);
+    auto b = vm.mem.gc_new_auto<VM::TypedArray>(vm, VM::TypedArray::ElemType::FLOAT64, LEN);
+    auto dst = vm.mem.gc_new_auto<VM::TypedArray>(vm, VM::TypedArray::ElemType::FLOAT64, LEN);
+    auto mask = vm.mem.gc_new_auto<VM::TypedArray>(vm, VM::TypedArray::ElemType::UINT8, LEN);
+    for (size_t pos = 0; pos < LEN; pos++) {
+        VM::Value val(Type::FLP, {.flp = fflp(pos % 1000) / 8});
+        (*boxed)[pos] = val;
+        a->set(pos, val);
+        b->set(pos, val);
+    }
+
+    // The same reduction over an array of values, which checks the type of every element
+    BENCHMARK("sum of VM::Array") {
+        fflp sum = 0;
+        for (const auto &val : *boxed) {
+            if (val.type != Type::FLP) return fflp(0);
+            sum += val.data.flp;
+        }
+        return sum;
+    };
+
+    BENCHMARK("kernels::sum") {
+        return kernels::sum(*a).data.flp;
+    };
+
+    BENCHMARK("kernels::dot") {
+        return kernels::dot(*a, *b).data.flp;
+    };
+
+    BENCHMARK("kernels::add") {
+        kernels::add(*dst, *a, *b);
+        return dst->data()[0];
+    };
+
+    BENCHMARK("kernels::less") {
+        kernels::less(*mask, *a, *b);
+        return mask->data()[0];
+    };
+}
@@ -0,0 +1,13 @@
+# Reads and writes of object fields
+exports = {};
+run = -> (
+    .point = {.x = 0; .y = 0; .z = 0};
+    .i = 0;
+    i < 200000 repeats (
+        point.x = point.x + 1;
+        point.y = point.y + point.x;
+        point.z = point.z + point.y % 3;
+        i = i + 1;
+    );
+    print(point.z);
+);
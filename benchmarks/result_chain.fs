@@ -0,0 +1,12 @@
+# Chains of Result combinators
+exports = {};
+.check = .x -> (x % 5 == 0 then Result[integer][string].err('divisible') else Result[integer][string].ok(x));
+run = -> (
+    .i, .oks, .errs = 0, 0, 0;
+    i < 2000 repeats (
+        check(i).and_then[integer](.x -> check(x + 1)).then_map[integer](.x -> x * 2)
+            .then_map[](.x -> (oks = oks + 1)).else_map[](.err -> (errs = errs + 1));
+        i = i + 1;
+    );
+    print(oks, errs);
+);
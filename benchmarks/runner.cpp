@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "vm.hpp"
+#include "utils.hpp"
+
+using namespace funscript;
+
+/**
+ * Allocator which counts allocations and tracks the peak size of the heap.
+ */
+class CountingAllocator : public Allocator {
+    size_t limit_bytes, used_bytes = 0;
+public:
+    size_t allocations = 0; // Amount of allocations since the last reset.
+    size_t allocated_bytes = 0; // Total size of allocations since the last reset.
+    size_t peak_bytes = 0; // Maximum size of the heap since the last reset.
+
+    explicit CountingAllocator(size_t limit_bytes) : limit_bytes(limit_bytes) {}
+
+    void set_limit(size_t new_limit_bytes) {
+        limit_bytes = new_limit_bytes;
+    }
+
+    [[nodiscard]] size_t get_used() const {
+        return used_bytes;
+    }
+
+    void reset() {
+        allocations = allocated_bytes = 0;
+        peak_bytes = used_bytes;
+    }
+
+    void *allocate(size_t size) override {
+        if (limit_bytes - used_bytes < size) throw OutOfMemoryError();
+        void *ptr = std::malloc(size);
+        if (!ptr) throw OutOfMemoryError();
+        used_bytes += size;
+        allocations++;
+        allocated_bytes += size;
+        peak_bytes = std::max(peak_bytes, used_bytes);
+        return ptr;
+    }
+
+    void free(void *ptr, size_t size) noexcept override {
+        if (ptr) used_bytes -= size;
+        std::free(ptr);
+    }
+};
+
+// The modules of the standard library in the order of loading, along with their imports.
+static const std::vector<std::pair<std::string, std::vector<std::string>>> STD_MODULES = {
+        {"std.native",     {}},
+        {"std.lang",       {"std.native"}},
+        {"std.sys",        {"std.lang"}},
+        {"std.io",         {"std.lang"}},
+        {"std.coroutines", {"std.lang"}},
+        {"std.events",     {"std.lang"}},
+        {"std.channels",   {"std.lang"}},
+        {"std.parallel",   {"std.lang"}},
+        {"std",            {"std.lang"}},
+};
+
+// The modules imported into every benchmark.
+static const std::vector<std::string> BENCHMARK_IMPORTS = {"std", "std.lang"};
+
+struct bench_conf_t {
+    size_t iterations = 5; // Amount of measured runs of every benchmark.
+    size_t warmup = 1; // Amount of runs before the measured ones.
+    size_t heap_limit = 1073741824; // The maximum heap size of a benchmark in bytes (1 GiB).
+    size_t input_lines = 200; // Amount of lines of the standard input of every run.
+};
+
+struct bench_result_t {
+    std::string name;
+    std::vector<uint64_t> times; // Wall time of every measured run, in nanoseconds.
+    size_t allocations = 0; // Maximum amount of allocations per run.
+    size_t allocated_bytes = 0; // Maximum total size of allocations per run.
+    size_t heap_base_bytes = 0; // Size of the heap after loading the benchmark.
+    size_t heap_peak_bytes = 0; // Maximum size of the heap during a run.
+    std::optional<std::string> error;
+};
+
+static std::string prog_name; // The name of the executable (`argv[0]`).
+
+/**
+ * Creates an anonymous in-memory file with the specified amount of text lines.
+ * @return The file descriptor of the file, or `-1` on failure.
+ */
+static int make_input_fd(size_t lines) {
+    std::string data;
+    for (size_t line = 0; line < lines; line++) {
+        data += std::to_string(line) + " lorem ipsum dolor sit amet, consectetur adipiscing elit\n";
+    }
+    int fd = memfd_create("funscript-bench-input", MFD_CLOEXEC);
+    if (fd == -1) return -1;
+    for (size_t pos = 0; pos < data.size();) {
+        auto cnt = write(fd, data.data() + pos, data.size() - pos);
+        if (cnt <= 0) {
+            close(fd);
+            return -1;
+        }
+        pos += cnt;
+    }
+    return fd;
+}
+
+/**
+ * Loads the benchmark module into a fresh VM and measures its runner.
+ * @param path The path to the source of the benchmark.
+ * @param conf The configuration of measurements.
+ * @param input_fd The file descriptor of the standard input of every run.
+ * @return The measurements.
+ */
+static bench_result_t run_benchmark(const std::filesystem::path &path, const bench_conf_t &conf, int input_fd) {
+    bench_result_t result{.name = path.stem().string()};
+    CountingAllocator allocator(conf.heap_limit);
+    VM vm({
+                  .mm{.allocator = &allocator},
+                  .stack_values_max = 67108864 /* 64 Mi */,
+                  .stack_frames_max = 256 /* 1 Ki */
+          });
+    try {
+        for (const auto &[name, imps] : STD_MODULES) {
+            auto module_obj = util::load_module(vm, name, imps, {});
+            vm.register_module(FStr(name, vm.mem.str_alloc()), module_obj.get());
+        }
+        auto name = "bench." + result.name;
+        auto module_obj = util::load_src_module(vm, name, path, BENCHMARK_IMPORTS, {});
+        vm.register_module(FStr(name, vm.mem.str_alloc()), module_obj.get());
+    } catch (const util::ModuleLoadingError &err) {
+        if (err.stack) util::print_panic(*err.stack);
+        result.error = err.what();
+        return result;
+    }
+    auto run_val = vm.get_module(FStr("bench." + result.name, vm.mem.str_alloc())).value()->
+            object->get_field(FStr(MODULE_RUNNER_VAR, vm.mem.str_alloc())).value();
+    if (run_val.type != Type::FUN) {
+        result.error = "benchmark is not runnable";
+        return result;
+    }
+    vm.mem.gc_cycle();
+    result.heap_base_bytes = allocator.get_used();
+    allocator.set_limit(result.heap_base_bytes + conf.heap_limit);
+    for (size_t run = 0; run < conf.warmup + conf.iterations; run++) {
+        vm.mem.gc_cycle(); // Every run starts with a heap containing only the loaded modules
+        lseek(input_fd, 0, SEEK_SET);
+        dup2(input_fd, STDIN_FILENO);
+        allocator.reset();
+        auto beg = std::chrono::steady_clock::now();
+        auto stack = vm.mem.gc_new_auto<VM::Stack>(vm, run_val.data.fun);
+        stack->push_sep();
+        try {
+            stack->execute();
+        } catch (const OutOfMemoryError &) {
+            result.error = "out of memory";
+            return result;
+        }
+        auto end = std::chrono::steady_clock::now();
+        if (stack->is_panicked()) {
+            util::print_panic(*stack);
+            result.error = "benchmark panicked";
+            return result;
+        }
+        if (run < conf.warmup) continue;
+        result.times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - beg).count());
+        result.allocations = std::max(result.allocations, allocator.allocations);
+        result.allocated_bytes = std::max(result.allocated_bytes, allocator.allocated_bytes);
+        result.heap_peak_bytes = std::max(result.heap_peak_bytes, allocator.peak_bytes);
+    }
+    return result;
+}
+
+/**
+ * Writes the measurements as a single-line JSON object.
+ */
+static void write_result(std::ostream &out, bench_result_t result) {
+    out << "{\"benchmark\": \"" << Tracer::escape(result.name) << "\"";
+    if (result.error.has_value()) {
+        out << ", \"error\": \"" << Tracer::escape(result.error.value()) << "\"}" << std::endl;
+        return;
+    }
+    std::sort(result.times.begin(), result.times.end());
+    out << ", \"iterations\": " << result.times.size()
+        << ", \"time_min_ns\": " << result.times.front()
+        << ", \"time_median_ns\": " << result.times[result.times.size() / 2]
+        << ", \"time_max_ns\": " << result.times.back()
+        << ", \"allocations\": " << result.allocations
+        << ", \"allocated_bytes\": " << result.allocated_bytes
+        << ", \"heap_base_bytes\": " << result.heap_base_bytes
+        << ", \"heap_peak_bytes\": " << result.heap_peak_bytes << "}" << std::endl;
+}
+
+// The numeric options of the runner.
+static const std::map<std::string, size_t bench_conf_t::*> NUMBER_OPTIONS = {
+        {"-n",            &bench_conf_t::iterations},
+        {"-w",            &bench_conf_t::warmup},
+        {"--heap-limit",  &bench_conf_t::heap_limit},
+        {"--input-lines", &bench_conf_t::input_lines},
+};
+
+/**
+ * Parses a non-negative decimal number.
+ * @return `false` if the string is not a number.
+ */
+static bool parse_number(const std::string &str, size_t &num) {
+    if (str.empty() || str.find_first_not_of("0123456789") != std::string::npos) return false;
+    num = std::stoul(str);
+    return true;
+}
+
+static void print_usage() {
+    std::cerr << "usage: " << prog_name << " [-n ITERATIONS] [-w WARMUP] [-o FILE] [--heap-limit BYTES] "
+                                           "[--input-lines LINES] BENCHMARK.fs..." << std::endl;
+}
+
+/**
+ * Runs Funscript benchmarks and writes their measurements as JSON lines, one object per benchmark:
+ * wall time of the runs, amount and total size of heap allocations per run, and the heap size before and at the peak
+ * of a run. The standard library is loaded from the directory specified by `FS_MODULES_PATH`. The output of
+ * benchmarks is discarded, and every run receives the same generated text as its standard input.
+ */
+int main(int argc, char **argv) {
+    prog_name = argv[0];
+    std::vector<std::string> args(argv, argv + argc);
+    bench_conf_t conf;
+    std::optional<std::string> out_path;
+    std::vector<std::filesystem::path> benchmarks;
+    for (size_t pos = 1; pos < args.size(); pos++) {
+        const auto &arg = args[pos];
+        if (NUMBER_OPTIONS.contains(arg)) {
+            if (++pos >= args.size() || !parse_number(args[pos], conf.*NUMBER_OPTIONS.at(arg))) {
+                std::cerr << prog_name << ": " << arg << ": number expected" << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (arg == "-o") {
+            if (++pos >= args.size()) {
+                std::cerr << prog_name << ": " << arg << ": output path expected" << std::endl;
+                return 1;
+            }
+            out_path = args[pos];
+            continue;
+        }
+        if (arg.starts_with("-")) {
+            std::cerr << prog_name << ": " << arg << ": invalid option" << std::endl;
+            print_usage();
+            return 1;
+        }
+        benchmarks.emplace_back(arg);
+    }
+    if (benchmarks.empty()) {
+        print_usage();
+        return 1;
+    }
+    if (!conf.iterations || !conf.heap_limit || !conf.input_lines) {
+        std::cerr << prog_name << ": iterations, heap limit and input lines must be positive" << std::endl;
+        return 1;
+    }
+    if (!getenv(MODULES_PATH_ENV_VAR)) {
+        std::cerr << prog_name << ": no modules path is set" << std::endl;
+        return 1;
+    }
+    std::ofstream out_file;
+    if (out_path.has_value()) {
+        out_file.open(out_path.value());
+        if (!out_file) {
+            std::cerr << prog_name << ": " << out_path.value() << ": failed to open" << std::endl;
+            return 1;
+        }
+    }
+    int input_fd = make_input_fd(conf.input_lines);
+    int stdout_fd = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (input_fd == -1 || stdout_fd == -1 || null_fd == -1) {
+        std::cerr << prog_name << ": failed to prepare standard streams: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    int exit_code = 0;
+    for (const auto &path : benchmarks) {
+        dup2(null_fd, STDOUT_FILENO); // The output of benchmarks is discarded
+        auto result = run_benchmark(path, conf, input_fd);
+        dup2(stdout_fd, STDOUT_FILENO);
+        if (result.error.has_value()) {
+            std::cerr << prog_name << ": " << path.string() << ": " << result.error.value() << std::endl;
+            exit_code = 1;
+        }
+        write_result(out_path.has_value() ? out_file : std::cout, std::move(result));
+    }
+    return exit_code;
+}
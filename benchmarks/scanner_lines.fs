@@ -0,0 +1,11 @@
+# Line-by-line reading of the standard input
+exports = {};
+run = -> (
+    .scanner = io.Scanner.with_source(io.BufferedReader.bufferize(io.stdin, 8192));
+    .lines, .chars = 0, 0;
+    scanner.lines().for_each(.line -> (
+        lines = lines + 1;
+        chars = chars + sizeof line;
+    ));
+    print(lines, chars);
+);
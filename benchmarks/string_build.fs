@@ -0,0 +1,15 @@
+# Concatenation of short strings
+exports = {};
+run = -> (
+    .i, .total = 0, 0;
+    i < 10000 repeats (
+        .str, .j = '', 0;
+        j < 20 repeats (
+            str = str + 'item' + ', ';
+            j = j + 1;
+        );
+        total = total + sizeof str;
+        i = i + 1;
+    );
+    print(total);
+);
@@ -81,6 +81,9 @@ namespace funscript {
 
         std::vector<std::unique_ptr<Chunk>> chunks; // Collection of code chunks.
         std::vector<pointer> pointers; // Collection of scheduled pointer insertions.
+        // Byte offsets of the source lines, starting from `first_row`. Empty unless functions are compiled lazily.
+        std::vector<size_t> lines;
+        size_t first_row = 0;
     public:
 
         Chunk &data_chunk();
@@ -109,6 +112,29 @@ namespace funscript {
          */
         void compile_expression(AST *ast);
 
+        /**
+         * Compiles parsed function expression, so that the code of the function starts at the beginning of the
+         * bytecode. Used to compile functions which were compiled lazily.
+         * @param ast The AST of the function expression (as in `.x -> x + 1`).
+         */
+        void compile_function(AST *ast);
+
+        /**
+         * Makes the assembler compile nested functions lazily: instead of their code, the bytecode gets the location of
+         * their source (see `Opcode::LAZ`), which is compiled by `compile_function()` when the function is called.
+         * @param code The code which is going to be compiled.
+         * @param beg_offset Byte offset of the code in the source file.
+         * @param beg_pos Position of the code in the source file.
+         */
+        void set_lazy_source(const std::string &code, size_t beg_offset = 0, code_pos_t beg_pos = {1, 1});
+
+        [[nodiscard]] bool is_lazy() const;
+
+        /**
+         * @return Byte offset of the position in the source file, only available if functions are compiled lazily.
+         */
+        [[nodiscard]] size_t source_offset(code_pos_t pos) const;
+
         /**
          * Calculates the total size of all chunks after compilation.
          * @return Total size of bytecode.
@@ -191,9 +217,10 @@ namespace funscript {
     /**
      * Parses a stream of code tokens into an AST node of the whole expression.
      * @param tokens Vector of code tokens.
+     * @param start Position of the code in the source file (when a part of the file is parsed).
      * @return Resulting AST node.
      */
-    ast_ptr parse(const std::string &filename, std::vector<Token> tokens);
+    ast_ptr parse(const std::string &filename, std::vector<Token> tokens, code_pos_t start = {1, 1});
 
     /**
      * Class of AST leaves which represent integer literals.
@@ -246,6 +273,14 @@ namespace funscript {
         [[nodiscard]] code_loc_t get_location() const override;
     public:
         OperatorAST(const std::string &filename, code_loc_t token_loc, AST *left, AST *right, Operator op);
+
+        /**
+         * Generates the code of the function which is defined by this `->` expression.
+         * @param chunk The chunk of the function.
+         */
+        void compile_function(Assembler &as, Assembler::Chunk &chunk);
+
+        [[nodiscard]] bool is_function() const; // Whether this is a `->` expression.
     };
 
     /**
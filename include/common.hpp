@@ -210,7 +210,12 @@ namespace funscript {
         /**
          * @brief Wrap all values until the separator (excluding the separator itself) in a new object and put the object on the stack.
          */
-        WRP
+        WRP,
+        /**
+         * @brief Push a function whose code is compiled on its first call.
+         * @param u64 Bytecode offset of the function description (struct funscript::lazy_fn_t).
+         */
+        LAZ
     };
 
     /**
@@ -225,6 +230,16 @@ namespace funscript {
         Instruction(Opcode op, uint32_t meta, uint16_t u16, uint64_t u64) : op(op), u16(u16), meta(meta), u64(u64) {}
     };
 
+    /**
+     * Structure that describes a function whose code is compiled lazily, from its source.
+     */
+    struct lazy_fn_t {
+        uint64_t meta; // Bytecode offset of the metadata chunk of the function.
+        code_pos_t pos; // Position of the function operator (which is reported as the location of the function).
+        code_pos_t src_pos; // Position of the function expression in the source file.
+        uint64_t src_beg, src_end; // Byte offsets of the function expression in the source file.
+    };
+
     /**
      * Enumeration of language operators.
      */
@@ -427,6 +442,12 @@ namespace funscript {
     // Name of the variable that holds native module's symbol checking function.
     static const char *NATIVE_MODULE_SYMBOL_CHECKER_VAR = "has_native_sym";
 
+    // Name of the variable that holds the functions listed in native module's registration table.
+    static const char *NATIVE_MODULE_TABLE_VAR = "natives";
+
+    // Name of the registration entry point of native module libraries (see `native_module_fn_t`).
+    static const char *NATIVE_MODULE_TABLE_SYMBOL = "funscript_native_module";
+
 
     static const std::unordered_map<Opcode, const char *> OPCODES{
             {Opcode::NOP, "NOP"},
@@ -457,6 +478,7 @@ namespace funscript {
             {Opcode::CHK, "CHK"},
             {Opcode::OSC, "OSC"},
             {Opcode::WRP, "WRP"},
+            {Opcode::LAZ, "LAZ"},
     };
 
     static const char *get_opcode_name(Opcode op) {
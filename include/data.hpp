@@ -0,0 +1,24 @@
+#ifndef FUNSCRIPT_DATA_HPP
+#define FUNSCRIPT_DATA_HPP
+
+#include "vm.hpp"
+
+#include <string>
+
+namespace funscript {
+
+    /**
+     * Builds the values of a literal-only expression directly from its tokens, without compiling and executing it.
+     * Such expressions consist of integer, float, string and boolean literals (numbers may be negated), arrays and
+     * objects with field definitions and indexed values, separated by commas and semicolons as in usual code. The
+     * values are the same as the ones produced by evaluation of the expression.
+     * @param stack The stack to push the values onto.
+     * @param filename The name of the file which contains the expression.
+     * @param code The expression.
+     * @return `true` if the expression is literal-only, `false` if it must be evaluated as usual (the stack is left
+     * unchanged then).
+     */
+    bool load_data(VM::Stack &stack, const std::string &filename, const std::string &code);
+}
+
+#endif //FUNSCRIPT_DATA_HPP
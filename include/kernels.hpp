@@ -0,0 +1,59 @@
+#ifndef FUNSCRIPT_KERNELS_HPP
+#define FUNSCRIPT_KERNELS_HPP
+
+#include "vm.hpp"
+
+#include <optional>
+#include <string_view>
+
+/**
+ * Vectorized kernels of typed arrays. The arguments are not checked: arrays must have the same element type and length
+ * (unless stated otherwise), scalars must be numbers of the element kind (integer or float).
+ * Integral elements wrap around on overflow. Reductions process the elements in several lanes at once, so floating
+ * point results may differ from the ones of sequential summation in the last bits.
+ */
+namespace funscript::kernels {
+
+    using ElemType = VM::TypedArray::ElemType;
+
+    /**
+     * @return The element type with the name (`int64`, `float64`, `int32`, `float32` or `uint8`).
+     */
+    std::optional<ElemType> parse_elem_type(std::string_view name);
+
+    const char *elem_type_name(ElemType elem_type);
+
+    void add(VM::TypedArray &dst, const VM::TypedArray &a, const VM::TypedArray &b);
+
+    void mul(VM::TypedArray &dst, const VM::TypedArray &a, const VM::TypedArray &b);
+
+    /**
+     * Compares the arrays elementwise, the results (1 or 0) are written to the `uint8` array.
+     */
+    void less(VM::TypedArray &dst, const VM::TypedArray &a, const VM::TypedArray &b);
+
+    void equal(VM::TypedArray &dst, const VM::TypedArray &a, const VM::TypedArray &b);
+
+    VM::Value sum(const VM::TypedArray &arr);
+
+    /**
+     * @return The minimum element of the non-empty array, or NaN if any element is NaN.
+     */
+    VM::Value min(const VM::TypedArray &arr);
+
+    /**
+     * @return The maximum element of the non-empty array, or NaN if any element is NaN.
+     */
+    VM::Value max(const VM::TypedArray &arr);
+
+    VM::Value dot(const VM::TypedArray &a, const VM::TypedArray &b);
+
+    void fill(VM::TypedArray &arr, const VM::Value &val);
+
+    /**
+     * Multiplies every element of the array by the scalar.
+     */
+    void scale(VM::TypedArray &arr, const VM::Value &factor);
+}
+
+#endif //FUNSCRIPT_KERNELS_HPP
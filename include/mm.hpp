@@ -4,6 +4,8 @@
 #include <string>
 #include <functional>
 #include <deque>
+#include <unordered_map>
+#include <unordered_set>
 #include <cstdint>
 
 namespace funscript {
@@ -36,6 +38,7 @@ namespace funscript {
         bool tracked = false;
         size_t mm_size = 0;
         size_t gc_pins = 0;
+        bool frozen = false; // Frozen allocations are immutable, never collected and can be shared between VMs.
 
     public:
         VM &vm;
@@ -57,6 +60,7 @@ namespace funscript {
         Allocation(Allocation &) = delete;
         Allocation(Allocation &&) = delete;
 
+        [[nodiscard]] bool is_frozen() const { return frozen; }
     };
 
     template<typename E>
@@ -147,6 +151,18 @@ namespace funscript {
     private:
         std::vector<Allocation *> gc_tracked; // Collection of all the allocation arrays tracked by the MM (and their sizes).
 
+    public:
+        /**
+         * Statistics of a finished GC cycle. Timestamps are taken from the monotonic clock, in nanoseconds.
+         */
+        struct gc_stats_t {
+            uint64_t beg_time, mark_end_time, end_time; // Marking phase is followed by sweeping phase.
+            size_t freed_allocs, freed_bytes;
+        };
+
+        std::function<void()> gc_hook; // If set, it is called at the beginning of every GC cycle.
+        std::function<void(const gc_stats_t &)> gc_stats_hook; // If set, it is called at the end of every GC cycle.
+
     public:
         /**
          * @tparam T Any type.
@@ -196,6 +212,13 @@ namespace funscript {
          */
         void gc_unpin(Allocation *alloc);
 
+        /**
+         * Freezes GC-tracked allocation and every allocation reachable from it. Frozen allocations stay pinned forever and
+         * are never modified by the MM, so they can be referenced from other VMs.
+         * @param alloc The allocation to freeze.
+         */
+        void gc_freeze(Allocation *alloc);
+
         /**
          * Constructs and pins a new GC-tracked allocation.
          * @tparam T Type of the allocation to create.
@@ -340,6 +363,8 @@ namespace funscript {
     using FVec = std::vector<E, AllocatorWrapper<E>>;
     template<typename E>
     using FDeq = std::deque<E, AllocatorWrapper<E>>;
+    template<typename E>
+    using FSet = std::unordered_set<E, std::hash<E>, std::equal_to<E>, AllocatorWrapper<E>>;
 
     template<typename T>
     T *AllocatorWrapper<T>::allocate(size_t n) {
@@ -360,6 +385,14 @@ namespace funscript {
     public:
         explicit DefaultAllocator(size_t limit_bytes = SIZE_MAX) : limit_bytes(limit_bytes) {}
 
+        void set_limit(size_t new_limit_bytes) {
+            limit_bytes = new_limit_bytes;
+        }
+
+        [[nodiscard]] size_t get_used() const {
+            return used_bytes;
+        }
+
         void *allocate(size_t size) override {
             if (limit_bytes - used_bytes < size) throw OutOfMemoryError();
             void *ptr = std::malloc(size);
@@ -0,0 +1,169 @@
+#ifndef FUNSCRIPT_PROFILER_HPP
+#define FUNSCRIPT_PROFILER_HPP
+
+#include "vm.hpp"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <signal.h>
+#include <time.h>
+
+namespace funscript {
+
+    /**
+     * Sampling CPU profiler of Funscript code. While it is running, the thread which started it is periodically
+     * interrupted by a CPU timer, and the frame chain of the active execution stack of the VM is recorded into a
+     * signal-safe ring buffer. Samples are symbolized later, at the beginning of every GC cycle and when the profiler
+     * is stopped, so that the recorded functions are guaranteed to be alive.
+     * Only one profiler can be running in the process at a time.
+     */
+    class Profiler {
+    public:
+        static constexpr size_t MAX_DEPTH = 64; // Maximum amount of recorded frames per sample (innermost ones).
+        static constexpr size_t BUFFER_SIZE = 4096; // Maximum amount of samples awaiting symbolization.
+
+    private:
+        struct raw_frame_t {
+            VM::Function *fun;
+            const char *filename;
+            code_pos_t position;
+        };
+
+        struct raw_sample_t {
+            size_t depth;
+            bool truncated;
+            raw_frame_t frames[MAX_DEPTH];
+        };
+
+        struct frame_t {
+            std::string function;
+            std::string filename;
+            size_t row;
+
+            auto operator<=>(const frame_t &) const = default;
+        };
+
+        VM &vm;
+        const unsigned frequency;
+        std::unique_ptr<raw_sample_t[]> buffer;
+        std::atomic<size_t> buffer_head = 0, buffer_tail = 0; // Positions of the first and past the last samples.
+        std::atomic<size_t> dropped = 0; // Amount of samples lost due to the buffer overflow.
+        std::map<std::vector<frame_t>, size_t> stacks; // Amounts of samples per symbolized stack, outermost frame first.
+        std::function<void()> prev_gc_hook;
+        timer_t timer{};
+        struct sigaction prev_action{};
+        bool running = false;
+        bool draining = false;
+
+        static void handle_signal(int sig, siginfo_t *info, void *ucontext);
+
+        void record_sample();
+
+        void drain();
+
+    public:
+        /**
+         * @param vm The VM to profile.
+         * @param frequency Sampling frequency, in samples per CPU second.
+         */
+        explicit Profiler(VM &vm, unsigned frequency = 99);
+
+        Profiler(const Profiler &) = delete;
+        Profiler &operator=(const Profiler &) = delete;
+
+        /**
+         * Starts sampling the calling thread.
+         */
+        void start();
+
+        /**
+         * Stops sampling and symbolizes the remaining samples.
+         */
+        void stop();
+
+        [[nodiscard]] size_t get_samples() const; // Amount of symbolized samples.
+        [[nodiscard]] size_t get_dropped() const; // Amount of samples lost due to the buffer overflow.
+
+        /**
+         * Writes the collected stacks in the folded format (one `frame;frame;... count` line per stack) which is
+         * accepted by `flamegraph.pl` and compatible tools.
+         */
+        void write_folded(std::ostream &out) const;
+
+        /**
+         * Writes the collected stacks as an uncompressed pprof `profile.proto` message.
+         */
+        void write_pprof(std::ostream &out) const;
+
+        ~Profiler();
+    };
+
+    /**
+     * Deterministic profiler which counts calls of every function and measures their inclusive and exclusive time.
+     * Calls are aggregated by function code, so all closures created from the same lambda share their statistics.
+     * The code of every called function is kept alive until the profiler is destroyed.
+     */
+    class CallProfiler final : public VM::CallHook {
+        struct stats_t {
+            std::string name;
+            std::string location;
+            size_t calls = 0;
+            size_t active = 0; // Amount of unfinished calls, used to measure inclusive time of recursive functions once.
+            uint64_t inclusive = 0; // Total time between entering and leaving the function, in nanoseconds.
+            uint64_t exclusive = 0; // Total time spent in the function itself, in nanoseconds.
+        };
+
+        struct call_t {
+            stats_t *stats;
+            uint64_t beg; // Time of entering the function.
+            uint64_t children = 0; // Total time spent in the called functions.
+        };
+
+        struct key_hash_t {
+            size_t operator()(const std::pair<Allocation *, size_t> &key) const {
+                return std::hash<Allocation *>()(key.first) ^ key.second * 0x9E3779B97F4A7C15ull;
+            }
+        };
+
+        VM &vm;
+        std::unordered_map<std::pair<Allocation *, size_t>, stats_t, key_hash_t> stats; // Keyed by code and offset.
+        std::unordered_map<VM::Stack *, std::vector<call_t>> calls; // Unfinished calls of every execution stack.
+        bool running = false;
+
+        static uint64_t now();
+
+    public:
+        explicit CallProfiler(VM &vm);
+
+        CallProfiler(const CallProfiler &) = delete;
+        CallProfiler &operator=(const CallProfiler &) = delete;
+
+        /**
+         * Starts instrumenting function calls of the VM.
+         */
+        void start();
+
+        /**
+         * Stops instrumenting function calls. Calls which are still running are not accounted.
+         */
+        void stop();
+
+        void enter(VM::Stack &stack, VM::Function *fun) override;
+        void leave(VM::Stack &stack, VM::Function *fun) override;
+
+        /**
+         * Writes a table of the called functions sorted by their exclusive time.
+         */
+        void write_report(std::ostream &out) const;
+
+        ~CallProfiler() override;
+    };
+}
+
+#endif //FUNSCRIPT_PROFILER_HPP
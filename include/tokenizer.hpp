@@ -242,8 +242,10 @@ namespace funscript {
      * @param filename The name of the file which is being parsed.
      * @param code Code to tokenize.
      * @param cb Callback function to call for every parsed token.
+     * @param start Position of the code in the source file (when a part of the file is tokenized).
      */
-    void tokenize(const std::string &filename, const std::string &code, const std::function<void(Token)> &cb);
+    void tokenize(const std::string &filename, const std::string &code, const std::function<void(Token)> &cb,
+                  code_pos_t start = {1, 1});
 }
 
 #endif //FUNSCRIPT_TOKENIZER_HPP
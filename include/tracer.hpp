@@ -0,0 +1,132 @@
+#ifndef FUNSCRIPT_TRACER_HPP
+#define FUNSCRIPT_TRACER_HPP
+
+#include "vm.hpp"
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace funscript {
+
+    /**
+     * Recorder of timeline events in Chrome Trace Event format (viewable in Perfetto or `chrome://tracing`).
+     * Once attached to a VM, it records function calls which last longer than the threshold (unless call tracing is
+     * disabled), GC cycles, module loading with its compilation phases and native I/O calls. Events are buffered per
+     * thread without locking, so a tracer can be shared by VMs running in different threads, but the trace can only be
+     * written after all of them have stopped recording.
+     */
+    class Tracer final : public VM::CallHook {
+        struct event_t {
+            std::string name;
+            const char *cat;
+            uint64_t beg, dur; // In nanoseconds.
+            std::string args; // JSON object of event arguments (may be empty).
+        };
+
+        struct call_t {
+            VM::Function *fun;
+            uint64_t beg;
+        };
+
+        struct thread_buffer_t {
+            long tid;
+            std::vector<event_t> events;
+            std::unordered_map<VM::Stack *, std::vector<call_t>> calls; // Unfinished calls of every execution stack.
+        };
+
+        struct attachment_t {
+            VM::CallHook *prev_call_hook;
+            std::function<void(const MemoryManager::gc_stats_t &)> prev_gc_stats_hook;
+        };
+
+        const std::optional<uint64_t> call_threshold;
+        const uint64_t id; // Unique identifier of the tracer, used to validate cached thread buffers.
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<thread_buffer_t>> buffers;
+        std::unordered_map<VM *, attachment_t> vms; // Attached VMs.
+
+        thread_buffer_t &get_buffer();
+
+    public:
+        /**
+         * @param call_threshold Minimum duration of function calls to be recorded, in nanoseconds. If not set, function
+         * calls are not instrumented at all.
+         */
+        explicit Tracer(std::optional<uint64_t> call_threshold = 100000);
+
+        Tracer(const Tracer &) = delete;
+        Tracer &operator=(const Tracer &) = delete;
+
+        /**
+         * Starts recording events of the VM. Must be called from the thread which runs the VM.
+         */
+        void attach(VM &vm);
+
+        /**
+         * Stops recording events of the VM.
+         */
+        void detach(VM &vm);
+
+        /**
+         * @return Current time of the monotonic clock, in nanoseconds.
+         */
+        static uint64_t now();
+
+        /**
+         * Records an event which has already finished.
+         * @param cat The category of the event (must be a string literal).
+         * @param name The name of the event.
+         * @param beg The time when the event has started.
+         * @param end The time when the event has finished.
+         * @param args JSON object of event arguments, or an empty string.
+         */
+        void record(const char *cat, std::string name, uint64_t beg, uint64_t end, std::string args = "");
+
+        void enter(VM::Stack &stack, VM::Function *fun) override;
+        void leave(VM::Stack &stack, VM::Function *fun) override;
+
+        /**
+         * Writes all the recorded events as a JSON trace. Must only be called when no other thread records events, e.g.
+         * after the threads running the attached VMs have finished, since their buffers are read without
+         * synchronization.
+         */
+        void write_json(std::ostream &out) const;
+
+        ~Tracer() override;
+
+        /**
+         * RAII helper which records an event lasting for its lifetime. Does nothing if the tracer is `nullptr`.
+         */
+        class Span {
+            Tracer *tracer;
+            const char *cat;
+            std::string name;
+            uint64_t beg;
+        public:
+            std::string args; // JSON object of event arguments (may be set before the span ends).
+
+            Span(Tracer *tracer, const char *cat, std::string name) :
+                    tracer(tracer), cat(cat), name(tracer ? std::move(name) : std::string()),
+                    beg(tracer ? now() : 0) {}
+
+            Span(const Span &) = delete;
+            Span &operator=(const Span &) = delete;
+
+            ~Span() {
+                if (tracer) tracer->record(cat, std::move(name), beg, now(), std::move(args));
+            }
+        };
+
+        /**
+         * Escapes the string to be used inside of a JSON string literal.
+         */
+        static std::string escape(const std::string &str);
+    };
+}
+
+#endif //FUNSCRIPT_TRACER_HPP
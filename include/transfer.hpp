@@ -0,0 +1,235 @@
+#ifndef FUNSCRIPT_TRANSFER_HPP
+#define FUNSCRIPT_TRANSFER_HPP
+
+#include "vm.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace funscript {
+
+    class TransferError : public std::runtime_error {
+    public:
+        explicit TransferError(const std::string &msg) : std::runtime_error(msg) {}
+    };
+
+    /**
+     * Self-contained copy of a graph of Funscript values which does not depend on the heap of the VM it was created in.
+     * Integers, floats, booleans, strings, arrays, plain objects and byte arrays can be transferred. Shared references
+     * and cycles are preserved, frozen allocations are transferred by reference.
+     */
+    class TransferBuffer {
+        std::string data;
+    public:
+        /**
+         * Deep-copies the specified values into a new transfer buffer. Throws `TransferError` if a value cannot be
+         * transferred or is nested too deeply.
+         * @param beg Pointer to the first value to copy.
+         * @param end Pointer past the last value to copy.
+         * @return The transfer buffer which holds the copied values.
+         */
+        static TransferBuffer pack(const VM::Value *beg, const VM::Value *end);
+
+        /**
+         * Materializes the values of the buffer in the heap of the VM which owns the stack and pushes them onto it.
+         * @param stack The stack to push values onto.
+         */
+        void unpack(VM::Stack &stack) const;
+
+        [[nodiscard]] size_t size() const;
+    };
+
+    class SerializationError : public std::runtime_error {
+    public:
+        explicit SerializationError(const std::string &msg) : std::runtime_error(msg) {}
+    };
+
+    /**
+     * Writer of the binary serialization format of value graphs. Unlike transfer buffers, serialized values do not
+     * depend on the process, so they can be stored and read back by other runs. Integers, floats, booleans, strings,
+     * arrays, plain objects and byte arrays can be serialized. Values are written as messages: shared references and
+     * cycles are preserved within a message. Integers and lengths are written as varints, every field name is written
+     * once per message and referenced by its index later. The output is passed to the sink in chunks.
+     */
+    class Serializer {
+    public:
+        using Sink = std::function<void(const char *data, size_t len)>;
+
+    private:
+        const Sink sink;
+        const size_t chunk_size;
+        std::string buf;
+        // Open addressing hash table of written allocations of the message and their indices.
+        std::vector<std::pair<Allocation *, uint64_t>> seen;
+        size_t seen_cnt = 0;
+        std::unordered_map<std::string_view, uint64_t> keys; // Written field names of the message and their indices.
+        size_t depth = 0; // Nesting depth of the value being written.
+
+        bool put_ref(Allocation *alloc);
+        void put_varint(uint64_t num);
+        void put_bytes(const char *data, size_t len);
+        void put_value(const VM::Value &val);
+
+    public:
+        /**
+         * @param sink The function which consumes the output, or `nullptr` if the output is accumulated in the buffer.
+         * @param chunk_size Amount of buffered bytes which are passed to the sink at once.
+         */
+        explicit Serializer(Sink sink = nullptr, size_t chunk_size = 65536);
+
+        /**
+         * Writes the values as a single message. The values are not modified while the message is written.
+         * @param beg Pointer to the first value to write.
+         * @param end Pointer past the last value to write.
+         */
+        void write(const VM::Value *beg, const VM::Value *end);
+
+        /**
+         * Passes the buffered output to the sink.
+         */
+        void flush();
+
+        /**
+         * @return The accumulated output (if there is no sink).
+         */
+        [[nodiscard]] const std::string &get_buffer() const;
+    };
+
+    /**
+     * Reader of the messages written by `Serializer`. The input is validated, malformed messages are reported by
+     * `SerializationError`.
+     */
+    class Deserializer {
+    public:
+        using Source = std::function<size_t(char *data, size_t len)>;
+
+    private:
+        const Source source;
+        const size_t chunk_size;
+        std::string buf; // Buffered input (only if there is a source).
+        const char *pos, *end; // Unread part of the input.
+        std::vector<VM::Value> refs; // Read allocations of the message by their indices.
+        std::vector<MemoryManager::AutoPtr<Allocation>> allocs; // Read allocations, pinned until the message is read.
+        std::vector<FStr> keys; // Read field names of the message by their indices.
+        size_t depth = 0; // Nesting depth of the value being read.
+
+        bool fill(size_t len);
+        void require(size_t len);
+        uint8_t get_byte();
+        uint64_t get_varint();
+        uint64_t get_len();
+        void get_bytes(char *data, size_t len);
+        FStr get_str(VM &vm, size_t len);
+        VM::Value get_value(VM &vm);
+
+    public:
+        /**
+         * Reads the messages from the memory. The data must outlive the deserializer.
+         */
+        explicit Deserializer(std::string_view data);
+
+        /**
+         * Reads the messages from the source.
+         * @param source The function which reads up to `len` bytes of the input into `data` and returns the amount
+         * of read bytes, or 0 at the end of the input.
+         * @param chunk_size Amount of bytes which are requested from the source at once.
+         */
+        explicit Deserializer(Source source, size_t chunk_size = 65536);
+
+        /**
+         * Reads the next message and pushes its values onto the stack.
+         * @param stack The stack to push values onto.
+         * @return `false` if the input has ended before the message.
+         */
+        bool read(VM::Stack &stack);
+    };
+
+    /**
+     * Bounded lock-free multi-producer multi-consumer queue of transfer buffers. Can be shared between VMs running in
+     * different threads.
+     */
+    class Channel {
+        struct Cell {
+            std::atomic<size_t> seq;
+            TransferBuffer *msg;
+        };
+
+        const size_t mask;
+        std::unique_ptr<Cell[]> cells;
+        alignas(64) std::atomic<size_t> head = 0; // Position of the next message to receive.
+        alignas(64) std::atomic<size_t> tail = 0; // Position of the next message to send.
+        alignas(64) std::atomic<uint32_t> events = 0; // Incremented after every send, receive and close.
+        std::atomic<bool> closed = false;
+
+        void notify();
+    public:
+        /**
+         * @param capacity Maximum amount of messages in the channel (rounded up to the power of two).
+         */
+        explicit Channel(size_t capacity);
+
+        Channel(const Channel &) = delete;
+        Channel &operator=(const Channel &) = delete;
+
+        /**
+         * Tries to put the message into the channel.
+         * @param msg The message to send. Ownership is taken only if the message was sent.
+         * @return `false` if the channel is full or closed.
+         */
+        bool try_send(std::unique_ptr<TransferBuffer> &msg);
+
+        /**
+         * Tries to take a message from the channel.
+         * @return The received message or `nullptr` if the channel is empty.
+         */
+        std::unique_ptr<TransferBuffer> try_receive();
+
+        /**
+         * Blocks the calling thread until the state of the channel changes.
+         * @param seen The value of `get_events()` observed before the last unsuccessful operation.
+         */
+        void wait(uint32_t seen) const;
+
+        [[nodiscard]] uint32_t get_events() const;
+
+        void close();
+
+        [[nodiscard]] bool is_closed() const;
+
+        ~Channel();
+    };
+
+    /**
+     * Process-wide heap of deep-frozen values which can be referenced from any VM without copying.
+     * Frozen values are never collected, so the heap must outlive every VM which references them.
+     */
+    class FrozenHeap {
+        class SharedAllocator final : public Allocator {
+        public:
+            void *allocate(size_t size) override;
+            void free(void *ptr, size_t size) noexcept override;
+        };
+
+        SharedAllocator allocator;
+        VM vm;
+        std::mutex mutex;
+    public:
+        FrozenHeap();
+
+        /**
+         * Makes a deep-frozen copy of the value in this heap. Frozen values are returned as is.
+         * @param val The value to freeze.
+         * @return The frozen value.
+         */
+        VM::Value freeze(const VM::Value &val);
+    };
+}
+
+#endif //FUNSCRIPT_TRANSFER_HPP
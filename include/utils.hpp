@@ -4,11 +4,16 @@
 #include "tokenizer.hpp"
 #include "ast.hpp"
 #include "vm.hpp"
+#include "tracer.hpp"
+#include "data.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <dlfcn.h>
 #include <filesystem>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
 
 namespace funscript::util {
 
@@ -117,6 +122,20 @@ namespace funscript::util {
             }
         };
 
+        template<>
+        struct ValueTransformer<VM::Value> {
+            static std::optional<VM::Value> from_stack(VM::Stack &stack) {
+                if (stack[-1].type == Type::SEP) return std::nullopt;
+                auto result = stack[-1];
+                stack.pop();
+                return result;
+            }
+
+            static void to_stack(VM::Stack &stack, const VM::Value &val) {
+                stack.push(val);
+            }
+        };
+
         template<>
         struct ValueTransformer<MemoryManager::AutoPtr<VM::Object>> {
             static std::optional<MemoryManager::AutoPtr<VM::Object>> from_stack(VM::Stack &stack) {
@@ -210,15 +229,136 @@ namespace funscript::util {
             }, util::values_from_stack<Args...>(stack)));
         }
     } catch (const util::ValueError &err) {
-        stack.panic(err.what());
+        stack.raise_panic(err.what());
+    }
+
+    namespace {
+
+        template<typename T>
+        struct NativeArg {
+
+        };
+
+        template<>
+        struct NativeArg<fint> {
+            static constexpr Type TYPE = Type::INT;
+
+            static fint get(const VM::Value &val) { return val.data.num; }
+        };
+
+        template<>
+        struct NativeArg<fflp> {
+            static constexpr Type TYPE = Type::FLP;
+
+            static fflp get(const VM::Value &val) { return val.data.flp; }
+        };
+
+        template<>
+        struct NativeArg<fbln> {
+            static constexpr Type TYPE = Type::BLN;
+
+            static fbln get(const VM::Value &val) { return val.data.bln; }
+        };
+
+        template<>
+        struct NativeArg<VM::String *> {
+            static constexpr Type TYPE = Type::STR;
+
+            static VM::String *get(const VM::Value &val) { return val.data.str; }
+        };
+
+        template<>
+        struct NativeArg<VM::Array *> {
+            static constexpr Type TYPE = Type::ARR;
+
+            static VM::Array *get(const VM::Value &val) { return val.data.arr; }
+        };
+
+        template<>
+        struct NativeArg<VM::Object *> {
+            static constexpr Type TYPE = Type::OBJ;
+
+            static VM::Object *get(const VM::Value &val) { return val.data.obj; }
+        };
+
+        template<>
+        struct NativeArg<VM::Function *> {
+            static constexpr Type TYPE = Type::FUN;
+
+            static VM::Function *get(const VM::Value &val) { return val.data.fun; }
+        };
+
+        template<>
+        struct NativeArg<Allocation *> {
+            static constexpr Type TYPE = Type::PTR;
+
+            static Allocation *get(const VM::Value &val) { return val.data.ptr; }
+        };
+
+        /**
+         * Panics with the same message as `call_native_function` would for the argument pack on top of the stack.
+         * @param types The types of the expected arguments.
+         */
+        void native_args_panic(VM::Stack &stack, std::initializer_list<Type> types) {
+            VM::Stack::pos_t pos = stack.find_sep() + 1;
+            size_t num = 0;
+            for (Type type : types) {
+                num++;
+                if (pos == stack.size() || stack[pos].type != type) {
+                    return stack.raise_panic("value #" + std::to_string(num) + " is absent or is of wrong type");
+                }
+                pos++;
+            }
+            stack.raise_panic("too many values, required " + std::to_string(types.size()));
+        }
+
+        template<auto Fn, typename Ret, typename... Args, size_t... Pos>
+        void bind_native_impl(VM::Stack &stack, Ret (*)(VM::Stack &, Args...), std::index_sequence<Pos...>) {
+            constexpr VM::Stack::pos_t ARITY = sizeof...(Args);
+            // Exactly `ARITY` values of the expected types are above the separator, none of them is a separator
+            if (stack.size() <= ARITY || stack[-ARITY - 1].type != Type::SEP ||
+                ((stack[VM::Stack::pos_t(Pos) - ARITY].type != NativeArg<Args>::TYPE) || ...)) {
+                return native_args_panic(stack, {NativeArg<Args>::TYPE...});
+            }
+            VM::Stack::pos_t sep = stack.size() - ARITY - 1;
+            if constexpr (std::is_same_v<Ret, void>) {
+                Fn(stack, NativeArg<Args>::get(stack[VM::Stack::pos_t(Pos) - ARITY])...);
+                if (stack.is_panicked()) return;
+                stack.pop(sep);
+            } else {
+                Ret result = Fn(stack, NativeArg<Args>::get(stack[VM::Stack::pos_t(Pos) - ARITY])...);
+                if (stack.is_panicked()) return;
+                stack.pop(sep);
+                value_to_stack(stack, result);
+            }
+        }
+
+        template<typename Ret, typename... Args>
+        constexpr auto native_arg_positions(Ret (*)(VM::Stack &, Args...)) {
+            return std::index_sequence_for<Args...>();
+        }
+
+    }
+
+    /**
+     * Zero-overhead alternative to `call_native_function`. The signature of the C++ function is known at compile time,
+     * so its arguments are type-checked and read directly from their positions above the separator, and the whole
+     * argument pack is popped at once after the call. Object arguments are passed as raw pointers: they stay on the
+     * stack (and therefore reachable) until the function returns. The function must not leave values on the stack, its
+     * result is returned instead. The function may panic with `raise_panic()`, its result is ignored then.
+     * @tparam Fn The C++ function, which accepts the execution stack followed by `fint`, `fflp`, `fbln`,
+     * `VM::String *`, `VM::Array *`, `VM::Object *`, `VM::Function *` or `Allocation *` arguments.
+     * @param stack Execution stack to operate with.
+     */
+    template<auto Fn>
+    static void bind_native(VM::Stack &stack) {
+        bind_native_impl<Fn>(stack, Fn, native_arg_positions(Fn));
     }
 
     static MemoryManager::AutoPtr<VM::Stack>
     create_panicked_stack(VM &vm, const std::string &msg) {
         auto stack = vm.mem.gc_new_auto<VM::Stack>(vm);
-        try {
-            stack->panic(msg);
-        } catch (...) {}
+        stack->raise_panic(msg);
         return stack;
     }
 
@@ -230,30 +370,147 @@ namespace funscript::util {
         return stack;
     }
 
-    static MemoryManager::AutoPtr<VM::Function> compile_fn(VM &vm, VM::Module *mod, VM::Scope *scope,
-                                                           const std::string &filename, const std::string &expr) {
+    /**
+     * Context for repeated calls of a Funscript function from C++. The execution stack of the function (its value
+     * storage and root frame) is created once and reused by every call, the results are viewed in place. Errors are
+     * reported as panics of the call instead of exceptions.
+     */
+    class CallContext {
+        MemoryManager::AutoPtr<VM::Stack> stack;
+
+    public:
+        CallContext(VM &vm, VM::Function *fun) : stack(vm.mem.gc_new_auto<VM::Stack>(vm, fun)) {}
+
+        /**
+         * Calls the function with the specified arguments.
+         * @return `true` if the function has returned, `false` if it has panicked.
+         */
+        bool call(std::span<const VM::Value> args) {
+            stack->reset();
+            try {
+                stack->push_sep();
+                for (const auto &arg : args) stack->push(arg);
+                stack->execute();
+            } catch (const VM::StackOverflowError &) {
+                stack->raise_panic("stack overflow");
+            } catch (const OutOfMemoryError &) {
+                stack->raise_panic("out of memory");
+            }
+            return !stack->is_panicked();
+        }
+
+        bool call(std::initializer_list<VM::Value> args) {
+            return call(std::span<const VM::Value>(args.begin(), args.size()));
+        }
+
+        /**
+         * @return The values returned by the last call, or its panic message as the last value if it has panicked.
+         * The view is valid until the next call.
+         */
+        [[nodiscard]] std::span<const VM::Value> results() const {
+            return stack->get_values();
+        }
+
+        [[nodiscard]] bool is_panicked() const {
+            return stack->is_panicked();
+        }
+
+        [[nodiscard]] VM::Stack &get_stack() const {
+            return *stack;
+        }
+    };
+
+    /**
+     * Compiles the expression into raw bytecode. Does not use any VM, so it can be called from any thread.
+     * @param tracer The tracer which records compilation phases, or `nullptr`.
+     * @param lazy Whether the functions defined in the expression are compiled on their first call.
+     */
+    static std::string assemble_bytecode(Tracer *tracer, const std::string &filename, const std::string &expr,
+                                         bool lazy = false) {
         // Split expression into array of tokens
         std::vector<Token> tokens;
-        tokenize(filename, expr, [&tokens](auto token) { tokens.push_back(token); });
+        {
+            Tracer::Span span(tracer, "compile", "tokenize");
+            tokenize(filename, expr, [&tokens](auto token) { tokens.push_back(token); });
+        }
         // Parse array of tokens
-        ast_ptr ast = parse(filename, tokens);
+        ast_ptr ast;
+        {
+            Tracer::Span span(tracer, "compile", "parse");
+            ast = parse(filename, tokens);
+        }
         // Compile the expression AST
         Assembler as;
-        as.compile_expression(ast.get());
-        // Assemble the whole expression bytecode
-        std::string bytes(as.total_size(), '\0');
-        as.assemble(bytes.data());
-        auto bytecode = vm.mem.gc_new_auto<VM::Bytecode>(vm, bytes);
+        if (lazy) as.set_lazy_source(expr);
+        std::string bytes;
+        {
+            Tracer::Span span(tracer, "compile", "assemble");
+            as.compile_expression(ast.get());
+            // Assemble the whole expression bytecode
+            bytes.resize(as.total_size(), '\0');
+            as.assemble(bytes.data());
+        }
+        return bytes;
+    }
+
+    /**
+     * Creates the bytecode object from raw bytecode of the expression.
+     * @param lazy Whether the bytecode was assembled with lazily compiled functions. The source is kept in the bytecode
+     * then.
+     */
+    static MemoryManager::AutoPtr<VM::Bytecode> make_bytecode(VM &vm, std::string bytes, const std::string &expr,
+                                                              bool lazy = false) {
+        if (!lazy) return vm.mem.gc_new_auto<VM::Bytecode>(vm, std::move(bytes));
+        auto source = vm.mem.gc_new_auto<VM::String>(vm, FStr(expr, vm.mem.str_alloc()));
+        return vm.mem.gc_new_auto<VM::Bytecode>(vm, std::move(bytes), source.get());
+    }
+
+    /**
+     * Compiles the expression into bytecode.
+     * @param lazy Whether the functions defined in the expression are compiled on their first call. The source is kept
+     * in the bytecode then.
+     */
+    static MemoryManager::AutoPtr<VM::Bytecode> compile_bytecode(VM &vm, const std::string &filename,
+                                                                 const std::string &expr, bool lazy = false) {
+        return make_bytecode(vm, assemble_bytecode(vm.tracer, filename, expr, lazy), expr, lazy);
+    }
+
+    /**
+     * Compiles the expression into a function.
+     * @param cached Whether the bytecode is looked up in (and added to) the compilation cache of the VM. Expressions
+     * which are compiled repeatedly (e.g. by `lang.compile_expr`) should be cached, module files should not.
+     * @param lazy Whether the functions defined in the expression are compiled on their first call.
+     * @return The new function which runs in the specified scope.
+     */
+    static MemoryManager::AutoPtr<VM::Function> compile_fn(VM &vm, VM::Module *mod, VM::Scope *scope,
+                                                           const std::string &filename, const std::string &expr,
+                                                           bool cached = false, bool lazy = false) {
+        MemoryManager::AutoPtr<VM::Bytecode> bytecode(cached ? vm.find_compiled(filename, expr) : nullptr);
+        if (!bytecode) {
+            bytecode = compile_bytecode(vm, filename, expr, lazy);
+            if (cached) vm.cache_compiled(filename, expr, bytecode.get());
+        }
         // Create the new function from generated bytecode
         return vm.mem.gc_new_auto<VM::BytecodeFunction>(vm, mod, scope, bytecode.get());
     }
 
     static MemoryManager::AutoPtr<VM::Stack>
-    eval_expr(VM &vm, VM::Module *mod, VM::Scope *scope, const std::string &filename, const std::string &expr_name,
-              const std::string &expr) try {
-        auto start = compile_fn(vm, mod, scope, filename, expr);
+    eval_bytecode(VM &vm, VM::Module *mod, VM::Scope *scope, const std::string &expr_name,
+                  VM::Bytecode *bytecode) try {
+        auto start = vm.mem.gc_new_auto<VM::BytecodeFunction>(vm, mod, scope, bytecode);
         start->assign_name(FStr(expr_name, vm.mem.str_alloc()));
+        Tracer::Span span(vm.tracer, "eval", "execute");
         return eval_fn(vm, start.get());
+    } catch (const VM::StackOverflowError &) {
+        return create_panicked_stack(vm, "stack overflow");
+    } catch (const OutOfMemoryError &) {
+        return create_panicked_stack(vm, "out of memory");
+    }
+
+    static MemoryManager::AutoPtr<VM::Stack>
+    eval_expr(VM &vm, VM::Module *mod, VM::Scope *scope, const std::string &filename, const std::string &expr_name,
+              const std::string &expr, bool lazy = false) try {
+        return eval_bytecode(vm, mod, scope, expr_name, compile_bytecode(vm, filename, expr, lazy).get());
     } catch (const CompilationError &err) {
         return create_panicked_stack(vm, std::string("compilation error: ") + err.what());
     } catch (const VM::StackOverflowError &) {
@@ -262,7 +519,27 @@ namespace funscript::util {
         return create_panicked_stack(vm, "out of memory");
     }
 
-    std::string display_value(const VM::Value &val) {
+    /**
+     * Evaluates the data expression in an empty scope. Literal-only expressions are loaded without compilation (see
+     * `load_data()`), other ones are compiled and executed as usual.
+     * @return The stack which contains the values of the expression.
+     */
+    static MemoryManager::AutoPtr<VM::Stack>
+    eval_data(VM &vm, const std::string &filename, const std::string &expr) {
+        try {
+            Tracer::Span span(vm.tracer, "eval", "load_data");
+            auto stack = vm.mem.gc_new_auto<VM::Stack>(vm);
+            if (load_data(*stack, filename, expr)) return stack;
+        } catch (const CompilationError &err) {
+            return create_panicked_stack(vm, std::string("compilation error: ") + err.what());
+        } catch (const OutOfMemoryError &) {
+            return create_panicked_stack(vm, "out of memory");
+        }
+        auto scope = vm.mem.gc_new_auto<VM::Scope>(vm.mem.gc_new_auto<VM::Object>(vm).get(), nullptr);
+        return eval_expr(vm, nullptr, scope.get(), filename, "'<data>'", expr);
+    }
+
+    static std::string display_value(const VM::Value &val) {
         std::ostringstream out;
         switch (val.type) {
             case Type::INT:
@@ -335,16 +612,98 @@ namespace funscript::util {
                 ModuleLoadingError(mod_name, why, MemoryManager::AutoPtr<VM::Stack>(nullptr)) {}
     };
 
+    /**
+     * Module loader source file which has been read and compiled ahead of its execution.
+     */
+    struct compiled_src_module_t {
+        std::filesystem::path loader_path;
+        std::string code; // Source of the loader.
+        std::string bytes; // Raw bytecode of the loader.
+        bool lazy; // Whether the loader was compiled with lazily compiled functions.
+        std::exception_ptr error; // Error of reading or compilation (`ModuleLoadingError` or `CompilationError`).
+    };
+
+    /**
+     * Reads and compiles the module loader. Does not use any VM, so it can be called from any thread. Errors are saved
+     * to be reported when the module is loaded.
+     * @param tracer The tracer which records compilation phases, or `nullptr`.
+     */
+    static compiled_src_module_t compile_src_module(Tracer *tracer, const std::string &name,
+                                                    const std::filesystem::path &loader_path, bool lazy) {
+        compiled_src_module_t loader{.loader_path = loader_path, .lazy = lazy};
+        try {
+            // Read contents of the loader source file
+            {
+                Tracer::Span read_span(tracer, "module", "read");
+                std::ifstream loader_file(loader_path);
+                if (!loader_file) {
+                    throw ModuleLoadingError(name, "failed to open module loader " + loader_path.string());
+                }
+                std::copy(std::istreambuf_iterator<char>(loader_file),
+                          std::istreambuf_iterator<char>(),
+                          std::back_inserter(loader.code));
+            }
+            loader.bytes = assemble_bytecode(tracer, loader_path.string(), loader.code, lazy);
+        } catch (...) {
+            loader.error = std::current_exception();
+        }
+        return loader;
+    }
+
+    /**
+     * Reads and compiles loaders of the source modules in parallel. Modules which are not source ones are skipped.
+     * @param threads Maximum amount of compiling threads (the amount of hardware threads by default).
+     * @param get_loader_path The function which produces the path to the loader of the source module with the name.
+     * Modules whose loader does not exist are not source ones.
+     * @return The compiled loaders by module names.
+     */
+    static std::unordered_map<std::string, compiled_src_module_t>
+    compile_src_modules(VM &vm, const std::vector<std::string> &names, size_t threads = 0,
+                        const std::function<std::filesystem::path(const std::string &)> &get_loader_path =
+                        get_src_module_loader_path) {
+        std::vector<std::string> src_names;
+        std::vector<std::filesystem::path> loader_paths;
+        for (const auto &name : names) {
+            if (std::find(src_names.begin(), src_names.end(), name) != src_names.end()) continue;
+            auto loader_path = get_loader_path(name);
+            if (!std::filesystem::exists(loader_path)) continue;
+            src_names.push_back(name);
+            loader_paths.push_back(std::move(loader_path));
+        }
+        std::vector<compiled_src_module_t> loaders(src_names.size());
+        std::atomic<size_t> next = 0;
+        auto compile_next = [&]() -> void {
+            for (size_t pos; (pos = next.fetch_add(1)) < src_names.size();) {
+                loaders[pos] = compile_src_module(vm.tracer, src_names[pos], loader_paths[pos],
+                                                  vm.config.lazy_compilation);
+            }
+        };
+        if (!threads) threads = std::max(std::thread::hardware_concurrency(), 1u);
+        std::vector<std::thread> workers;
+        for (size_t id = 1; id < std::min(threads, src_names.size()); id++) workers.emplace_back(compile_next);
+        compile_next(); // The current thread compiles modules too
+        for (auto &worker : workers) worker.join();
+        std::unordered_map<std::string, compiled_src_module_t> result;
+        for (size_t pos = 0; pos < src_names.size(); pos++) result.emplace(src_names[pos], std::move(loaders[pos]));
+        return result;
+    }
+
+    /**
+     * Loads the source module from its compiled loader.
+     */
     static MemoryManager::AutoPtr<VM::Module>
-    load_src_module(VM &vm, const std::string &name,
+    load_src_module(VM &vm, const std::string &name, const compiled_src_module_t &loader,
                     const std::vector<std::string> &imps, const std::vector<std::string> &deps) {
-        // Read contents of the loader source file
-        std::filesystem::path loader_path = get_src_module_loader_path(name);
-        std::ifstream loader_file(loader_path);
-        std::string loader_code;
-        std::copy(std::istreambuf_iterator<char>(loader_file),
-                  std::istreambuf_iterator<char>(),
-                  std::back_inserter(loader_code));
+        Tracer::Span span(vm.tracer, "module", "load_src_module");
+        if (vm.tracer) span.args = "{\"module\": \"" + Tracer::escape(name) + "\"}";
+        MemoryManager::AutoPtr<VM::Stack> error_stack(nullptr);
+        if (loader.error) {
+            try {
+                std::rethrow_exception(loader.error);
+            } catch (const CompilationError &err) {
+                error_stack = create_panicked_stack(vm, std::string("compilation error: ") + err.what());
+            }
+        }
         // Prepare module object and scope
         auto module_obj = vm.mem.gc_new_auto<VM::Object>(vm);
         module_obj->set_field(FStr(MODULE_EXPORTS_VAR, vm.mem.str_alloc()), Type::INT);
@@ -378,8 +737,9 @@ namespace funscript::util {
                                      vm.get_module(FStr(dep_mod, vm.mem.str_alloc())).value());
         }
         // Execute module loader code
-        auto stack = util::eval_expr(vm, mod.get(), module_global_scope.get(),
-                                     loader_path.string(), "'<load>'", loader_code);
+        if (error_stack) throw ModuleLoadingError(name, "module loader panicked", std::move(error_stack));
+        auto stack = util::eval_bytecode(vm, mod.get(), module_global_scope.get(), "'<load>'",
+                                         make_bytecode(vm, loader.bytes, loader.code, loader.lazy).get());
         if (stack->is_panicked()) {
             throw ModuleLoadingError(name, "module loader panicked", std::move(stack));
         }
@@ -387,53 +747,126 @@ namespace funscript::util {
     }
 
     static MemoryManager::AutoPtr<VM::Module>
-    load_native_module(VM &vm, const std::string &name) {
-        dlerror();
-        auto lib = dlopen(get_native_module_lib_path(name).c_str(), RTLD_NOW);
-        if (!lib) throw ModuleLoadingError(name, dlerror());
+    load_src_module(VM &vm, const std::string &name, const std::filesystem::path &loader_path,
+                    const std::vector<std::string> &imps, const std::vector<std::string> &deps) {
+        return load_src_module(vm, name, compile_src_module(vm.tracer, name, loader_path, vm.config.lazy_compilation),
+                               imps, deps);
+    }
+
+    static MemoryManager::AutoPtr<VM::Module>
+    load_src_module(VM &vm, const std::string &name,
+                    const std::vector<std::string> &imps, const std::vector<std::string> &deps) {
+        return load_src_module(vm, name, get_src_module_loader_path(name), imps, deps);
+    }
+
+    /**
+     * Adds the functions listed in the registration table of a native module to the object. The functions are placed
+     * into nested objects according to their dot-separated names.
+     */
+    static void add_native_table(VM &vm, VM::Module *mod, VM::Object *natives, const native_module_t &table) {
+        for (size_t pos = 0; pos < table.size; pos++) {
+            const auto &entry = table.entries[pos];
+            std::string_view path = entry.name;
+            VM::Object *obj = natives;
+            for (size_t dot; (dot = path.find('.')) != std::string_view::npos; path.remove_prefix(dot + 1)) {
+                FStr key(path.substr(0, dot), vm.mem.str_alloc());
+                auto val = obj->get_field(key);
+                if (val.has_value() && val->type == Type::OBJ) {
+                    obj = val->data.obj;
+                    continue;
+                }
+                auto inner = vm.mem.gc_new_auto<VM::Object>(vm);
+                obj->set_field(key, {Type::OBJ, {.obj = inner.get()}});
+                obj = inner.get();
+            }
+            auto fn = vm.mem.gc_new_auto<VM::NativeFunction>(vm, mod, *entry.fn);
+            fn->assign_name(FStr(entry.name, vm.mem.str_alloc()));
+            obj->set_field(FStr(path, vm.mem.str_alloc()), {Type::FUN, {.fun = fn.get()}});
+        }
+    }
+
+    /**
+     * Creates the native module. Its exports contain the functions listed in the registration table (if there is one)
+     * as `natives`, and, if the module is a library, the functions which look up its symbols by their names.
+     * @param lib The handle of the module library, or `nullptr` if the module is linked into the executable.
+     * @param table The registration table of the module, or `nullptr` if the module has none.
+     */
+    static MemoryManager::AutoPtr<VM::Module>
+    load_native_module(VM &vm, const std::string &name, void *lib, const native_module_t *table) {
         auto module_exports = vm.mem.gc_new_auto<VM::Object>(vm);
         auto module_obj = vm.mem.gc_new_auto<VM::Object>(vm);
         auto mod = vm.mem.gc_new_auto<VM::Module>(vm, FStr(name, vm.mem.str_alloc()), nullptr, module_obj.get());
         auto *mod_ptr = mod.get();
-        auto load_native_sym_fn = vm.mem.gc_new_auto<VM::NativeFunction>(
-                vm, mod.get(), [mod_ptr, lib](VM::Stack &stack) -> void {
-                    std::function load_native_sym([&stack, mod_ptr, lib](MemoryManager::AutoPtr<VM::String> sym) ->
-                                                          MemoryManager::AutoPtr<VM::Function> {
-                        dlerror();
-                        auto *fn_ptr = reinterpret_cast<void (*)(VM::Stack &)>(dlsym(lib, sym->bytes.c_str()));
-                        if (!fn_ptr) stack.panic(std::string("failed to load native symbol: ") + dlerror());
-                        return stack.vm.mem.gc_new_auto<VM::NativeFunction>(stack.vm, mod_ptr, fn_ptr);
-                    });
-                    call_native_function(stack, load_native_sym);
-                }
-        );
-        load_native_sym_fn->assign_name(FStr(NATIVE_MODULE_SYMBOL_LOADER_VAR, vm.mem.str_alloc()));
-        module_exports->set_field(FStr(NATIVE_MODULE_SYMBOL_LOADER_VAR, vm.mem.str_alloc()),
-                                  {Type::FUN, {.fun = load_native_sym_fn.get()}}
-        );
-        auto check_native_sym_fn = vm.mem.gc_new_auto<VM::NativeFunction>(
-                vm, mod.get(), [lib](VM::Stack &stack) -> void {
-                    std::function check_native_sym([lib](MemoryManager::AutoPtr<VM::String> sym) -> fbln {
-                        dlerror();
-                        auto *fn_ptr = reinterpret_cast<void (*)(VM::Stack &)>(dlsym(lib, sym->bytes.c_str()));
-                        return fn_ptr != nullptr;
-                    });
-                    call_native_function(stack, check_native_sym);
-                }
-        );
-        check_native_sym_fn->assign_name(FStr(NATIVE_MODULE_SYMBOL_CHECKER_VAR, vm.mem.str_alloc()));
-        module_exports->set_field(FStr(NATIVE_MODULE_SYMBOL_CHECKER_VAR, vm.mem.str_alloc()),
-                                  {Type::FUN, {.fun = check_native_sym_fn.get()}}
-        );
+        if (table) {
+            auto natives = vm.mem.gc_new_auto<VM::Object>(vm);
+            add_native_table(vm, mod.get(), natives.get(), *table);
+            module_exports->set_field(FStr(NATIVE_MODULE_TABLE_VAR, vm.mem.str_alloc()),
+                                      {Type::OBJ, {.obj = natives.get()}});
+        }
+        if (lib) {
+            auto load_native_sym_fn = vm.mem.gc_new_auto<VM::NativeFunction>(
+                    vm, mod.get(), [mod_ptr, lib](VM::Stack &stack) -> void {
+                        std::function load_native_sym([&stack, mod_ptr, lib](MemoryManager::AutoPtr<VM::String> sym) ->
+                                                              MemoryManager::AutoPtr<VM::Function> {
+                            Tracer::Span span(stack.vm.tracer, "module", "dlsym");
+                            dlerror();
+                            auto *fn_ptr = reinterpret_cast<void (*)(VM::Stack &)>(dlsym(lib, sym->bytes.c_str()));
+                            if (!fn_ptr) stack.panic(std::string("failed to load native symbol: ") + dlerror());
+                            return stack.vm.mem.gc_new_auto<VM::NativeFunction>(stack.vm, mod_ptr, *fn_ptr);
+                        });
+                        call_native_function(stack, load_native_sym);
+                    }
+            );
+            load_native_sym_fn->assign_name(FStr(NATIVE_MODULE_SYMBOL_LOADER_VAR, vm.mem.str_alloc()));
+            module_exports->set_field(FStr(NATIVE_MODULE_SYMBOL_LOADER_VAR, vm.mem.str_alloc()),
+                                      {Type::FUN, {.fun = load_native_sym_fn.get()}}
+            );
+            auto check_native_sym_fn = vm.mem.gc_new_auto<VM::NativeFunction>(
+                    vm, mod.get(), [lib](VM::Stack &stack) -> void {
+                        std::function check_native_sym([&stack, lib](MemoryManager::AutoPtr<VM::String> sym) -> fbln {
+                            Tracer::Span span(stack.vm.tracer, "module", "dlsym");
+                            dlerror();
+                            auto *fn_ptr = reinterpret_cast<void (*)(VM::Stack &)>(dlsym(lib, sym->bytes.c_str()));
+                            return fn_ptr != nullptr;
+                        });
+                        call_native_function(stack, check_native_sym);
+                    }
+            );
+            check_native_sym_fn->assign_name(FStr(NATIVE_MODULE_SYMBOL_CHECKER_VAR, vm.mem.str_alloc()));
+            module_exports->set_field(FStr(NATIVE_MODULE_SYMBOL_CHECKER_VAR, vm.mem.str_alloc()),
+                                      {Type::FUN, {.fun = check_native_sym_fn.get()}}
+            );
+        }
         module_obj->set_field(FStr(MODULE_EXPORTS_VAR, vm.mem.str_alloc()),
                               {Type::OBJ, {.obj = module_exports.get()}});
         return mod;
     }
 
+    static MemoryManager::AutoPtr<VM::Module>
+    load_native_module(VM &vm, const std::string &name) {
+        Tracer::Span span(vm.tracer, "module", "load_native_module");
+        if (vm.tracer) span.args = "{\"module\": \"" + Tracer::escape(name) + "\"}";
+        if (const auto *table = find_static_native_module(name)) return load_native_module(vm, name, nullptr, table);
+        void *lib;
+        {
+            Tracer::Span dlopen_span(vm.tracer, "module", "dlopen");
+            dlerror();
+            lib = dlopen(get_native_module_lib_path(name).c_str(), RTLD_NOW);
+        }
+        if (!lib) throw ModuleLoadingError(name, dlerror());
+        native_module_fn_t table_fn;
+        {
+            Tracer::Span dlsym_span(vm.tracer, "module", "dlsym");
+            table_fn = reinterpret_cast<native_module_fn_t>(dlsym(lib, NATIVE_MODULE_TABLE_SYMBOL));
+        }
+        return load_native_module(vm, name, lib, table_fn ? table_fn() : nullptr);
+    }
+
     static MemoryManager::AutoPtr<VM::Module>
     load_module(VM &vm, const std::string &name,
                 const std::vector<std::string> &imps, const std::vector<std::string> &deps) {
         if (std::filesystem::exists(get_src_module_loader_path(name))) return load_src_module(vm, name, imps, deps);
+        if (find_static_native_module(name)) return load_native_module(vm, name);
         if (std::filesystem::exists(get_native_module_lib_path(name))) return load_native_module(vm, name);
         throw ModuleLoadingError(name, "failed to find module loader");
     }
@@ -11,11 +11,15 @@
 #include <map>
 #include <set>
 #include <deque>
+#include <list>
 #include <optional>
 #include <csignal>
+#include <span>
 
 namespace funscript {
 
+    class Tracer;
+
     class VM {
     public:
         VM(const VM &vm) = delete;
@@ -25,6 +29,12 @@ namespace funscript {
             MemoryManager::Config mm;
             size_t stack_values_max = SIZE_MAX; // Maximum amount of stack values allowed in each execution stack.
             size_t stack_frames_max = SIZE_MAX; // Maximum amount of stack frames allowed in each execution stack.
+            size_t native_stack_size = 8388608; // Size of native stack reserved for each resumable execution stack.
+            size_t compile_cache_size = 256; // Maximum amount of cached compiled expressions (0 disables the cache).
+            bool lazy_compilation = true; // Whether functions of module files are compiled on their first call.
+            // If set, execution statistics are written to this CSV file when the VM is destroyed.
+            // Only has effect if Funscript is built with `FUNSCRIPT_EXEC_STATS` option.
+            const char *exec_stats_path = nullptr;
         };
 
         class Stack;
@@ -57,6 +67,44 @@ namespace funscript {
             [[nodiscard]] size_t len() const;
         };
 
+        /**
+         * Class of typed array objects, which store numbers of a single type unboxed and contiguously. Typed arrays are
+         * represented by pointer values, their elements are accessed by indexing as the ones of usual arrays.
+         */
+        class TypedArray final : public Allocation {
+        public:
+            enum class ElemType : uint8_t {
+                INT64, FLOAT64, INT32, FLOAT32, UINT8
+            };
+
+            const ElemType elem_type;
+
+        private:
+            FVec<char> bytes; // Elements in the native representation.
+
+            void get_refs(const std::function<void(Allocation *)> &callback) override;
+        public:
+            TypedArray(VM &vm, ElemType elem_type, size_t len);
+
+            static size_t elem_size(ElemType elem_type);
+
+            static bool is_integral(ElemType elem_type);
+
+            char *data();
+
+            [[nodiscard]] const char *data() const;
+
+            [[nodiscard]] size_t len() const;
+
+            [[nodiscard]] Value get(size_t pos) const;
+
+            /**
+             * Sets the element. Integers are truncated to the width of integral elements.
+             * @return `false` if the value is not a number of the element kind (integer or float).
+             */
+            bool set(size_t pos, const Value &val);
+        };
+
         /**
          * Class of string value objects.
          */
@@ -119,6 +167,13 @@ namespace funscript {
              * @return Whether the variable exists or not (if not, it won't be created).
              */
             bool set_var(const FStr &name, Value val);
+
+            /**
+             * Recursively searches the scope which contains the specified variable.
+             * @param name Name of the variable to search.
+             * @return The variables object of the found scope or `nullptr` if the variable does not exist.
+             */
+            [[nodiscard]] Object *find_var(const FStr &name) const;
         };
 
         /**
@@ -207,8 +262,17 @@ namespace funscript {
             friend BytecodeFunction;
             friend VM::Stack;
             const std::string bytes;
+            String *source; // Source file of lazily compiled functions (`nullptr` if there are none).
+            FMap<size_t, Bytecode *> functions; // Compiled code of lazily compiled functions, by their descriptions.
         public:
-            explicit Bytecode(VM &vm, std::string data);
+            explicit Bytecode(VM &vm, std::string data, String *source = nullptr);
+
+            /**
+             * Compiles the code of a lazily compiled function, unless it is compiled already.
+             * @param offset Bytecode offset of the function description.
+             * @return The bytecode which starts with the code of the function.
+             */
+            Bytecode *compile_function(size_t offset);
 
             void get_refs(const std::function<void(Allocation *)> &callback) override;
 
@@ -222,6 +286,8 @@ namespace funscript {
             Scope *scope;
             Bytecode *bytecode;
             size_t offset;
+            const bool lazy; // Whether the function is compiled lazily, `offset` is the one of its description then.
+            Bytecode *code = nullptr; // Compiled code of the lazily compiled function, once it is called.
 
             void call(VM::Stack &stack) override;
         public:
@@ -229,7 +295,17 @@ namespace funscript {
 
             [[nodiscard]] FStr display() const override;
 
-            BytecodeFunction(VM &vm, Module *mod, Scope *scope, Bytecode *bytecode, size_t offset = 0);
+            [[nodiscard]] Bytecode *get_bytecode() const;
+            [[nodiscard]] size_t get_offset() const; // Offset of the function code (or description) in the bytecode.
+
+            /**
+             * Finds the source code location of the function from its bytecode metadata.
+             * @return The filename and the position of the beginning of the function (`nullptr` and zero if unknown).
+             */
+            [[nodiscard]] code_met_t get_location() const;
+
+            BytecodeFunction(VM &vm, Module *mod, Scope *scope, Bytecode *bytecode, size_t offset = 0,
+                             bool lazy = false);
         };
 
         /**
@@ -237,16 +313,33 @@ namespace funscript {
          */
         class NativeFunction final : public Function {
             std::function<void(VM::Stack &)> fn;
+            void (*fn_ptr)(VM::Stack &) = nullptr; // Plain C++ function, which is called without the wrapper.
 
             void call(VM::Stack &stack) override;
         public:
             NativeFunction(VM &vm, Module *mod, decltype(fn) fn);
 
+            /**
+             * Creates the function which calls the plain C++ function directly. It is taken by reference, so that
+             * lambdas without captures still select the constructor with the wrapper.
+             */
+            NativeFunction(VM &vm, Module *mod, void (&fn_ref)(VM::Stack &));
+
             void get_refs(const std::function<void(Allocation *)> &callback) override;
 
             [[nodiscard]] FStr display() const override;
         };
 
+        /**
+         * Interface of instrumentation which is notified about every function call performed by `call_function()`.
+         */
+        class CallHook {
+        public:
+            virtual void enter(Stack &stack, Function *fun) = 0; // Called after the frame of the function is created.
+            virtual void leave(Stack &stack, Function *fun) = 0; // Called after the function returns or panics.
+            virtual ~CallHook() = default;
+        };
+
         /**
          * Structure that holds Funscript value of any type.
          */
@@ -275,18 +368,52 @@ namespace funscript {
             void get_ref(const std::function<void(Allocation *)> &callback) const;
         };
 
+        // Counters of the compilation cache.
+        struct compile_cache_stats_t {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t evictions = 0;
+        };
+
         const Config config; // Configuration of current VM instance.
         MemoryManager mem; // Memory manager for the current VM.
     private:
         FMap<FStr, MemoryManager::AutoPtr<Module>> modules; // Loaded modules of this VM.
+        FSet<Stack *> suspended_stacks; // Resumable execution stacks which are currently suspended.
+        // Compiled expressions, from the most recently used one, keyed by their filename and source text.
+        using compile_cache_entry_t = std::pair<FStr, MemoryManager::AutoPtr<Bytecode>>;
+        std::list<compile_cache_entry_t, AllocatorWrapper<compile_cache_entry_t>> compile_cache;
+        FMap<std::string_view, decltype(compile_cache)::iterator> compile_cache_index;
+        struct ExecStats; // Counters of executed instructions and operators.
+        ExecStats *exec_stats = nullptr;
+        compile_cache_stats_t compile_cache_stats;
     public:
+        Stack *active_stack = nullptr; // The innermost execution stack which is currently running in this VM.
+        CallHook *call_hook = nullptr; // Instrumentation of function calls, if enabled.
+        Tracer *tracer = nullptr; // Recorder of timeline events, if enabled.
 
         explicit VM(Config config);
 
+        ~VM();
+
         void register_module(const funscript::FStr &name, funscript::VM::Module *mod);
 
         std::optional<Module *> get_module(const FStr &name);
 
+        /**
+         * Finds the bytecode compiled earlier from the same source text and filename, and marks it as the most
+         * recently used one.
+         * @return The cached bytecode, or `nullptr` if there is none (which is counted as a miss).
+         */
+        Bytecode *find_compiled(const std::string &filename, const std::string &src);
+
+        /**
+         * Caches the bytecode compiled from the source text, evicting the least recently used one if the cache is full.
+         */
+        void cache_compiled(const std::string &filename, const std::string &src, Bytecode *bytecode);
+
+        [[nodiscard]] const compile_cache_stats_t &get_compile_cache_stats() const;
+
         class StackOverflowError : std::exception {
         public:
             StackOverflowError();
@@ -296,6 +423,7 @@ namespace funscript {
          * Class of Funscript execution stack.
          */
         class Stack final : public Allocation {
+            friend VM;
             void get_refs(const std::function<void(Allocation *)> &callback) override;
         public:
             using pos_t = ssize_t; // Type representing position in stack. Can be negative (-1 is the topmost element).
@@ -319,9 +447,15 @@ namespace funscript {
 
             [[nodiscard]] pos_t size() const;
             const Value &operator[](pos_t pos) const; // Value stack indexing.
+            [[nodiscard]] std::span<const Value> get_values() const; // The whole value stack, from the bottom.
 
             static volatile std::sig_atomic_t kbd_int; // This flag is used to interrupt running execution stack.
 
+            /**
+             * Executes bytecode of a function. A panic is not thrown: the stack is marked as panicked and the function
+             * returns, so the same applies to `call_function()`, `call_operator()` and `call_assignment()`. Callers
+             * must check `is_panicked()` before touching the stack again.
+             */
             void exec_bytecode(Module *mod, Scope *scope, Bytecode *bytecode_obj, size_t offset, pos_t frame_start);
 
             void call_function(Function *fun);
@@ -331,6 +465,59 @@ namespace funscript {
 
             void execute();
 
+            /**
+             * Prepares the stack for another execution of its main function. The values and the frames left by the
+             * previous execution (including the panic, if any) are discarded, while the storage of the value stack
+             * and the root frame are reused. Must not be called while the stack is running, coroutines cannot be
+             * reset.
+             */
+            void reset();
+
+            /**
+             * Runs the stack on its own native stack until it finishes or suspends itself.
+             * If the stack is suspended, its execution is continued from the point where it was suspended.
+             */
+            void resume();
+
+            /**
+             * Suspends execution of the stack and returns control to the caller of `resume()`.
+             * Must be called from the code running on this stack.
+             */
+            void suspend();
+
+            /**
+             * Unwinds the suspended stack: `suspend()` throws on its native stack, so that native functions release
+             * their resources, and the stack becomes finished. Does nothing if the stack is not suspended.
+             */
+            void cancel();
+
+            [[nodiscard]] bool is_suspended() const;
+            [[nodiscard]] bool is_finished() const;
+
+            /**
+             * Enables preemption of the stack while it is running as a coroutine.
+             * Once the specified amount of instructions is executed, the stack suspends itself at the next safe point (a
+             * backward jump or a function call).
+             * @param instructions The amount of instructions in a time slice (0 disables preemption).
+             */
+            void set_time_slice(size_t instructions);
+
+            [[nodiscard]] bool is_preempted() const; // Whether the last suspension of the stack was caused by preemption.
+            [[nodiscard]] uint64_t get_cpu_time() const; // CPU time spent in the stack as a coroutine, in nanoseconds.
+            [[nodiscard]] size_t get_switches() const; // Amount of times the stack was resumed.
+
+            /**
+             * Marks the stack as panicked: pushes the message and saves the positions of all frames for the stack
+             * trace. Nothing is thrown, the caller must return right away (native functions included) and leave the
+             * stack untouched, the panic is then propagated by the interpreter.
+             * @param msg The panic message.
+             */
+            void raise_panic(const std::string &msg, const std::source_location &loc = std::source_location::current());
+
+            /**
+             * Same as `raise_panic()`, but unwinds the native stack with an exception up to the nearest native function
+             * call or `execute()`. Convenient in deeply nested native code, but much slower than `raise_panic()`.
+             */
             [[noreturn]] void
             panic(const std::string &msg, const std::source_location &loc = std::source_location::current());
 
@@ -414,8 +601,27 @@ namespace funscript {
 
             bool panicked = false;
 
+            struct Coroutine; // Native execution context of a resumable stack.
+            Coroutine *coroutine = nullptr;
+
+            size_t time_slice = 0; // Amount of instructions in a time slice.
+            ssize_t slice_left = 0; // Amount of instructions left in the current time slice.
+
+            /**
+             * Preempts the stack if its time slice is exhausted.
+             */
+            void safe_point() {
+                if (slice_left <= 0 && time_slice) preempt();
+            }
+
+            void preempt();
+
+            static void coroutine_main();
+
             void op_panic(Operator op);
 
+            void call_function_hooked(Function *fun);
+
             /**
              * Returns mutable reference to the value stack element at the specified position.
              * @param pos Position to index.
@@ -427,7 +633,43 @@ namespace funscript {
     private:
         class Panic {
         };
+
+        class Cancellation {
+        };
     };
+
+    /**
+     * Entry of the registration table of a native module.
+     */
+    struct native_entry_t {
+        const char *name; // Dot-separated path of the function in the `natives` export of the module.
+        void (*fn)(VM::Stack &stack);
+    };
+
+    /**
+     * Registration table of a native module, which lists all of its functions.
+     */
+    struct native_module_t {
+        const native_entry_t *entries;
+        size_t size;
+    };
+
+    // Type of the registration entry point which native module libraries export as `NATIVE_MODULE_TABLE_SYMBOL`.
+    using native_module_fn_t = const native_module_t *(*)();
+
+    /**
+     * Registers the table of a native module which is linked into the executable, so that it is loaded without
+     * `dlopen()`. Such modules take precedence over native module libraries with the same name.
+     * @param name The name of the module.
+     * @param table The registration table of the module.
+     */
+    void register_static_native_module(const std::string &name, const native_module_t *table);
+
+    /**
+     * @param name The name of the module.
+     * @return The registration table of the statically linked native module, or `nullptr` if there is no such module.
+     */
+    const native_module_t *find_static_native_module(const std::string &name);
 }
 
 #endif //FUNSCRIPT_VM_HPP
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""
+Compares results of Funscript benchmarks between two commits.
+
+The results are produced by the `benchmarks` target (`benchmarks.jsonl` in the build directory) or by running
+`funscript-bench` directly:
+
+    FS_MODULES_PATH=... funscript-bench -o base.jsonl benchmarks/*.fs
+
+Every metric of the new results is shown relatively to the base ones, changes above the threshold are marked.
+Metrics which are absent from either of the results (e.g. allocations of startup phases) are left blank.
+"""
+
+import argparse
+import json
+import sys
+
+METRICS = [('time_median_ns', 'time'), ('allocations', 'allocs'), ('allocated_bytes', 'alloc bytes'),
+           ('heap_peak_bytes', 'peak heap')]
+
+
+def load(path):
+    results = {}
+    with open(path) as file:
+        for line in file:
+            if line.strip():
+                result = json.loads(line)
+                results[result['benchmark']] = result
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('base', help='results of the base commit')
+    parser.add_argument('new', help='results of the new commit')
+    parser.add_argument('--threshold', type=float, default=5.0,
+                        help='minimum change (in percents) to be marked as a regression or an improvement')
+    args = parser.parse_args()
+
+    base, new = load(args.base), load(args.new)
+    print(f'{"benchmark":<20}' + ''.join(f'{title:>14}' for _, title in METRICS))
+    regressions = 0
+    for name in sorted(base.keys() & new.keys()):
+        row = f'{name:<20}'
+        if 'error' in base[name] or 'error' in new[name]:
+            print(row + '  failed: ' + new[name].get('error', base[name].get('error')))
+            continue
+        for metric, _ in METRICS:
+            if metric not in base[name] or metric not in new[name]:
+                row += ' ' * 14
+                continue
+            old_val, new_val = base[name][metric], new[name][metric]
+            change = 100 * (new_val - old_val) / old_val if old_val else 0.0
+            mark = '+' if change >= args.threshold else '-' if change <= -args.threshold else ' '
+            regressions += mark == '+'
+            row += f'{change:>+12.1f}%{mark}'
+        print(row.rstrip())
+    for name in sorted(base.keys() ^ new.keys()):
+        print(f'{name:<20}  only in {"base" if name in base else "new"} results')
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Turns execution statistics of Funscript VM into interpreter tuning recommendations.
+
+The statistics are collected by a build configured with `-DFUNSCRIPT_EXEC_STATS=ON`:
+
+    funscript --exec-stats=stats.csv -m ...
+
+Several CSV files (e.g. from different workloads) can be passed at once, their counters are summed up.
+"""
+
+import argparse
+import csv
+import sys
+from collections import Counter
+
+PRIMITIVE_OPERANDS = {'int', 'flp', 'bln', 'none'}
+
+
+def load(paths):
+    stats = {'opcode': Counter(), 'pair': Counter(), 'triple': Counter(), 'operator': Counter()}
+    for path in paths:
+        with open(path, newline='') as file:
+            for row in csv.DictReader(file):
+                stats[row['kind']][row['item']] += int(row['count'])
+    return stats
+
+
+def print_table(title, rows, total, limit):
+    print(f'{title}:')
+    for item, count in rows[:limit]:
+        print(f'  {count:>14}  {100 * count / total:6.2f}%  {item}')
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('csv', nargs='+', help='execution statistics files')
+    parser.add_argument('--top', type=int, default=15, help='amount of rows in every table')
+    parser.add_argument('--threshold', type=float, default=2.0,
+                        help='minimum share of saved dispatches (in percents) to recommend a superinstruction')
+    args = parser.parse_args()
+
+    stats = load(args.csv)
+    instructions = sum(stats['opcode'].values())
+    if not instructions:
+        sys.exit('no instructions were executed')
+    operators = sum(stats['operator'].values()) or 1
+
+    print(f'{instructions} instructions, {operators} operator calls\n')
+    print_table('Opcodes', stats['opcode'].most_common(), instructions, args.top)
+    print_table('Opcode pairs', stats['pair'].most_common(), instructions, args.top)
+    print_table('Opcode triples', stats['triple'].most_common(), instructions, args.top)
+    print_table('Operators (left and right operands)', stats['operator'].most_common(), operators, args.top)
+
+    # A superinstruction replacing a sequence of N instructions saves N - 1 dispatches per execution
+    candidates = [(seq, count * (len(seq.split()) - 1)) for kind in ('pair', 'triple')
+                  for seq, count in stats[kind].items()]
+    candidates.sort(key=lambda candidate: candidate[1], reverse=True)
+    print('Recommended superinstructions:')
+    recommended = [(seq, saved) for seq, saved in candidates if 100 * saved / instructions >= args.threshold]
+    for seq, saved in recommended[:args.top]:
+        print(f'  {seq:<16} saves {100 * saved / instructions:5.2f}% of dispatches')
+    if not recommended:
+        print(f'  none (no sequence saves at least {args.threshold}% of dispatches)')
+    print()
+
+    print('Recommended operator fast paths:')
+    slow = [(item, count) for item, count in stats['operator'].most_common()
+            if not set(item.split()[1:]) <= PRIMITIVE_OPERANDS and 100 * count / operators >= args.threshold]
+    for item, count in slow[:args.top]:
+        print(f'  {item:<28} {100 * count / operators:5.2f}% of operator calls')
+    if not slow:
+        print('  none (hot operators only have primitive operands)')
+
+
+if __name__ == '__main__':
+    main()
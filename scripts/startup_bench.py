@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""
+Measures the cold start of funscript-bin loading the `lang`, `sys` and `io` modules of the standard library.
+
+The wall time of the whole process is measured over plain runs. The time of every startup phase (reading module files,
+tokenizing, parsing, assembling, executing module loaders, `dlopen` and `dlsym`) is collected from separate runs with
+`--trace` (function calls are not traced, so that the phases are not slowed down by instrumentation). Native symbols
+are resolved while module loaders are executed, so the `execute` phase includes `dlsym`:
+
+    startup_bench.py --bin build/funscript --modules build/bench-modules -o startup.jsonl
+
+The modules directory must contain the standard library as `std/` (the `benchmarks` target prepares one). Results are
+written as JSON lines in the format of `funscript-bench`, so they can be compared by `bench_compare.py`.
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+PHASES = ['read', 'tokenize', 'parse', 'assemble', 'execute', 'dlopen', 'dlsym']
+
+MODULE_ARGS = ['-m', 'std.native', '-i', 'std.native', '-m', 'std.lang', '-i', 'std.lang', '-m', 'std.sys',
+               '-i', 'std.lang', '-m', 'std.io', '-i', 'std.lang', '-m', 'startup']
+
+
+def run(args, env):
+    beg = time.perf_counter_ns()
+    subprocess.run(args, env=env, check=True, stdout=subprocess.DEVNULL)
+    return time.perf_counter_ns() - beg
+
+
+def phase_times(trace_path):
+    with open(trace_path) as file:
+        events = json.load(file)['traceEvents']
+    times = dict.fromkeys(PHASES, 0.0)
+    for event in events:
+        if event['name'] in times:
+            times[event['name']] += event['dur'] * 1000  # Microseconds to nanoseconds
+    return times
+
+
+def result(name, times):
+    times = sorted(times)
+    return {'benchmark': name, 'iterations': len(times), 'time_min_ns': int(times[0]),
+            'time_median_ns': int(statistics.median(times)), 'time_max_ns': int(times[-1])}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--bin', required=True, help='path to funscript-bin')
+    parser.add_argument('--modules', required=True, help='modules directory which contains the standard library')
+    parser.add_argument('-n', type=int, default=20, help='amount of runs of every kind')
+    parser.add_argument('-o', help='output file (standard output by default)')
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        os.symlink(os.path.abspath(os.path.join(args.modules, 'std')), os.path.join(tmp, 'std'))
+        with open(os.path.join(tmp, 'startup.fs'), 'w') as file:
+            file.write('exports = {};\nrun = -> ();\n')
+        env = dict(os.environ, FS_MODULES_PATH=tmp)
+        command = [args.bin] + MODULE_ARGS
+        run(command, env)  # Warm up the page cache
+        totals = [run(command, env) for _ in range(args.n)]
+        phases = {phase: [] for phase in PHASES}
+        trace_path = os.path.join(tmp, 'trace.json')
+        for _ in range(args.n):
+            run([args.bin, f'--trace={trace_path}', '--trace-calls=none'] + MODULE_ARGS, env)
+            for phase, phase_time in phase_times(trace_path).items():
+                phases[phase].append(phase_time)
+
+    results = [result('startup', totals)] + [result(f'startup.{phase}', phases[phase]) for phase in PHASES]
+    out = open(args.o, 'w') if args.o else sys.stdout
+    for res in results:
+        out.write(json.dumps(res) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -1,5 +1,6 @@
 #include "ast.hpp"
 
+#include <cstddef>
 #include <utility>
 
 namespace funscript {
@@ -65,25 +66,25 @@ namespace funscript {
                 return {.no_scope = u_opt1.no_scope && u_opt2.no_scope};
             }
             case Operator::LAMBDA: {
+                if (as.is_lazy()) {
+                    // Only the location of the function source goes to the bytecode
+                    code_loc_t loc = get_location();
+                    size_t fn_pos = as.data_chunk().put(lazy_fn_t{
+                            .meta = 0 /* Will be overwritten to actual DATA chunk location */,
+                            .pos = token_loc.beg, .src_pos = loc.beg,
+                            .src_beg = as.source_offset(loc.beg), .src_end = as.source_offset(loc.end)
+                    });
+                    as.add_pointer(as.data_chunk().id, fn_pos + offsetof(lazy_fn_t, meta), as.data_chunk().id, 0);
+                    ch.put_instruction({Opcode::LAZ, uint32_t(as.data_chunk().put(token_loc.beg)), 0, 0});
+                    as.add_pointer(ch.id, ch.size() - sizeof(Instruction::u64), as.data_chunk().id, fn_pos);
+                    return {.no_scope = true};
+                }
                 auto &new_ch = as.new_chunk(); // Chunk of the new function
                 ch.put_instruction({Opcode::VAL, uint32_t(as.data_chunk().put(token_loc.beg)),
                                     static_cast<uint16_t>(Type::FUN), 0});
                 as.add_pointer(ch.id, ch.size() - sizeof(Instruction::u64), new_ch.id, 0);
                 // Here goes the bytecode of new function
-                new_ch.put_instruction({Opcode::MET, 0, 0, 0 /* Will be overwritten to actual DATA chunk location */});
-                as.add_pointer(new_ch.id, new_ch.size() - sizeof(Instruction::u64), as.data_chunk().id, 0);
-                new_ch.put_instruction({Opcode::SCP, uint32_t(as.data_chunk().put(token_loc.beg)),
-                                        true, 0}); // Create the scope of the function
-                new_ch.put_instruction({Opcode::REV, uint32_t(as.data_chunk().put(token_loc.beg)),
-                                        0, 0}); // Prepare arguments for assignment
-                u_mv_opt_info u_opt1 = left->compile_move(as, new_ch, {}); // Assign function arguments
-                new_ch.put_instruction({Opcode::DIS, uint32_t(as.data_chunk().put(token_loc.beg)),
-                                        true, 0}); // Discard the separator after the arguments
-                u_ev_opt_info u_opt2 = right->compile_eval(as, new_ch, {}); // Evaluate function body
-                new_ch.put_instruction({Opcode::SCP, uint32_t(as.data_chunk().put(token_loc.beg)),
-                                        false, 0}); // Discard the scope ot the function
-                new_ch.put_instruction({Opcode::END, uint32_t(as.data_chunk().put(right->get_location().end)),
-                                        0, 0});
+                compile_function(as, new_ch);
                 return {.no_scope = true};
             }
             case Operator::INDEX: {
@@ -338,6 +339,27 @@ namespace funscript {
                                                                               right(right),
                                                                               op(op) {}
 
+    void OperatorAST::compile_function(Assembler &as, Assembler::Chunk &ch) {
+        ch.put_instruction({Opcode::MET, 0, 0, 0 /* Will be overwritten to actual DATA chunk location */});
+        as.add_pointer(ch.id, ch.size() - sizeof(Instruction::u64), as.data_chunk().id, 0);
+        ch.put_instruction({Opcode::SCP, uint32_t(as.data_chunk().put(token_loc.beg)),
+                            true, 0}); // Create the scope of the function
+        ch.put_instruction({Opcode::REV, uint32_t(as.data_chunk().put(token_loc.beg)),
+                            0, 0}); // Prepare arguments for assignment
+        left->compile_move(as, ch, {}); // Assign function arguments
+        ch.put_instruction({Opcode::DIS, uint32_t(as.data_chunk().put(token_loc.beg)),
+                            true, 0}); // Discard the separator after the arguments
+        right->compile_eval(as, ch, {}); // Evaluate function body
+        ch.put_instruction({Opcode::SCP, uint32_t(as.data_chunk().put(token_loc.beg)),
+                            false, 0}); // Discard the scope ot the function
+        ch.put_instruction({Opcode::END, uint32_t(as.data_chunk().put(right->get_location().end)),
+                            0, 0});
+    }
+
+    bool OperatorAST::is_function() const {
+        return op == Operator::LAMBDA;
+    }
+
     code_loc_t OperatorAST::get_location() const {
         return {left->get_location().beg, right->get_location().end};
     }
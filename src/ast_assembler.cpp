@@ -48,6 +48,32 @@ namespace funscript {
         ch.put_instruction({Opcode::END, uint32_t(data_chunk().put(ast->get_location().end)), 0, 0});
     }
 
+    void Assembler::compile_function(AST *ast) {
+        auto *fn = dynamic_cast<OperatorAST *>(ast);
+        if (!fn || !fn->is_function()) throw CompilationError(ast->filename, ast->get_location(), "function expected");
+        chunks.clear();
+        pointers.clear();
+        new_chunk(); // Data chunk
+        add_string(ast->filename);
+        fn->compile_function(*this, new_chunk()); // Main chunk
+    }
+
+    void Assembler::set_lazy_source(const std::string &code, size_t beg_offset, code_pos_t beg_pos) {
+        first_row = beg_pos.row;
+        lines = {beg_offset - (beg_pos.col - 1)};
+        for (size_t pos = 0; pos < code.size(); pos++) {
+            if (code[pos] == '\n') lines.push_back(beg_offset + pos + 1);
+        }
+    }
+
+    bool Assembler::is_lazy() const {
+        return !lines.empty();
+    }
+
+    size_t Assembler::source_offset(code_pos_t pos) const {
+        return lines.at(pos.row - first_row) + pos.col - 1;
+    }
+
     size_t Assembler::total_size() const {
         size_t size = 0;
         for (size_t i = 0; i < chunks.size(); i++) {
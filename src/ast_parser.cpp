@@ -14,7 +14,7 @@ namespace funscript {
     CompilationError::CompilationError(const std::string &filename, const code_loc_t &loc, const std::string &msg) :
             std::runtime_error(msg + " at " + filename + ':' + loc.to_string()) {}
 
-    ast_ptr parse(const std::string &filename, std::vector<Token> tokens) {
+    ast_ptr parse(const std::string &filename, std::vector<Token> tokens, code_pos_t start) {
         { // Filtering comments out
             std::vector<Token> tokens_new;
             for (const auto &token : tokens) if (token.type != Token::COMMENT) tokens_new.push_back(token);
@@ -48,7 +48,7 @@ namespace funscript {
                     // If it is the second consecutive operator or if it occurs right after left bracket, we insert implicit void token
                     // As in `(+5)` or `val, *arr`
                     if (pos == 0 || insert_void_after(tokens[pos - 1].type)) {
-                        auto beg = pos == 0 ? code_pos_t{1, 1} : tokens[pos - 1].location.end;
+                        auto beg = pos == 0 ? start : tokens[pos - 1].location.end;
                         queue.emplace_back(Token::VOID, 0u,
                                            code_loc_t{beg, tokens[pos].location.beg});
                     }
@@ -89,7 +89,7 @@ namespace funscript {
                     Bracket br = std::get<Bracket>(token.data);
                     // As it is with operators, we need to insert void token in the same cases
                     if (pos == 0 || insert_void_after(tokens[pos - 1].type)) {
-                        auto beg = pos == 0 ? code_pos_t{1, 1} : tokens[pos - 1].location.end;
+                        auto beg = pos == 0 ? start : tokens[pos - 1].location.end;
                         queue.emplace_back(Token::VOID, 0u,
                                            code_loc_t{beg, tokens[pos].location.beg});
                     }
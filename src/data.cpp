@@ -0,0 +1,312 @@
+#include "data.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <optional>
+#include <vector>
+
+namespace funscript {
+
+    namespace {
+
+        struct not_literal_t {}; // Thrown at the first token which cannot be handled without compilation.
+
+        bool is_word_char(char c) {
+            return std::isalnum(c) || c == '_';
+        }
+
+        bool is_punctuation(char c) {
+            switch (c) {
+                case '[':
+                case ']':
+                case '{':
+                case '}':
+                case ',':
+                case ';':
+                case '.':
+                case '-':
+                case '=':
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        /**
+         * Creates the token of a single punctuation character the same way as `get_token()` does, but without looking
+         * up the keyword mappings.
+         */
+        Token get_punctuation_token(char c) {
+            switch (c) {
+                case '[':
+                    return {Token::LEFT_BRACKET, Bracket::SQUARE};
+                case ']':
+                    return {Token::RIGHT_BRACKET, Bracket::SQUARE};
+                case '{':
+                    return {Token::LEFT_BRACKET, Bracket::CURLY};
+                case '}':
+                    return {Token::RIGHT_BRACKET, Bracket::CURLY};
+                case ',':
+                    return {Token::OPERATOR, Operator::APPEND};
+                case ';':
+                    return {Token::OPERATOR, Operator::DISCARD};
+                case '.':
+                    return {Token::OPERATOR, Operator::INDEX};
+                case '-':
+                    return {Token::OPERATOR, Operator::MINUS};
+                default:
+                    return {Token::OPERATOR, Operator::ASSIGN};
+            }
+        }
+
+        /**
+         * Finds the end of the token which starts at the position. Only the tokens which can occur in literal-only
+         * expressions are recognized, their boundaries are the same as the ones found by `tokenize()`, so the token
+         * string can be converted by `get_token()`. This is much faster than the general tokenizer, which checks all
+         * the kinds of tokens at every character.
+         * @return Position past the end of the token.
+         */
+        size_t scan_token(const std::string &code, size_t pos) {
+            size_t end = pos + 1;
+            char c = code[pos];
+            if (c == '\'') { // String literals end at the next quote
+                end = code.find('\'', end);
+                if (end == std::string::npos) throw not_literal_t();
+                return end + 1;
+            }
+            if (c == '#') {
+                if (end == code.size() || code[end] != '[') { // Line comments end at the newline
+                    end = code.find('\n', end);
+                    return end == std::string::npos ? code.size() : end;
+                }
+                // Block comments end at the first `]#`, other closing square brackets are not handled
+                end = code.find(']', end + 1);
+                if (end == std::string::npos || end + 1 == code.size() || code[end + 1] != '#') throw not_literal_t();
+                return end + 2;
+            }
+            if (std::isalpha(c) || c == '_') { // Identifiers and keywords
+                while (end < code.size() && is_word_char(code[end])) end++;
+                return end;
+            }
+            if (std::isdigit(c)) {
+                if (c == '0' && end < code.size() && code[end] == 'x') { // Hexadecimal integer literals
+                    end++;
+                    while (end < code.size() && std::isalnum(code[end])) end++;
+                    return end;
+                }
+                while (end < code.size() && std::isdigit(code[end])) end++;
+                if (end < code.size() && code[end] == '.') { // Floating-point literals
+                    end++;
+                    while (end < code.size() && std::isdigit(code[end])) end++;
+                }
+                return end;
+            }
+            if (!is_punctuation(c)) throw not_literal_t();
+            // Arrows and comparisons are the only longer tokens which start with these characters
+            if ((c == '-' || c == '=') && end < code.size() && (code[end] == '>' || code[end] == '=')) {
+                throw not_literal_t();
+            }
+            return end;
+        }
+
+        /**
+         * Pushdown automaton which consumes tokens of the expression and builds its values on the stack. Values of the
+         * current statement of every bracket are kept on the stack, objects are created at their opening brackets.
+         */
+        class DataBuilder {
+            enum class State {
+                VALUE, // A value (or the end of the statement or bracket) is expected.
+                NEXT, // A comma, a semicolon or the end of the bracket is expected after a value.
+                FIELD_NAME, // The name of a field definition is expected.
+                FIELD_ASSIGN, // The assignment of a field definition is expected.
+                FIELD_END // A semicolon or the end of the bracket is expected after a field definition.
+            };
+
+            struct frame_t {
+                std::optional<Bracket> bracket; // The bracket of the frame (empty for the whole expression).
+                VM::Stack::pos_t base; // Position of the first value of the current statement.
+                MemoryManager::AutoPtr<VM::Object> obj; // The object which is being built by curly brackets.
+                std::optional<FStr> field; // Name of the field whose value is expected.
+            };
+
+            VM::Stack &stack;
+            std::vector<frame_t> frames;
+            State state = State::VALUE;
+            bool stmt_beg = true; // Whether the current statement has no values yet.
+            bool negate = false; // Whether the next number is negated.
+
+            void put_value(const VM::Value &val) {
+                auto &frame = frames.back();
+                if (frame.field.has_value()) {
+                    frame.obj->set_field(frame.field.value(), val);
+                    frame.field.reset();
+                    state = State::FIELD_END;
+                } else {
+                    stack.push(val);
+                    state = State::NEXT;
+                }
+                stmt_beg = negate = false;
+            }
+
+            void open_bracket(Bracket bracket) {
+                if (negate || bracket == Bracket::PLAIN) throw not_literal_t();
+                MemoryManager::AutoPtr<VM::Object> obj(nullptr);
+                if (bracket == Bracket::CURLY) obj = stack.vm.mem.gc_new_auto<VM::Object>(stack.vm);
+                frames.push_back({bracket, stack.size(), std::move(obj), std::nullopt});
+                state = State::VALUE;
+                stmt_beg = true;
+            }
+
+            void close_bracket(Bracket bracket) {
+                auto &frame = frames.back();
+                if (frame.bracket != bracket || !can_end_statement()) throw not_literal_t();
+                auto values = stack.get_values().subspan(frame.base);
+                if (bracket == Bracket::SQUARE) {
+                    auto arr = stack.vm.mem.gc_new_auto<VM::Array>(stack.vm, values.size());
+                    std::copy(values.begin(), values.end(), arr->begin());
+                    if (!values.empty()) stack.pop(frame.base);
+                    frames.pop_back();
+                    put_value({Type::ARR, {.arr = arr.get()}});
+                } else {
+                    frame.obj->init_values(values.data(), values.data() + values.size());
+                    if (!values.empty()) stack.pop(frame.base);
+                    auto obj = std::move(frame.obj);
+                    frames.pop_back();
+                    put_value({Type::OBJ, {.obj = obj.get()}});
+                }
+            }
+
+            [[nodiscard]] bool can_end_statement() const {
+                switch (state) {
+                    case State::VALUE:
+                        return !negate && !frames.back().field.has_value();
+                    case State::NEXT:
+                    case State::FIELD_END:
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+
+            void end_statement() {
+                auto &frame = frames.back();
+                if (frame.bracket == Bracket::SQUARE || !can_end_statement()) throw not_literal_t();
+                // Only the values of the last statement are left, as the semicolon operator discards its left operand
+                if (stack.size() > frame.base) stack.pop(frame.base);
+                state = State::VALUE;
+                stmt_beg = true;
+            }
+
+            void put_literal(const Token &token) {
+                switch (token.type) {
+                    case Token::INTEGER: {
+                        auto num = std::get<uint64_t>(token.data);
+                        put_value({Type::INT, {.num = fint(negate ? 0 - num : num)}});
+                        break;
+                    }
+                    case Token::FLOAT: {
+                        auto flp = std::get<double>(token.data);
+                        put_value({Type::FLP, {.flp = negate ? -flp : flp}});
+                        break;
+                    }
+                    case Token::STRING: {
+                        if (negate) throw not_literal_t();
+                        FStr bytes(std::get<std::string>(token.data), stack.vm.mem.str_alloc());
+                        auto str = stack.vm.mem.gc_new_auto<VM::String>(stack.vm, bytes);
+                        put_value({Type::STR, {.str = str.get()}});
+                        break;
+                    }
+                    case Token::BOOLEAN: {
+                        if (negate) throw not_literal_t();
+                        put_value({Type::BLN, {.bln = std::get<bool>(token.data)}});
+                        break;
+                    }
+                    default:
+                        throw not_literal_t();
+                }
+            }
+
+        public:
+            explicit DataBuilder(VM::Stack &stack) : stack(stack) {
+                frames.push_back({std::nullopt, stack.size(), MemoryManager::AutoPtr<VM::Object>(nullptr),
+                                  std::nullopt});
+            }
+
+            void feed(const Token &token) {
+                if (token.type == Token::COMMENT) return;
+                switch (state) {
+                    case State::VALUE:
+                        if (token.type == Token::OPERATOR) {
+                            auto op = std::get<Operator>(token.data);
+                            if (op == Operator::MINUS && !negate) negate = true;
+                            else if (op == Operator::INDEX && stmt_beg && !negate &&
+                                     frames.back().bracket == Bracket::CURLY) {
+                                state = State::FIELD_NAME;
+                            } else if (op == Operator::DISCARD) end_statement();
+                            else throw not_literal_t(); // Commas are only allowed after values
+                        } else if (token.type == Token::LEFT_BRACKET) open_bracket(std::get<Bracket>(token.data));
+                        else if (token.type == Token::RIGHT_BRACKET) close_bracket(std::get<Bracket>(token.data));
+                        else put_literal(token);
+                        break;
+                    case State::NEXT:
+                    case State::FIELD_END:
+                        if (token.type == Token::OPERATOR) {
+                            auto op = std::get<Operator>(token.data);
+                            if (op == Operator::APPEND && state == State::NEXT) state = State::VALUE;
+                            else if (op == Operator::DISCARD) end_statement();
+                            else throw not_literal_t();
+                        } else if (token.type == Token::RIGHT_BRACKET) close_bracket(std::get<Bracket>(token.data));
+                        else throw not_literal_t();
+                        break;
+                    case State::FIELD_NAME:
+                        if (token.type != Token::ID) throw not_literal_t();
+                        frames.back().field.emplace(std::get<std::string>(token.data), stack.vm.mem.str_alloc());
+                        state = State::FIELD_ASSIGN;
+                        break;
+                    case State::FIELD_ASSIGN:
+                        if (token.type != Token::OPERATOR || std::get<Operator>(token.data) != Operator::ASSIGN) {
+                            throw not_literal_t();
+                        }
+                        state = State::VALUE;
+                        break;
+                }
+            }
+
+            void finish() {
+                if (frames.size() != 1 || !can_end_statement()) throw not_literal_t();
+            }
+        };
+    }
+
+    bool load_data(VM::Stack &stack, const std::string &filename, const std::string &code) {
+        auto base = stack.size();
+        try {
+            DataBuilder builder(stack);
+            for (size_t pos = 0; pos < code.size();) {
+                if (std::isspace(code[pos])) {
+                    pos++;
+                    continue;
+                }
+                size_t end = scan_token(code, pos);
+                if (end == pos + 1 && is_punctuation(code[pos])) builder.feed(get_punctuation_token(code[pos]));
+                else if (code[pos] != '#') {
+                    try {
+                        builder.feed(get_token(filename, {}, code.substr(pos, end - pos)));
+                    } catch (const CompilationError &) {
+                        throw not_literal_t(); // The error is reported with its location by the usual compilation
+                    }
+                }
+                pos = end;
+            }
+            builder.finish();
+            return true;
+        } catch (const not_literal_t &) {
+            if (stack.size() > base) stack.pop(base);
+            return false;
+        } catch (...) {
+            if (stack.size() > base) stack.pop(base);
+            throw;
+        }
+    }
+}
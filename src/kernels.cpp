@@ -0,0 +1,297 @@
+#include "kernels.hpp"
+
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+// Vectors are only passed between inlined functions of this file, so the ABI of passing them does not matter
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace funscript::kernels {
+
+    namespace {
+
+        // Kernels operate on vectors of this size, which are lowered to the widest registers of the target architecture
+        constexpr size_t VECTOR_SIZE = 32;
+
+        template<typename T, size_t N = VECTOR_SIZE / sizeof(T)>
+        using vec_t [[gnu::vector_size(N * sizeof(T))]] = T;
+
+        // Integral arithmetic is performed on unsigned numbers, which wrap around on overflow
+        template<typename T, bool = std::is_integral_v<T>>
+        struct arith {
+            using type = T;
+        };
+
+        template<typename T>
+        struct arith<T, true> {
+            using type = std::make_unsigned_t<T>;
+        };
+
+        template<typename T>
+        using arith_t = typename arith<T>::type;
+
+        // Reductions accumulate integers as 64-bit ones and floats as doubles
+        template<typename T>
+        using acc_t = std::conditional_t<std::is_integral_v<T>, uint64_t, double>;
+
+        // Elements are accessed by copying, since the storage of typed arrays is untyped and may be unaligned
+        template<typename V>
+        V load(const char *ptr) {
+            V vec;
+            std::memcpy(&vec, ptr, sizeof(vec));
+            return vec;
+        }
+
+        template<typename V>
+        void store(char *ptr, const V &vec) {
+            std::memcpy(ptr, &vec, sizeof(vec));
+        }
+
+        template<typename V, typename T>
+        V broadcast(T elem) {
+            V vec;
+            for (size_t lane = 0; lane < sizeof(V) / sizeof(T); lane++) vec[lane] = elem;
+            return vec;
+        }
+
+        template<typename Fn>
+        auto visit(ElemType elem_type, Fn &&fn) {
+            switch (elem_type) {
+                case ElemType::INT64:
+                    return fn(int64_t());
+                case ElemType::FLOAT64:
+                    return fn(double());
+                case ElemType::INT32:
+                    return fn(int32_t());
+                case ElemType::FLOAT32:
+                    return fn(float());
+                case ElemType::UINT8:
+                    return fn(uint8_t());
+            }
+            __builtin_unreachable();
+        }
+
+        template<typename T>
+        VM::Value to_value(T elem) {
+            if constexpr (std::is_integral_v<T>) return {Type::INT, {.num = fint(elem)}};
+            else return {Type::FLP, {.flp = fflp(elem)}};
+        }
+
+        template<typename T>
+        T from_value(const VM::Value &val) {
+            if constexpr (std::is_integral_v<T>) return T(val.data.num);
+            else return T(val.data.flp);
+        }
+
+        template<typename T, typename Op>
+        void binary(char *dst, const char *a, const char *b, size_t len, Op op) {
+            using A = arith_t<T>;
+            using V = vec_t<A>;
+            constexpr size_t LANES = VECTOR_SIZE / sizeof(T);
+            size_t pos = 0;
+            for (; pos + LANES <= len; pos += LANES) {
+                size_t off = pos * sizeof(T);
+                store(dst + off, V(op(load<V>(a + off), load<V>(b + off))));
+            }
+            for (; pos < len; pos++) {
+                size_t off = pos * sizeof(T);
+                store(dst + off, A(op(load<A>(a + off), load<A>(b + off))));
+            }
+        }
+
+        template<typename T, typename Op>
+        void compare(char *dst, const char *a, const char *b, size_t len, Op op) {
+            using V = vec_t<T>;
+            constexpr size_t LANES = VECTOR_SIZE / sizeof(T);
+            size_t pos = 0;
+            for (; pos + LANES <= len; pos += LANES) {
+                size_t off = pos * sizeof(T);
+                auto mask = op(load<V>(a + off), load<V>(b + off)); // Lanes are -1 for true and 0 for false
+                store(dst + pos, __builtin_convertvector(mask, vec_t<uint8_t, LANES>) & 1);
+            }
+            for (; pos < len; pos++) {
+                size_t off = pos * sizeof(T);
+                dst[pos] = char(op(load<T>(a + off), load<T>(b + off)) ? 1 : 0);
+            }
+        }
+
+        /**
+         * Sums the products of the elements, or the elements themselves if there is a single array. Two vectors of
+         * accumulators are used, so that consecutive additions do not depend on each other.
+         */
+        template<typename T, bool Dot>
+        acc_t<T> accumulate(const char *a, const char *b, size_t len) {
+            using A = acc_t<T>;
+            using V = vec_t<A>;
+            constexpr size_t LANES = VECTOR_SIZE / sizeof(A);
+            using E = vec_t<T, LANES>;
+            auto get = [a, b](size_t pos) -> V {
+                size_t off = pos * sizeof(T);
+                V vec = __builtin_convertvector(load<E>(a + off), V);
+                if constexpr (Dot) vec *= __builtin_convertvector(load<E>(b + off), V);
+                return vec;
+            };
+            V acc0{}, acc1{};
+            size_t pos = 0;
+            for (; pos + 2 * LANES <= len; pos += 2 * LANES) {
+                acc0 += get(pos);
+                acc1 += get(pos + LANES);
+            }
+            acc0 += acc1;
+            A result = 0;
+            for (size_t lane = 0; lane < LANES; lane++) result += acc0[lane];
+            for (; pos < len; pos++) {
+                size_t off = pos * sizeof(T);
+                A elem = A(load<T>(a + off));
+                if constexpr (Dot) elem *= A(load<T>(b + off));
+                result += elem;
+            }
+            return result;
+        }
+
+        /**
+         * Finds the element which is preferred over all the other ones by the comparison (the array is non-empty).
+         * NaN is never preferred by the comparison, so it is checked separately: it is the result if any element is
+         * NaN, wherever it is.
+         */
+        template<typename T, typename Op>
+        T select_elem(const char *data, size_t len, Op prefer) {
+            using V = vec_t<T>;
+            constexpr size_t LANES = VECTOR_SIZE / sizeof(T);
+            T result = load<T>(data);
+            V best = broadcast<V>(result);
+            decltype(best != best) nans{}; // Lanes are -1 if a NaN was met in them
+            size_t pos = 0;
+            for (; pos + LANES <= len; pos += LANES) {
+                V vec = load<V>(data + pos * sizeof(T));
+                best = prefer(vec, best) ? vec : best;
+                if constexpr (std::is_floating_point_v<T>) nans |= vec != vec;
+            }
+            for (size_t lane = 0; lane < LANES; lane++) {
+                if (nans[lane]) return std::numeric_limits<T>::quiet_NaN();
+                if (prefer(T(best[lane]), result)) result = best[lane];
+            }
+            for (; pos < len; pos++) {
+                T elem = load<T>(data + pos * sizeof(T));
+                if (elem != elem) return elem;
+                if (prefer(elem, result)) result = elem;
+            }
+            return result;
+        }
+
+        template<typename T>
+        void fill_elems(char *data, size_t len, T elem) {
+            using V = vec_t<T>;
+            constexpr size_t LANES = VECTOR_SIZE / sizeof(T);
+            V vec = broadcast<V>(elem);
+            size_t pos = 0;
+            for (; pos + LANES <= len; pos += LANES) store(data + pos * sizeof(T), vec);
+            for (; pos < len; pos++) store(data + pos * sizeof(T), elem);
+        }
+
+        template<typename T>
+        void scale_elems(char *data, size_t len, T factor) {
+            using A = arith_t<T>;
+            using V = vec_t<A>;
+            constexpr size_t LANES = VECTOR_SIZE / sizeof(T);
+            V vec = broadcast<V>(A(factor));
+            size_t pos = 0;
+            for (; pos + LANES <= len; pos += LANES) {
+                size_t off = pos * sizeof(T);
+                store(data + off, V(load<V>(data + off) * vec));
+            }
+            for (; pos < len; pos++) {
+                size_t off = pos * sizeof(T);
+                store(data + off, A(load<A>(data + off) * A(factor)));
+            }
+        }
+    }
+
+    std::optional<ElemType> parse_elem_type(std::string_view name) {
+        if (name == "int64") return ElemType::INT64;
+        if (name == "float64") return ElemType::FLOAT64;
+        if (name == "int32") return ElemType::INT32;
+        if (name == "float32") return ElemType::FLOAT32;
+        if (name == "uint8") return ElemType::UINT8;
+        return std::nullopt;
+    }
+
+    const char *elem_type_name(ElemType elem_type) {
+        switch (elem_type) {
+            case ElemType::INT64:
+                return "int64";
+            case ElemType::FLOAT64:
+                return "float64";
+            case ElemType::INT32:
+                return "int32";
+            case ElemType::FLOAT32:
+                return "float32";
+            case ElemType::UINT8:
+                return "uint8";
+        }
+        __builtin_unreachable();
+    }
+
+    void add(VM::TypedArray &dst, const VM::TypedArray &a, const VM::TypedArray &b) {
+        visit(a.elem_type, [&](auto tag) -> void {
+            binary<decltype(tag)>(dst.data(), a.data(), b.data(), a.len(), [](auto x, auto y) { return x + y; });
+        });
+    }
+
+    void mul(VM::TypedArray &dst, const VM::TypedArray &a, const VM::TypedArray &b) {
+        visit(a.elem_type, [&](auto tag) -> void {
+            binary<decltype(tag)>(dst.data(), a.data(), b.data(), a.len(), [](auto x, auto y) { return x * y; });
+        });
+    }
+
+    void less(VM::TypedArray &dst, const VM::TypedArray &a, const VM::TypedArray &b) {
+        visit(a.elem_type, [&](auto tag) -> void {
+            compare<decltype(tag)>(dst.data(), a.data(), b.data(), a.len(), [](auto x, auto y) { return x < y; });
+        });
+    }
+
+    void equal(VM::TypedArray &dst, const VM::TypedArray &a, const VM::TypedArray &b) {
+        visit(a.elem_type, [&](auto tag) -> void {
+            compare<decltype(tag)>(dst.data(), a.data(), b.data(), a.len(), [](auto x, auto y) { return x == y; });
+        });
+    }
+
+    VM::Value sum(const VM::TypedArray &arr) {
+        return visit(arr.elem_type, [&](auto tag) -> VM::Value {
+            return to_value(accumulate<decltype(tag), false>(arr.data(), nullptr, arr.len()));
+        });
+    }
+
+    VM::Value min(const VM::TypedArray &arr) {
+        return visit(arr.elem_type, [&](auto tag) -> VM::Value {
+            return to_value(select_elem<decltype(tag)>(arr.data(), arr.len(), [](auto x, auto y) { return x < y; }));
+        });
+    }
+
+    VM::Value max(const VM::TypedArray &arr) {
+        return visit(arr.elem_type, [&](auto tag) -> VM::Value {
+            return to_value(select_elem<decltype(tag)>(arr.data(), arr.len(), [](auto x, auto y) { return x > y; }));
+        });
+    }
+
+    VM::Value dot(const VM::TypedArray &a, const VM::TypedArray &b) {
+        return visit(a.elem_type, [&](auto tag) -> VM::Value {
+            return to_value(accumulate<decltype(tag), true>(a.data(), b.data(), a.len()));
+        });
+    }
+
+    void fill(VM::TypedArray &arr, const VM::Value &val) {
+        visit(arr.elem_type, [&](auto tag) -> void {
+            using T = decltype(tag);
+            fill_elems<T>(arr.data(), arr.len(), from_value<T>(val));
+        });
+    }
+
+    void scale(VM::TypedArray &arr, const VM::Value &factor) {
+        visit(arr.elem_type, [&](auto tag) -> void {
+            using T = decltype(tag);
+            scale_elems<T>(arr.data(), arr.len(), from_value<T>(factor));
+        });
+    }
+}
@@ -1,9 +1,26 @@
 #include <vector>
 #include <sstream>
+#include <functional>
+#include <cstring>
+#include <deque>
+#include <fstream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 #include "tokenizer.hpp"
 #include "vm.hpp"
 #include "utils.hpp"
+#include "profiler.hpp"
+#include "tracer.hpp"
 
 using namespace funscript;
 
@@ -13,15 +30,504 @@ struct module_conf_t {
     std::vector<std::string> imps = {}; // The modules to be imported into this module's scope.
 };
 
+static std::string prog_name; // The name of the executable (`argv[0]`).
+
+/**
+ * Executes the runner of the main module.
+ * @param vm The VM with all the modules loaded.
+ * @param name The name of the main module.
+ * @param run_args The strings to be passed to the runner as arguments.
+ * @return The exit code of the program.
+ */
+static int run_main_module(VM &vm, const std::string &name, const std::vector<std::string> &run_args = {}) {
+    auto run_val = vm.get_module(FStr(name, vm.mem.str_alloc())).value()->
+            object->get_field(FStr(MODULE_RUNNER_VAR, vm.mem.str_alloc())).value();
+    if (run_val.type != Type::FUN) {
+        std::cerr << prog_name << ": '" << name << "' is not runnable" << std::endl;
+        return 1;
+    }
+    auto stack = vm.mem.gc_new_auto<VM::Stack>(vm, run_val.data.fun);
+    stack->push_sep();
+    for (const auto &arg : run_args) {
+        stack->push_str(vm.mem.gc_new_auto<VM::String>(vm, FStr(arg, vm.mem.str_alloc())).get());
+    }
+    try {
+        stack->execute();
+    } catch (const OutOfMemoryError &) {
+        std::cerr << prog_name << ": out of memory" << std::endl;
+        return 1;
+    }
+    if (stack->is_panicked()) {
+        std::cerr << prog_name << ": main module panicked" << std::endl;
+        util::print_panic(*stack);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Forks a copy-on-write clone of the current process and executes the function in it. The heap of the VM is shared
+ * with the clone until either of them writes to it, so the clone starts with all the modules loaded and its mutations
+ * never leak into the parent.
+ * @param fn The function to execute in the clone. Its result is the exit code of the clone.
+ * @param in_fd The file descriptor to be used as the standard input of the clone, or `-1` to inherit it.
+ * @param out_fd The file descriptor to be used as the standard output of the clone, or `-1` to inherit it.
+ * @return The PID of the clone, or `-1` on failure.
+ */
+static pid_t fork_clone(const std::function<int()> &fn, int in_fd = -1, int out_fd = -1) {
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    if (in_fd != -1) dup2(in_fd, STDIN_FILENO);
+    if (out_fd != -1) dup2(out_fd, STDOUT_FILENO);
+    int code = fn();
+    std::cout.flush();
+    std::cerr.flush();
+    _exit(code); // The heap of the clone is discarded as a whole, there is no need to destroy the VM
+}
+
+/**
+ * Creates an anonymous in-memory file with the specified contents, positioned at its beginning.
+ * @return The file descriptor of the file, or `-1` on failure.
+ */
+static int make_input_fd(const std::string &data) {
+    int fd = memfd_create("funscript-input", MFD_CLOEXEC);
+    if (fd == -1) return -1;
+    for (size_t pos = 0; pos < data.size();) {
+        auto cnt = write(fd, data.data() + pos, data.size() - pos);
+        if (cnt <= 0) {
+            close(fd);
+            return -1;
+        }
+        pos += cnt;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/**
+ * Serves requests read line by line from the standard input. Each request is executed by a fresh clone of the
+ * initialized VM, which receives the request line as its standard input.
+ * @return The exit code of the program.
+ */
+static int run_fork_server(VM &vm, const std::string &name) {
+    std::string line;
+    for (size_t req = 0; std::getline(std::cin, line); req++) {
+        int in_fd = make_input_fd(line + "\n");
+        pid_t pid = in_fd == -1 ? -1 : fork_clone([&vm, &name]() -> int { return run_main_module(vm, name); }, in_fd);
+        if (in_fd != -1) close(in_fd);
+        if (pid == -1) {
+            std::cerr << prog_name << ": failed to clone VM: " << strerror(errno) << std::endl;
+            return 1;
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::cerr << prog_name << ": request " << req << " failed" << std::endl;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Runs every input by a separate clone of the initialized VM, keeping at most `workers` clones running at once.
+ * Each input is fed to the standard input of its clone. The outputs of the clones are gathered and written to the
+ * standard output in the order of inputs.
+ * @param files The input files. If empty, each line of the standard input is a separate input.
+ * @return The exit code of the program.
+ */
+static int run_workers(VM &vm, const std::string &name, size_t workers, const std::vector<std::string> &files) {
+    struct job_t {
+        pid_t pid = -1; // The PID of the clone running the job.
+        int out_fd = -1; // The read end of the pipe connected to the standard output of the clone.
+        std::string output; // The gathered output of the clone.
+        bool done = false; // Whether the clone has exited.
+        bool failed = false; // Whether the clone has exited abnormally.
+    };
+    std::deque<job_t> jobs; // Jobs which were started, but whose output was not written yet.
+    size_t jobs_beg = 0; // The index of the first job in the deque.
+    size_t running = 0;
+    size_t next_file = 0;
+    bool inputs_left = true;
+    int exit_code = 0;
+
+    auto next_input_fd = [&]() -> int { // Returns -2 if there are no more inputs
+        if (!files.empty()) {
+            if (next_file == files.size()) return -2;
+            const auto &file = files[next_file++];
+            int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) std::cerr << prog_name << ": " << file << ": " << strerror(errno) << std::endl;
+            return fd;
+        }
+        std::string line;
+        if (!std::getline(std::cin, line)) return -2;
+        return make_input_fd(line + "\n");
+    };
+
+    auto start_job = [&]() -> bool {
+        int in_fd = next_input_fd();
+        if (in_fd == -2) return false;
+        auto &job = jobs.emplace_back();
+        int pipe_fds[2];
+        if (in_fd == -1 || pipe2(pipe_fds, O_CLOEXEC) == -1) {
+            if (in_fd != -1) close(in_fd);
+            job.done = job.failed = true;
+            return true;
+        }
+        job.pid = fork_clone([&vm, &name]() -> int { return run_main_module(vm, name); }, in_fd, pipe_fds[1]);
+        close(in_fd);
+        close(pipe_fds[1]);
+        if (job.pid == -1) {
+            close(pipe_fds[0]);
+            job.done = job.failed = true;
+            return true;
+        }
+        job.out_fd = pipe_fds[0];
+        running++;
+        return true;
+    };
+
+    while (true) {
+        while (inputs_left && running < workers) inputs_left = start_job();
+        while (!jobs.empty() && jobs.front().done) { // Write the outputs of the finished jobs in order
+            auto &job = jobs.front();
+            std::cout << job.output << std::flush;
+            if (job.failed) {
+                std::cerr << prog_name << ": input " << jobs_beg << " failed" << std::endl;
+                exit_code = 1;
+            }
+            jobs.pop_front();
+            jobs_beg++;
+        }
+        if (running == 0) {
+            if (!inputs_left) break;
+            continue;
+        }
+        std::vector<pollfd> fds;
+        std::vector<job_t *> polled;
+        for (auto &job : jobs) {
+            if (job.out_fd == -1) continue;
+            fds.push_back({.fd = job.out_fd, .events = POLLIN});
+            polled.push_back(&job);
+        }
+        if (poll(fds.data(), fds.size(), -1) == -1) {
+            if (errno == EINTR) continue;
+            std::cerr << prog_name << ": poll: " << strerror(errno) << std::endl;
+            return 1;
+        }
+        for (size_t pos = 0; pos < fds.size(); pos++) {
+            if (!fds[pos].revents) continue;
+            auto &job = *polled[pos];
+            char buf[65536];
+            auto cnt = read(job.out_fd, buf, sizeof buf);
+            if (cnt > 0) {
+                job.output.append(buf, cnt);
+                continue;
+            }
+            if (cnt == -1 && errno == EINTR) continue;
+            close(job.out_fd); // The clone has closed its standard output
+            job.out_fd = -1;
+            int status;
+            waitpid(job.pid, &status, 0);
+            job.done = true;
+            job.failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+            running--;
+        }
+    }
+    return exit_code;
+}
+
+static bool parse_number(const std::string &str, size_t &num) {
+    if (str.empty() || str.find_first_not_of("0123456789") != std::string::npos) return false;
+    num = std::stoul(str);
+    return true;
+}
+
+struct daemon_conf_t {
+    std::string socket_path; // The path of the Unix socket to listen on.
+    module_conf_t script_conf; // The imports and dependencies of submitted scripts.
+    size_t mem_limit = 0; // The maximum heap size of a request in bytes, or 0 if unlimited.
+    size_t time_limit = 0; // The maximum wall time of a request in seconds, or 0 if unlimited.
+};
+
+/**
+ * Executes a script submitted to the daemon. Runs in a clone of the daemon, with the standard streams of the client.
+ * @param request The working directory of the client, the path of the script and its arguments.
+ * @return The exit code of the script.
+ */
+static int run_daemon_request(VM &vm, DefaultAllocator &allocator, const daemon_conf_t &conf,
+                              std::vector<std::string> request) {
+    if (request.size() < 2 || chdir(request[0].c_str()) == -1) {
+        std::cerr << prog_name << ": invalid request" << std::endl;
+        return 1;
+    }
+    if (conf.mem_limit) allocator.set_limit(allocator.get_used() + conf.mem_limit);
+    if (conf.time_limit) {
+        rlimit cpu_limit{.rlim_cur = conf.time_limit, .rlim_max = conf.time_limit + 1};
+        setrlimit(RLIMIT_CPU, &cpu_limit);
+        alarm(conf.time_limit);
+    }
+    const std::string &path = request[1];
+    try {
+        auto module_obj = util::load_src_module(vm, path, path, conf.script_conf.imps, conf.script_conf.deps);
+        vm.register_module(FStr(path, vm.mem.str_alloc()), module_obj.get());
+    } catch (const util::ModuleLoadingError &err) {
+        std::cerr << prog_name << ": " << err.what() << std::endl;
+        if (err.stack) util::print_panic(*err.stack);
+        return 1;
+    }
+    return run_main_module(vm, path, std::vector<std::string>(request.begin() + 2, request.end()));
+}
+
+/**
+ * Accepts scripts from clients connected to the Unix socket and executes each of them in a clone of the initialized
+ * VM. Every request is a single packet of null-terminated strings (see `run_daemon_request`) accompanied by the
+ * standard input, output and error descriptors of the client. The exit code of the script is sent back as `int32_t`.
+ * @return The exit code of the program.
+ */
+static int run_daemon(VM &vm, DefaultAllocator &allocator, const daemon_conf_t &conf) {
+    int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{.sun_family = AF_UNIX};
+    if (conf.socket_path.size() >= sizeof addr.sun_path) {
+        std::cerr << prog_name << ": " << conf.socket_path << ": socket path is too long" << std::endl;
+        return 1;
+    }
+    std::strcpy(addr.sun_path, conf.socket_path.c_str());
+    // A socket left by a previous daemon is replaced, but other files at the path are never deleted
+    struct stat path_stat{};
+    if (lstat(addr.sun_path, &path_stat) == 0) {
+        if (!S_ISSOCK(path_stat.st_mode)) {
+            std::cerr << prog_name << ": " << conf.socket_path << ": " << strerror(EADDRINUSE) << std::endl;
+            return 1;
+        }
+        unlink(addr.sun_path);
+    }
+    if (listen_fd == -1 || bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == -1 ||
+        listen(listen_fd, SOMAXCONN) == -1) {
+        std::cerr << prog_name << ": " << conf.socket_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    signal(SIGCHLD, SIG_IGN); // Request supervisors are reaped automatically
+    while (true) {
+        int conn_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn_fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << prog_name << ": accept: " << strerror(errno) << std::endl;
+            return 1;
+        }
+        // Every request is served by a supervisor clone, which waits for the clone running the script
+        pid_t pid = fork_clone([&]() -> int {
+            close(listen_fd); // Clones must not keep the daemon socket open, the script clone is forked from here
+            signal(SIGCHLD, SIG_DFL);
+            char buf[65536];
+            alignas(cmsghdr) char ctl_buf[CMSG_SPACE(3 * sizeof(int))];
+            iovec iov{.iov_base = buf, .iov_len = sizeof buf};
+            msghdr msg{.msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl_buf, .msg_controllen = sizeof ctl_buf};
+            auto cnt = recvmsg(conn_fd, &msg, MSG_CMSG_CLOEXEC);
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            if (cnt <= 0 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) || !cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+                cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+                return 1;
+            }
+            int client_fds[3];
+            std::memcpy(client_fds, CMSG_DATA(cmsg), sizeof client_fds);
+            std::vector<std::string> request;
+            for (const char *pos = buf; pos < buf + cnt; pos += request.back().size() + 1) {
+                request.emplace_back(pos, strnlen(pos, buf + cnt - pos));
+            }
+            pid_t script_pid = fork_clone([&]() -> int {
+                close(conn_fd); // Only the supervisor replies to the client
+                dup2(client_fds[2], STDERR_FILENO);
+                return run_daemon_request(vm, allocator, conf, request);
+            }, client_fds[0], client_fds[1]);
+            for (int fd : client_fds) close(fd);
+            int status = 0;
+            if (script_pid != -1) waitpid(script_pid, &status, 0);
+            int32_t code = script_pid == -1 ? 1 : WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            send(conn_fd, &code, sizeof code, MSG_NOSIGNAL);
+            return 0;
+        });
+        if (pid == -1) std::cerr << prog_name << ": failed to clone VM: " << strerror(errno) << std::endl;
+        close(conn_fd);
+    }
+}
+
+/**
+ * Submits a script to the daemon, letting it use the standard streams of this process.
+ * @param socket_path The path of the Unix socket the daemon listens on.
+ * @param script_args The path of the script followed by its arguments.
+ * @return The exit code of the script.
+ */
+static int run_client(const std::string &socket_path, const std::vector<std::string> &script_args) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{.sun_family = AF_UNIX};
+    if (socket_path.size() >= sizeof addr.sun_path) {
+        std::cerr << prog_name << ": " << socket_path << ": socket path is too long" << std::endl;
+        return 1;
+    }
+    std::strcpy(addr.sun_path, socket_path.c_str());
+    if (fd == -1 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == -1) {
+        std::cerr << prog_name << ": " << socket_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    std::string request = std::filesystem::current_path().string();
+    request.push_back('\0');
+    for (const auto &arg : script_args) {
+        request += arg;
+        request.push_back('\0');
+    }
+    int client_fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    alignas(cmsghdr) char ctl_buf[CMSG_SPACE(sizeof client_fds)] = {};
+    iovec iov{.iov_base = request.data(), .iov_len = request.size()};
+    msghdr msg{.msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl_buf, .msg_controllen = sizeof ctl_buf};
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof client_fds);
+    std::memcpy(CMSG_DATA(cmsg), client_fds, sizeof client_fds);
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) == -1) {
+        std::cerr << prog_name << ": " << socket_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    int32_t code = 1;
+    ssize_t cnt;
+    while ((cnt = recv(fd, &code, sizeof code, 0)) == -1 && errno == EINTR);
+    if (cnt != sizeof code) {
+        std::cerr << prog_name << ": " << socket_path << ": connection lost" << std::endl;
+        return 1;
+    }
+    return code;
+}
+
+#ifdef FUNSCRIPT_STATIC_STDLIB
+extern "C" const funscript::native_module_t *funscript_native_module(); // Linked from the standard library
+#endif
+
 extern "C" const char *__asan_default_options() { // NOLINT(bugprone-reserved-identifier)
     return "detect_odr_violation=1";
 }
 
 int main(int argc, const char **argv) {
     std::vector<std::string> args(argv, argv + argc);
+    prog_name = args[0];
+#ifdef FUNSCRIPT_STATIC_STDLIB
+    register_static_native_module("std.native", funscript_native_module());
+#endif
     std::vector<module_conf_t> modules;
+    bool fork_server = false;
+    size_t workers = 0; // The number of worker clones, or 0 to run the main module once in this process.
+    std::vector<std::string> input_files;
+    std::optional<daemon_conf_t> daemon_conf;
+    daemon_conf_t request_limits;
+    std::optional<std::string> profile_path; // The path prefix of the profiler output files.
+    std::optional<std::string> call_stats_path; // The path of the function call statistics report.
+    std::optional<std::string> exec_stats_path; // The path of the execution statistics CSV file.
+    std::optional<std::string> trace_path; // The path of the trace events JSON file.
+    std::optional<uint64_t> trace_call_threshold = 100000; // Minimum duration of traced calls (ns), if they are traced.
     modules.emplace_back();
     for (size_t pos = 1; pos < argc;) {
+        if (args[pos] == "--connect") {
+            if (pos + 2 >= argc) {
+                std::cerr << args[0] << ": --connect: socket path and script path expected" << std::endl;
+                return 1;
+            }
+            return run_client(args[pos + 1], std::vector<std::string>(args.begin() + long(pos) + 2, args.end()));
+        }
+        if (args[pos] == "--daemon") {
+            pos++;
+            if (pos >= argc) {
+                std::cerr << args[0] << ": --daemon: socket path expected" << std::endl;
+                return 1;
+            }
+            daemon_conf = {.socket_path = args[pos]};
+            pos++;
+            continue;
+        }
+        if (args[pos] == "--request-memory" || args[pos] == "--request-time") {
+            const auto &opt = args[pos];
+            pos++;
+            if (pos >= argc || !parse_number(args[pos], opt == "--request-memory" ? request_limits.mem_limit
+                                                                                   : request_limits.time_limit)) {
+                std::cerr << args[0] << ": " << opt << ": number expected" << std::endl;
+                return 1;
+            }
+            pos++;
+            continue;
+        }
+        if (args[pos].starts_with("--trace-calls=")) {
+            auto threshold = args[pos].substr(std::string("--trace-calls=").size());
+            size_t threshold_ns;
+            if (threshold == "none") trace_call_threshold = std::nullopt;
+            else if (parse_number(threshold, threshold_ns)) trace_call_threshold = threshold_ns;
+            else {
+                std::cerr << args[0] << ": --trace-calls: number of nanoseconds or 'none' expected" << std::endl;
+                return 1;
+            }
+            pos++;
+            continue;
+        }
+        if (args[pos].starts_with("--trace=")) {
+            trace_path = args[pos].substr(std::string("--trace=").size());
+            if (trace_path->empty()) {
+                std::cerr << args[0] << ": --trace: output path expected" << std::endl;
+                return 1;
+            }
+            pos++;
+            continue;
+        }
+        if (args[pos].starts_with("--exec-stats=")) {
+#ifdef FUNSCRIPT_EXEC_STATS
+            exec_stats_path = args[pos].substr(std::string("--exec-stats=").size());
+            pos++;
+            continue;
+#else
+            std::cerr << args[0] << ": --exec-stats: Funscript is built without FUNSCRIPT_EXEC_STATS" << std::endl;
+            return 1;
+#endif
+        }
+        if (args[pos].starts_with("--call-stats=")) {
+            call_stats_path = args[pos].substr(std::string("--call-stats=").size());
+            if (call_stats_path->empty()) {
+                std::cerr << args[0] << ": --call-stats: output path expected" << std::endl;
+                return 1;
+            }
+            pos++;
+            continue;
+        }
+        if (args[pos].starts_with("--profile=")) {
+            profile_path = args[pos].substr(std::string("--profile=").size());
+            if (profile_path->empty()) {
+                std::cerr << args[0] << ": --profile: output path expected" << std::endl;
+                return 1;
+            }
+            pos++;
+            continue;
+        }
+        if (args[pos] == "--fork-server") {
+            fork_server = true;
+            pos++;
+            continue;
+        }
+        if (args[pos] == "--workers") {
+            pos++;
+            if (pos >= argc || !parse_number(args[pos], workers) || workers == 0) {
+                std::cerr << args[0] << ": --workers: positive number expected" << std::endl;
+                return 1;
+            }
+            pos++;
+            continue;
+        }
+        if (args[pos] == "--input") {
+            pos++;
+            if (pos >= argc) {
+                std::cerr << args[0] << ": --input: file name expected" << std::endl;
+                return 1;
+            }
+            input_files.push_back(args[pos]);
+            pos++;
+            continue;
+        }
         if (modules.back().name.has_value()) modules.emplace_back(); // If the module name was encountered, we should proceed to configuration of the next module
         const auto &arg = args[pos];
         if (arg == "-m") {
@@ -56,7 +562,14 @@ int main(int argc, const char **argv) {
         std::cerr << args[0] << ": " << arg << ": invalid option" << std::endl;
         return 1;
     }
-    if (!modules.back().name.has_value()) {
+    if (daemon_conf.has_value()) { // Imports and dependencies after the last module apply to submitted scripts
+        daemon_conf->mem_limit = request_limits.mem_limit;
+        daemon_conf->time_limit = request_limits.time_limit;
+        if (!modules.back().name.has_value()) {
+            daemon_conf->script_conf = modules.back();
+            modules.pop_back();
+        }
+    } else if (!modules.back().name.has_value()) {
         std::cerr << args[0] << ": module name expected" << std::endl;
         return 1;
     }
@@ -68,11 +581,47 @@ int main(int argc, const char **argv) {
     VM vm({
                   .mm{.allocator = &allocator},
                   .stack_values_max = 67108864 /* 64 Mi */,
-                  .stack_frames_max = 256 /* 1 Ki */
+                  .stack_frames_max = 256 /* 1 Ki */,
+                  .exec_stats_path = exec_stats_path.has_value() ? exec_stats_path->c_str() : nullptr
           });
+    if (call_stats_path.has_value() && trace_path.has_value() && trace_call_threshold.has_value()) {
+        std::cerr << args[0] << ": --call-stats and --trace cannot be used together" << std::endl;
+        return 1;
+    }
+    if ((profile_path.has_value() || call_stats_path.has_value() || trace_path.has_value()) &&
+        (daemon_conf.has_value() || fork_server || workers || !input_files.empty())) {
+        std::cerr << args[0] << ": profiling cannot be used with a multi-process mode" << std::endl;
+        return 1;
+    }
+    std::optional<Profiler> profiler;
+    if (profile_path.has_value()) {
+        profiler.emplace(vm);
+        profiler->start();
+    }
+    std::optional<Tracer> tracer;
+    if (trace_path.has_value()) {
+        tracer.emplace(trace_call_threshold);
+        tracer->attach(vm);
+    }
+    std::optional<CallProfiler> call_profiler;
+    if (call_stats_path.has_value()) {
+        call_profiler.emplace(vm);
+        call_profiler->start();
+    }
+    // Front-end work of source modules does not depend on the VM state, so their loaders are compiled in parallel
+    std::vector<std::string> module_names;
+    for (const auto &module_conf : modules) {
+        if (module_conf.name.has_value()) module_names.push_back(module_conf.name.value());
+    }
+    auto compiled_loaders = util::compile_src_modules(vm, module_names);
     for (const auto &module_conf : modules) {
+        if (!module_conf.name.has_value()) continue; // No modules are loaded into the daemon
         try {
-            auto module_obj = util::load_module(vm, module_conf.name.value(), module_conf.imps, module_conf.deps);
+            auto loader = compiled_loaders.find(module_conf.name.value());
+            auto module_obj = loader != compiled_loaders.end() ?
+                              util::load_src_module(vm, module_conf.name.value(), loader->second,
+                                                    module_conf.imps, module_conf.deps) :
+                              util::load_module(vm, module_conf.name.value(), module_conf.imps, module_conf.deps);
             vm.register_module(FStr(module_conf.name.value(), vm.mem.str_alloc()), module_obj.get());
         } catch (const util::ModuleLoadingError &err) {
             std::cerr << args[0] << ": " << err.what() << std::endl;
@@ -80,18 +629,39 @@ int main(int argc, const char **argv) {
             return 1;
         }
     }
-    { // Start main module
-        auto run_val = vm.get_module(FStr(modules.back().name.value(), vm.mem.str_alloc())).value()->
-                object->get_field(FStr(MODULE_RUNNER_VAR, vm.mem.str_alloc())).value();
-        if (run_val.type != Type::FUN) {
-            std::cerr << args[0] << ": '" << modules.back().name.value() << "' is not runnable" << std::endl;
+    if (daemon_conf.has_value()) return run_daemon(vm, allocator, daemon_conf.value());
+    if (fork_server) return run_fork_server(vm, modules.back().name.value());
+    if (!input_files.empty() && !workers) workers = 1;
+    if (workers) return run_workers(vm, modules.back().name.value(), workers, input_files);
+    int exit_code = run_main_module(vm, modules.back().name.value()); // Start main module
+    if (profiler.has_value()) {
+        profiler->stop();
+        std::ofstream folded_file(profile_path.value() + ".folded");
+        profiler->write_folded(folded_file);
+        std::ofstream pprof_file(profile_path.value() + ".pb", std::ios::binary);
+        profiler->write_pprof(pprof_file);
+        if (!folded_file || !pprof_file) {
+            std::cerr << args[0] << ": " << profile_path.value() << ": failed to write profile" << std::endl;
             return 1;
         }
-        auto stack = util::eval_fn(vm, run_val.data.fun);
-        if (stack->is_panicked()) {
-            std::cerr << args[0] << ": main module panicked" << std::endl;
-            util::print_panic(*stack);
+    }
+    if (tracer.has_value()) {
+        tracer->detach(vm);
+        std::ofstream trace_file(trace_path.value());
+        tracer->write_json(trace_file);
+        if (!trace_file) {
+            std::cerr << args[0] << ": " << trace_path.value() << ": failed to write trace" << std::endl;
+            return 1;
+        }
+    }
+    if (call_profiler.has_value()) {
+        call_profiler->stop();
+        std::ofstream report_file(call_stats_path.value());
+        call_profiler->write_report(report_file);
+        if (!report_file) {
+            std::cerr << args[0] << ": " << call_stats_path.value() << ": failed to write report" << std::endl;
             return 1;
         }
     }
+    return exit_code;
 }
@@ -2,6 +2,7 @@
 #include "common.hpp"
 
 #include <queue>
+#include <chrono>
 
 namespace funscript {
     Allocation::Allocation(funscript::VM &vm) : vm(vm) {}
@@ -13,17 +14,43 @@ namespace funscript {
     } // NOLINT(readability-make-member-function-const)
 
     void MemoryManager::gc_pin(Allocation *alloc) { // NOLINT(readability-convert-member-functions-to-static)
+        if (alloc->frozen) return; // Frozen allocations may be shared with other threads
         if (!alloc->tracked) [[unlikely]] assertion_failed("allocation is not tracked");
         alloc->gc_pins++;
     }
 
     void MemoryManager::gc_unpin(Allocation *alloc) { // NOLINT(readability-convert-member-functions-to-static)
+        if (alloc->frozen) return;
         if (!alloc->tracked) [[unlikely]] assertion_failed("allocation is not tracked");
         if (!alloc->gc_pins) [[unlikely]] assertion_failed("mismatched allocation unpin");
         alloc->gc_pins--;
     }
 
+    void MemoryManager::gc_freeze(Allocation *alloc) { // NOLINT(readability-convert-member-functions-to-static)
+        std::queue<Allocation *> queue;
+        queue.push(alloc);
+        while (!queue.empty()) {
+            auto *cur = queue.front();
+            queue.pop();
+            if (cur->frozen) continue;
+            if (!cur->tracked) [[unlikely]] assertion_failed("allocation is not tracked");
+            cur->gc_pins++;
+            cur->frozen = true;
+            cur->get_refs([&queue](Allocation *ref) -> void {
+                if (ref && !ref->frozen) queue.push(ref);
+            });
+        }
+    }
+
+    static uint64_t gc_time() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
     void MemoryManager::gc_cycle() {
+        if (gc_hook) gc_hook();
+        gc_stats_t stats{};
+        if (gc_stats_hook) stats.beg_time = gc_time();
         std::queue<Allocation *> queue;
         // Populate the queue with GC roots, unmark other allocations
         for (auto *alloc : gc_tracked) {
@@ -40,6 +67,7 @@ namespace funscript {
                 queue.push(ref);
             });
         }
+        if (gc_stats_hook) stats.mark_end_time = gc_time();
         std::vector<Allocation *> gc_tracked_new;
         // Remove track of unreachable allocations and destroy them
         for (auto *alloc : gc_tracked) {
@@ -48,14 +76,22 @@ namespace funscript {
                 size_t sz = alloc->mm_size;
                 alloc->~Allocation();
                 free(alloc, sz);
+                stats.freed_allocs++;
+                stats.freed_bytes += sz;
             }
         }
         gc_tracked = gc_tracked_new;
+        if (gc_stats_hook) {
+            stats.end_time = gc_time();
+            gc_stats_hook(stats);
+        }
     }
 
     MemoryManager::~MemoryManager() {
         for (auto *alloc : gc_tracked) {
-            if (alloc->gc_pins) assertion_failed("destructing memory manager with pinned allocations");
+            if (alloc->gc_pins && !alloc->frozen) {
+                assertion_failed("destructing memory manager with pinned allocations");
+            }
             size_t sz = alloc->mm_size;
             alloc->~Allocation();
             free(alloc, sz);
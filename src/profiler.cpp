@@ -0,0 +1,325 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <unordered_map>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace funscript {
+
+    namespace {
+
+        std::atomic<Profiler *> active_profiler = nullptr; // The profiler which receives `SIGPROF` signals.
+
+        /**
+         * Minimal encoder of protocol buffers messages.
+         */
+        class ProtoWriter {
+            std::string out;
+
+            void put_varint(uint64_t val) {
+                while (val >= 0x80) {
+                    out.push_back(char((val & 0x7F) | 0x80));
+                    val >>= 7;
+                }
+                out.push_back(char(val));
+            }
+
+        public:
+            void put_int(uint32_t field, uint64_t val) {
+                put_varint(uint64_t(field) << 3 | 0); // Varint
+                put_varint(val);
+            }
+
+            void put_bytes(uint32_t field, const std::string &bytes) {
+                put_varint(uint64_t(field) << 3 | 2); // Length-delimited
+                put_varint(bytes.size());
+                out += bytes;
+            }
+
+            void put_packed(uint32_t field, const std::vector<uint64_t> &vals) {
+                ProtoWriter packed;
+                for (auto val : vals) packed.put_varint(val);
+                put_bytes(field, packed.out);
+            }
+
+            [[nodiscard]] const std::string &data() const {
+                return out;
+            }
+        };
+
+        std::string symbolize(VM::Function *fun) {
+            std::string name;
+            if (fun->get_name().has_value()) name = fun->display();
+            else if (dynamic_cast<VM::NativeFunction *>(fun)) name = "function(#[native]#)";
+            else name = "function";
+            std::replace(name.begin(), name.end(), ';', ':'); // Semicolons separate frames in folded stacks
+            return name;
+        }
+    }
+
+    Profiler::Profiler(VM &vm, unsigned frequency) : vm(vm), frequency(std::max(frequency, 1u)),
+                                                    buffer(new raw_sample_t[BUFFER_SIZE]) {}
+
+    void Profiler::handle_signal(int sig, siginfo_t *info, void *ucontext) {
+        int saved_errno = errno;
+        if (auto *profiler = active_profiler.load(std::memory_order_relaxed)) profiler->record_sample();
+        errno = saved_errno;
+    }
+
+    void Profiler::record_sample() {
+        VM::Stack *stack = vm.active_stack;
+        if (!stack) return;
+        size_t tail = buffer_tail.load(std::memory_order_relaxed);
+        if (tail - buffer_head.load(std::memory_order_acquire) == BUFFER_SIZE) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        raw_sample_t &sample = buffer[tail % BUFFER_SIZE];
+        sample.depth = 0;
+        VM::Frame *frame = stack->get_current_frame();
+        for (; frame && sample.depth < MAX_DEPTH; frame = frame->prev_frame) {
+            const auto &meta = frame->get_meta();
+            sample.frames[sample.depth++] = {frame->fun, meta.filename, meta.position};
+        }
+        sample.truncated = frame != nullptr;
+        buffer_tail.store(tail + 1, std::memory_order_release);
+    }
+
+    void Profiler::drain() {
+        if (draining) return;
+        draining = true;
+        std::unordered_map<VM::Function *, std::string> names; // Functions can be reused after GC, so no cache is kept
+        size_t head = buffer_head.load(std::memory_order_relaxed);
+        size_t tail = buffer_tail.load(std::memory_order_acquire);
+        for (; head != tail; head++) {
+            const raw_sample_t &sample = buffer[head % BUFFER_SIZE];
+            std::vector<frame_t> frames;
+            frames.reserve(sample.depth + 1);
+            if (sample.truncated) frames.push_back({"[truncated]", "", 0});
+            for (size_t pos = sample.depth; pos-- > 0;) {
+                const auto &raw = sample.frames[pos];
+                auto it = names.find(raw.fun);
+                if (it == names.end()) it = names.emplace(raw.fun, symbolize(raw.fun)).first;
+                frames.push_back({it->second, raw.filename ? raw.filename : "?", raw.position.row});
+            }
+            stacks[frames]++;
+        }
+        buffer_head.store(head, std::memory_order_release);
+        draining = false;
+    }
+
+    void Profiler::start() {
+        if (running) return;
+        Profiler *expected = nullptr;
+        if (!active_profiler.compare_exchange_strong(expected, this)) {
+            throw std::runtime_error("another profiler is already running");
+        }
+        prev_gc_hook = vm.mem.gc_hook;
+        vm.mem.gc_hook = [this]() -> void {
+            drain();
+            if (prev_gc_hook) prev_gc_hook();
+        };
+        struct sigaction action{};
+        action.sa_sigaction = handle_signal;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &prev_action);
+        sigevent event{};
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = SIGPROF;
+        event._sigev_un._tid = pid_t(syscall(SYS_gettid));
+        if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) == -1) {
+            std::string err = std::strerror(errno);
+            sigaction(SIGPROF, &prev_action, nullptr);
+            vm.mem.gc_hook = prev_gc_hook;
+            active_profiler.store(nullptr);
+            throw std::runtime_error("failed to create profiling timer: " + err);
+        }
+        long period = 1000000000l / frequency;
+        itimerspec spec{.it_interval = {.tv_sec = period / 1000000000l, .tv_nsec = period % 1000000000l}};
+        spec.it_value = spec.it_interval;
+        timer_settime(timer, 0, &spec, nullptr);
+        running = true;
+    }
+
+    void Profiler::stop() {
+        if (!running) return;
+        timer_delete(timer);
+        sigaction(SIGPROF, &prev_action, nullptr);
+        active_profiler.store(nullptr);
+        vm.mem.gc_hook = prev_gc_hook;
+        running = false;
+        drain();
+    }
+
+    size_t Profiler::get_samples() const {
+        size_t cnt = 0;
+        for (const auto &[frames, frame_cnt] : stacks) cnt += frame_cnt;
+        return cnt;
+    }
+
+    size_t Profiler::get_dropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    void Profiler::write_folded(std::ostream &out) const {
+        for (const auto &[frames, cnt] : stacks) {
+            for (size_t pos = 0; pos < frames.size(); pos++) {
+                if (pos) out << ';';
+                out << frames[pos].function;
+                if (!frames[pos].filename.empty()) out << " (" << frames[pos].filename << ':' << frames[pos].row << ')';
+            }
+            out << ' ' << cnt << '\n';
+        }
+    }
+
+    void Profiler::write_pprof(std::ostream &out) const {
+        // See https://github.com/google/pprof/blob/main/proto/profile.proto
+        std::vector<std::string> strings = {""};
+        std::map<std::string, uint64_t> string_ids = {{"", 0}};
+        auto string_id = [&](const std::string &str) -> uint64_t {
+            auto [it, inserted] = string_ids.insert({str, strings.size()});
+            if (inserted) strings.push_back(str);
+            return it->second;
+        };
+        std::map<std::pair<std::string, std::string>, uint64_t> function_ids;
+        std::map<std::pair<uint64_t, size_t>, uint64_t> location_ids;
+        ProtoWriter profile, functions, locations;
+        auto put_value_type = [&](uint32_t field, const std::string &type, const std::string &unit) -> void {
+            ProtoWriter value_type;
+            value_type.put_int(1, string_id(type));
+            value_type.put_int(2, string_id(unit));
+            profile.put_bytes(field, value_type.data());
+        };
+        put_value_type(1, "samples", "count");
+        put_value_type(1, "cpu", "nanoseconds");
+        uint64_t period = 1000000000ull / frequency;
+        for (const auto &[frames, cnt] : stacks) {
+            std::vector<uint64_t> sample_locations;
+            for (size_t pos = frames.size(); pos-- > 0;) { // Innermost frame goes first
+                const auto &frame = frames[pos];
+                auto [fun_it, new_fun] = function_ids.insert({{frame.function, frame.filename},
+                                                              function_ids.size() + 1});
+                if (new_fun) {
+                    ProtoWriter function;
+                    function.put_int(1, fun_it->second);
+                    function.put_int(2, string_id(frame.function));
+                    function.put_int(3, string_id(frame.function));
+                    function.put_int(4, string_id(frame.filename));
+                    functions.put_bytes(5, function.data());
+                }
+                auto [loc_it, new_loc] = location_ids.insert({{fun_it->second, frame.row}, location_ids.size() + 1});
+                if (new_loc) {
+                    ProtoWriter line, location;
+                    line.put_int(1, fun_it->second);
+                    line.put_int(2, frame.row);
+                    location.put_int(1, loc_it->second);
+                    location.put_bytes(4, line.data());
+                    locations.put_bytes(4, location.data());
+                }
+                sample_locations.push_back(loc_it->second);
+            }
+            ProtoWriter sample;
+            sample.put_packed(1, sample_locations);
+            sample.put_packed(2, {cnt, cnt * period});
+            profile.put_bytes(2, sample.data());
+        }
+        ProtoWriter period_type;
+        period_type.put_int(1, string_id("cpu"));
+        period_type.put_int(2, string_id("nanoseconds"));
+        ProtoWriter tail;
+        for (const auto &str : strings) tail.put_bytes(6, str);
+        tail.put_bytes(11, period_type.data());
+        tail.put_int(12, period);
+        out << profile.data() << locations.data() << functions.data() << tail.data();
+    }
+
+    Profiler::~Profiler() {
+        stop();
+    }
+
+    CallProfiler::CallProfiler(VM &vm) : vm(vm) {}
+
+    uint64_t CallProfiler::now() {
+        timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    void CallProfiler::start() {
+        if (running) return;
+        if (vm.call_hook) throw std::runtime_error("function calls are already instrumented");
+        vm.call_hook = this;
+        running = true;
+    }
+
+    void CallProfiler::stop() {
+        if (!running) return;
+        vm.call_hook = nullptr;
+        for (auto &[stack, stack_calls] : calls) {
+            for (auto &call : stack_calls) call.stats->active = 0;
+        }
+        calls.clear();
+        running = false;
+    }
+
+    void CallProfiler::enter(VM::Stack &stack, VM::Function *fun) {
+        std::pair<Allocation *, size_t> key(fun, 0);
+        auto *bytecode_fun = dynamic_cast<VM::BytecodeFunction *>(fun);
+        if (bytecode_fun) key = {bytecode_fun->get_bytecode(), bytecode_fun->get_offset()};
+        auto [it, inserted] = stats.try_emplace(key);
+        stats_t &fun_stats = it->second;
+        if (inserted) {
+            vm.mem.gc_pin(key.first); // The key must not be reused by another function
+            if (bytecode_fun) {
+                auto loc = bytecode_fun->get_location();
+                if (loc.filename) fun_stats.location = std::string(loc.filename) + ':' + loc.position.to_string();
+            }
+        }
+        if (fun_stats.name.empty() && fun->get_name().has_value()) fun_stats.name = fun->display();
+        fun_stats.calls++;
+        fun_stats.active++;
+        calls[&stack].push_back({.stats = &fun_stats, .beg = now()});
+    }
+
+    void CallProfiler::leave(VM::Stack &stack, VM::Function *fun) {
+        uint64_t end = now();
+        auto it = calls.find(&stack);
+        if (it == calls.end()) return; // The call started before the profiler
+        auto &stack_calls = it->second;
+        uint64_t elapsed = end - stack_calls.back().beg;
+        stats_t &fun_stats = *stack_calls.back().stats;
+        fun_stats.exclusive += elapsed - std::min(elapsed, stack_calls.back().children);
+        if (--fun_stats.active == 0) fun_stats.inclusive += elapsed;
+        stack_calls.pop_back();
+        if (!stack_calls.empty()) stack_calls.back().children += elapsed;
+        else calls.erase(it);
+    }
+
+    void CallProfiler::write_report(std::ostream &out) const {
+        std::vector<const stats_t *> sorted;
+        for (const auto &[key, fun_stats] : stats) sorted.push_back(&fun_stats);
+        std::sort(sorted.begin(), sorted.end(), [](const stats_t *a, const stats_t *b) -> bool {
+            return a->exclusive > b->exclusive;
+        });
+        out << std::setw(12) << "calls" << std::setw(14) << "incl, ms" << std::setw(14) << "excl, ms"
+            << "  function" << '\n';
+        for (const auto *fun_stats : sorted) {
+            out << std::setw(12) << fun_stats->calls << std::fixed << std::setprecision(3)
+                << std::setw(14) << double(fun_stats->inclusive) / 1e6
+                << std::setw(14) << double(fun_stats->exclusive) / 1e6 << "  "
+                << (fun_stats->name.empty() ? "function" : fun_stats->name);
+            if (!fun_stats->location.empty()) out << " at " << fun_stats->location;
+            out << '\n';
+        }
+    }
+
+    CallProfiler::~CallProfiler() {
+        stop();
+        for (const auto &[key, fun_stats] : stats) vm.mem.gc_unpin(key.first);
+    }
+}
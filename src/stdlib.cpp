@@ -1,18 +1,35 @@
 #include "vm.hpp"
 #include "utils.hpp"
+#include "transfer.hpp"
+#include "tracer.hpp"
+#include "kernels.hpp"
 
 #include <memory>
 #include <cstring>
+#include <queue>
+#include <chrono>
+#include <utility>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <optional>
+#include <tuple>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 namespace funscript::stdlib {
 
     namespace lang {
 
+        static void panic_impl(VM::Stack &stack, VM::String *msg) {
+            stack.raise_panic(std::string(msg->bytes));
+        }
+
         void panic(VM::Stack &stack) {
-            std::function fn([&stack](MemoryManager::AutoPtr<VM::String> msg) -> void {
-                stack.panic(std::string(msg->bytes));
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<panic_impl>(stack);
         }
 
         void is_object(VM::Stack &stack) {
@@ -63,42 +80,46 @@ namespace funscript::stdlib {
             stack.push_bln(result);
         }
 
+        static MemoryManager::AutoPtr<VM::String> fun_to_str_impl(VM::Stack &stack, VM::Function *fun) {
+            return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, fun->display());
+        }
+
         void fun_to_str(VM::Stack &stack) {
-            std::function fn([](MemoryManager::AutoPtr<VM::Function> fun) -> MemoryManager::AutoPtr<VM::String> {
-                return fun->vm.mem.gc_new_auto<VM::String>(fun->vm, fun->display());
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<fun_to_str_impl>(stack);
+        }
+
+        static MemoryManager::AutoPtr<VM::String> ptr_to_str_impl(VM::Stack &stack, Allocation *ptr) {
+            return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, FStr(
+                    "pointer(" + addr_to_string(ptr) + ")", stack.vm.mem.str_alloc()
+            ));
         }
 
         void ptr_to_str(VM::Stack &stack) {
-            std::function fn([](MemoryManager::AutoPtr<Allocation> ptr) -> MemoryManager::AutoPtr<VM::String> {
-                return ptr->vm.mem.gc_new_auto<VM::String>(ptr->vm, FStr(
-                        "pointer(" + addr_to_string(ptr.get()) + ")", ptr->vm.mem.str_alloc()
-                ));
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<ptr_to_str_impl>(stack);
+        }
+
+        static MemoryManager::AutoPtr<VM::String> int_to_str_impl(VM::Stack &stack, fint num) {
+            return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, FStr(
+                    std::to_string(num), stack.vm.mem.str_alloc()
+            ));
         }
 
         void int_to_str(VM::Stack &stack) {
-            std::function fn([&stack](fint num) -> MemoryManager::AutoPtr<VM::String> {
-                return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, FStr(
-                        std::to_string(num), stack.vm.mem.str_alloc()
-                ));
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<int_to_str_impl>(stack);
+        }
+
+        static MemoryManager::AutoPtr<VM::String> flp_to_str_impl(VM::Stack &stack, fflp flp) {
+            return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, FStr(
+                    std::to_string(flp), stack.vm.mem.str_alloc()
+            ));
         }
 
         void flp_to_str(VM::Stack &stack) {
-            std::function fn([&stack](fflp flp) -> MemoryManager::AutoPtr<VM::String> {
-                return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, FStr(
-                        std::to_string(flp), stack.vm.mem.str_alloc()
-                ));
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<flp_to_str_impl>(stack);
         }
 
         void str_to_str(VM::Stack &stack) {
-            std::function fn([](MemoryManager::AutoPtr<VM::String> str) -> MemoryManager::AutoPtr<VM::String> {
+            std::function fn([&stack](MemoryManager::AutoPtr<VM::String> str) -> MemoryManager::AutoPtr<VM::String> {
                 size_t length = 0;
                 length++;
                 for (char c : str->bytes) {
@@ -106,7 +127,7 @@ namespace funscript::stdlib {
                     else length += 4; // '\xNN'
                 }
                 length++;
-                FStr result(str->vm.mem.str_alloc());
+                FStr result(stack.vm.mem.str_alloc());
                 result.reserve(length);
                 result += '\'';
                 for (char c : str->bytes) {
@@ -122,7 +143,7 @@ namespace funscript::stdlib {
                     }
                 }
                 result += '\'';
-                return str->vm.mem.gc_new_auto<VM::String>(str->vm, result);
+                return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, result);
             });
             util::call_native_function(stack, fn);
         }
@@ -200,6 +221,7 @@ namespace funscript::stdlib {
         void import_(VM::Stack &stack) {
             std::function fn([&stack](MemoryManager::AutoPtr<VM::Object> obj) -> void {
                 auto *caller_scope = get_caller(stack, -2)->get_meta().scope;
+                if (caller_scope->vars->is_frozen()) stack.panic("object is frozen");
                 for (const auto &[var, val] : obj->get_fields()) {
                     caller_scope->vars->set_field(var, val);
                 }
@@ -207,59 +229,66 @@ namespace funscript::stdlib {
             util::call_native_function(stack, fn);
         }
 
+        static MemoryManager::AutoPtr<Allocation> bytes_allocate_impl(VM::Stack &stack, fint size) {
+            auto ptr = stack.vm.mem.gc_new_auto_arr(stack.vm, size_t(size), char(0));
+            return MemoryManager::AutoPtr<Allocation>(ptr.get());
+        }
+
         void bytes_allocate(VM::Stack &stack) {
-            std::function fn([&stack](fint size) -> MemoryManager::AutoPtr<Allocation> {
-                auto ptr = stack.vm.mem.gc_new_auto_arr(stack.vm, size_t(size), char(0));
-                return MemoryManager::AutoPtr<Allocation>(ptr.get());
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<bytes_allocate_impl>(stack);
+        }
+
+        static void bytes_paste_from_string_impl(VM::Stack &stack, Allocation *data, fint pos, VM::String *str,
+                                                 fint beg, fint end) {
+            if (data->is_frozen()) stack.panic("bytes are frozen");
+            char *bytes = dynamic_cast<ArrayAllocation<char> *>(data)->data();
+            std::memcpy(bytes + pos, str->bytes.c_str() + beg, end - beg);
         }
 
         void bytes_paste_from_string(VM::Stack &stack) {
-            std::function fn([](MemoryManager::AutoPtr<Allocation> data,
-                                fint pos, MemoryManager::AutoPtr<VM::String> str, fint beg, fint end) -> void {
-                char *bytes = dynamic_cast<ArrayAllocation<char> *>(data.get())->data();
-                std::memcpy(bytes + pos, str->bytes.c_str() + beg, end - beg);
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<bytes_paste_from_string_impl>(stack);
+        }
+
+        static void bytes_paste_from_bytes_impl(VM::Stack &stack, Allocation *dst, fint pos, Allocation *src,
+                                                fint beg, fint end) {
+            if (dst->is_frozen()) stack.panic("bytes are frozen");
+            char *bytes_dst = dynamic_cast<ArrayAllocation<char> *>(dst)->data();
+            char *bytes_src = dynamic_cast<ArrayAllocation<char> *>(src)->data();
+            memmove(bytes_dst + pos, bytes_src + beg, end - beg);
         }
 
         void bytes_paste_from_bytes(VM::Stack &stack) {
-            std::function fn([](MemoryManager::AutoPtr<Allocation> dst,
-                                fint pos, MemoryManager::AutoPtr<Allocation> src, fint beg, fint end) -> void {
-                char *bytes_dst = dynamic_cast<ArrayAllocation<char> *>(dst.get())->data();
-                char *bytes_src = dynamic_cast<ArrayAllocation<char> *>(src.get())->data();
-                memmove(bytes_dst + pos, bytes_src + beg, end - beg);
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<bytes_paste_from_bytes_impl>(stack);
+        }
+
+        static fint bytes_find_string_impl(VM::Stack &stack, Allocation *data, fint beg, fint end, VM::String *str) {
+            char *bytes = dynamic_cast<ArrayAllocation<char> *>(data)->data();
+            return std::search(bytes + beg, bytes + end,
+                               str->bytes.data(), str->bytes.data() + str->bytes.size()) - bytes;
         }
 
         void bytes_find_string(VM::Stack &stack) {
-            std::function fn([](MemoryManager::AutoPtr<Allocation> data,
-                                fint beg, fint end, MemoryManager::AutoPtr<VM::String> str) -> fint {
-                char *bytes = dynamic_cast<ArrayAllocation<char> *>(data.get())->data();
-                return std::search(bytes + beg, bytes + end,
-                                   str->bytes.data(), str->bytes.data() + str->bytes.size()) - bytes;
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<bytes_find_string_impl>(stack);
+        }
+
+        static MemoryManager::AutoPtr<VM::String> bytes_to_string_impl(VM::Stack &stack, Allocation *data,
+                                                                        fint beg, fint end) {
+            char *bytes = dynamic_cast<ArrayAllocation<char> *>(data)->data();
+            return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, FStr(
+                    bytes + beg, bytes + end, stack.vm.mem.str_alloc()
+            ));
         }
 
         void bytes_to_string(VM::Stack &stack) {
-            std::function fn([](MemoryManager::AutoPtr<Allocation> data,
-                                fint beg, fint end) -> MemoryManager::AutoPtr<VM::String> {
-                char *bytes = dynamic_cast<ArrayAllocation<char> *>(data.get())->data();
-                return data->vm.mem.gc_new_auto<VM::String>(data->vm, FStr(
-                        bytes + beg, bytes + end, data->vm.mem.str_alloc()
-                ));
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<bytes_to_string_impl>(stack);
+        }
+
+        static fbln string_is_suffix_impl(VM::Stack &stack, VM::String *str, VM::String *suf) {
+            return str->bytes.ends_with(suf->bytes);
         }
 
         void string_is_suffix(VM::Stack &stack) {
-            std::function f([](MemoryManager::AutoPtr<VM::String> str, MemoryManager::AutoPtr<VM::String> suf) -> fbln {
-                return str->bytes.ends_with(suf->bytes);
-            });
-            util::call_native_function(stack, f);
+            util::bind_native<string_is_suffix_impl>(stack);
         }
 
         void concat(VM::Stack &stack) {
@@ -292,7 +321,8 @@ namespace funscript::stdlib {
                             get_caller(stack, -2)->fun->mod,
                             scope.get(),
                             std::string(filename->bytes),
-                            std::string(expr->bytes)
+                            std::string(expr->bytes),
+                            true
                     );
                     fun->assign_name(name->bytes);
                     return fun;
@@ -303,37 +333,393 @@ namespace funscript::stdlib {
             util::call_native_function(stack, fn);
         }
 
+        void load_data(VM::Stack &stack) {
+            if (stack.size() < 3 || stack[-3].type != Type::SEP || stack[-2].type != Type::STR ||
+                stack[-1].type != Type::STR) {
+                return util::native_args_panic(stack, {Type::STR, Type::STR});
+            }
+            auto result = util::eval_data(stack.vm, std::string(stack[-1].data.str->bytes),
+                                          std::string(stack[-2].data.str->bytes));
+            if (result->is_panicked()) return stack.raise_panic(std::string((*result)[-1].data.str->bytes));
+            stack.pop(stack.find_sep());
+            for (const auto &val : result->get_values()) stack.push(val);
+        }
+
+        void serialize(VM::Stack &stack) {
+            VM::Stack::pos_t beg = stack.find_sep() + 1;
+            Serializer serializer;
+            try {
+                const auto *values = stack.get_values().data();
+                serializer.write(values + beg, values + stack.size());
+            } catch (const SerializationError &err) {
+                return stack.raise_panic(err.what());
+            }
+            const auto &out = serializer.get_buffer();
+            auto bytes = stack.vm.mem.gc_new_auto_arr(stack.vm, out.size(), char(0));
+            std::memcpy(bytes->data(), out.data(), out.size());
+            stack.pop(stack.find_sep());
+            stack.push_ptr(bytes.get());
+            stack.push_int(fint(out.size()));
+        }
+
+        void deserialize(VM::Stack &stack) {
+            if (stack.size() < 4 || stack[-4].type != Type::SEP || stack[-3].type != Type::PTR ||
+                stack[-2].type != Type::INT || stack[-1].type != Type::INT) {
+                return util::native_args_panic(stack, {Type::PTR, Type::INT, Type::INT});
+            }
+            char *bytes = dynamic_cast<ArrayAllocation<char> *>(stack[-3].data.ptr)->data();
+            Deserializer deserializer(std::string_view(bytes + stack[-2].data.num,
+                                                       size_t(stack[-1].data.num - stack[-2].data.num)));
+            stack.pop(stack.find_sep());
+            try {
+                while (deserializer.read(stack)); // Values of all the messages are returned
+            } catch (const SerializationError &err) {
+                stack.raise_panic(err.what());
+            }
+        }
+
+        // The helpers of typed array natives return `nullptr`, an empty value or `false` after raising a panic.
+
+        static VM::TypedArray *get_typed_array(VM::Stack &stack, Allocation *ptr) {
+            auto *arr = dynamic_cast<VM::TypedArray *>(ptr);
+            if (!arr) stack.raise_panic("typed array expected");
+            return arr;
+        }
+
+        static std::optional<VM::TypedArray::ElemType> get_elem_type(VM::Stack &stack, VM::String *name) {
+            auto elem_type = kernels::parse_elem_type(std::string_view(name->bytes.data(), name->bytes.size()));
+            if (!elem_type.has_value()) stack.raise_panic("unknown element type");
+            return elem_type;
+        }
+
+        static bool check_elem(VM::Stack &stack, const VM::TypedArray &arr, const VM::Value &val) {
+            if (VM::TypedArray::is_integral(arr.elem_type)) {
+                if (val.type != Type::INT) {
+                    stack.raise_panic("integer expected");
+                    return false;
+                }
+            } else if (val.type != Type::FLP) {
+                stack.raise_panic("float expected");
+                return false;
+            }
+            return true;
+        }
+
+        static bool check_shapes(VM::Stack &stack, const VM::TypedArray &a, const VM::TypedArray &b) {
+            if (a.elem_type != b.elem_type) {
+                stack.raise_panic("typed arrays of the same element type expected");
+                return false;
+            }
+            if (a.len() != b.len()) {
+                stack.raise_panic("typed arrays of the same length expected");
+                return false;
+            }
+            return true;
+        }
+
+        static MemoryManager::AutoPtr<Allocation> typed_allocate_impl(VM::Stack &stack, VM::String *elem, fint len) {
+            auto elem_type = get_elem_type(stack, elem);
+            if (!elem_type.has_value()) return MemoryManager::AutoPtr<Allocation>(nullptr);
+            if (len < 0) {
+                stack.raise_panic("invalid array length");
+                return MemoryManager::AutoPtr<Allocation>(nullptr);
+            }
+            auto arr = stack.vm.mem.gc_new_auto<VM::TypedArray>(stack.vm, elem_type.value(), size_t(len));
+            return MemoryManager::AutoPtr<Allocation>(arr.get());
+        }
+
+        void typed_allocate(VM::Stack &stack) {
+            util::bind_native<typed_allocate_impl>(stack);
+        }
+
+        static MemoryManager::AutoPtr<Allocation> typed_from_array_impl(VM::Stack &stack, VM::String *elem,
+                                                                        VM::Array *values) {
+            auto elem_type = get_elem_type(stack, elem);
+            if (!elem_type.has_value()) return MemoryManager::AutoPtr<Allocation>(nullptr);
+            auto arr = stack.vm.mem.gc_new_auto<VM::TypedArray>(stack.vm, elem_type.value(), values->len());
+            for (size_t pos = 0; pos < values->len(); pos++) {
+                if (!arr->set(pos, (*values)[pos]) && !check_elem(stack, *arr, (*values)[pos])) {
+                    return MemoryManager::AutoPtr<Allocation>(nullptr);
+                }
+            }
+            return MemoryManager::AutoPtr<Allocation>(arr.get());
+        }
+
+        void typed_from_array(VM::Stack &stack) {
+            util::bind_native<typed_from_array_impl>(stack);
+        }
+
+        static MemoryManager::AutoPtr<VM::Array> typed_to_array_impl(VM::Stack &stack, Allocation *ptr) {
+            const auto *arr = get_typed_array(stack, ptr);
+            if (!arr) return MemoryManager::AutoPtr<VM::Array>(nullptr);
+            auto values = stack.vm.mem.gc_new_auto<VM::Array>(stack.vm, arr->len());
+            for (size_t pos = 0; pos < arr->len(); pos++) (*values)[pos] = arr->get(pos);
+            return values;
+        }
+
+        void typed_to_array(VM::Stack &stack) {
+            util::bind_native<typed_to_array_impl>(stack);
+        }
+
+        static MemoryManager::AutoPtr<VM::String> typed_get_elem_type_impl(VM::Stack &stack, Allocation *ptr) {
+            const auto *arr = get_typed_array(stack, ptr);
+            if (!arr) return MemoryManager::AutoPtr<VM::String>(nullptr);
+            FStr name(kernels::elem_type_name(arr->elem_type), stack.vm.mem.str_alloc());
+            return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, name);
+        }
+
+        void typed_get_elem_type(VM::Stack &stack) {
+            util::bind_native<typed_get_elem_type_impl>(stack);
+        }
+
+        /**
+         * Applies the elementwise kernel to the arrays, the results are written to a new array of the element type.
+         */
+        template<void (*Kernel)(VM::TypedArray &, const VM::TypedArray &, const VM::TypedArray &), bool Mask>
+        static MemoryManager::AutoPtr<Allocation> typed_elementwise_impl(VM::Stack &stack, Allocation *a_ptr,
+                                                                         Allocation *b_ptr) {
+            const auto *a = get_typed_array(stack, a_ptr);
+            if (!a) return MemoryManager::AutoPtr<Allocation>(nullptr);
+            const auto *b = get_typed_array(stack, b_ptr);
+            if (!b || !check_shapes(stack, *a, *b)) return MemoryManager::AutoPtr<Allocation>(nullptr);
+            auto dst = stack.vm.mem.gc_new_auto<VM::TypedArray>(
+                    stack.vm, Mask ? VM::TypedArray::ElemType::UINT8 : a->elem_type, a->len()
+            );
+            Kernel(*dst, *a, *b);
+            return MemoryManager::AutoPtr<Allocation>(dst.get());
+        }
+
+        void typed_add(VM::Stack &stack) {
+            util::bind_native<typed_elementwise_impl<kernels::add, false>>(stack);
+        }
+
+        void typed_mul(VM::Stack &stack) {
+            util::bind_native<typed_elementwise_impl<kernels::mul, false>>(stack);
+        }
+
+        void typed_less(VM::Stack &stack) {
+            util::bind_native<typed_elementwise_impl<kernels::less, true>>(stack);
+        }
+
+        void typed_equal(VM::Stack &stack) {
+            util::bind_native<typed_elementwise_impl<kernels::equal, true>>(stack);
+        }
+
+        static VM::Value typed_sum_impl(VM::Stack &stack, Allocation *ptr) {
+            const auto *arr = get_typed_array(stack, ptr);
+            if (!arr) return {};
+            return kernels::sum(*arr);
+        }
+
+        void typed_sum(VM::Stack &stack) {
+            util::bind_native<typed_sum_impl>(stack);
+        }
+
+        static VM::Value typed_min_impl(VM::Stack &stack, Allocation *ptr) {
+            const auto *arr = get_typed_array(stack, ptr);
+            if (!arr) return {};
+            if (!arr->len()) {
+                stack.raise_panic("array is empty");
+                return {};
+            }
+            return kernels::min(*arr);
+        }
+
+        void typed_min(VM::Stack &stack) {
+            util::bind_native<typed_min_impl>(stack);
+        }
+
+        static VM::Value typed_max_impl(VM::Stack &stack, Allocation *ptr) {
+            const auto *arr = get_typed_array(stack, ptr);
+            if (!arr) return {};
+            if (!arr->len()) {
+                stack.raise_panic("array is empty");
+                return {};
+            }
+            return kernels::max(*arr);
+        }
+
+        void typed_max(VM::Stack &stack) {
+            util::bind_native<typed_max_impl>(stack);
+        }
+
+        static VM::Value typed_dot_impl(VM::Stack &stack, Allocation *a_ptr, Allocation *b_ptr) {
+            const auto *a = get_typed_array(stack, a_ptr);
+            if (!a) return {};
+            const auto *b = get_typed_array(stack, b_ptr);
+            if (!b || !check_shapes(stack, *a, *b)) return {};
+            return kernels::dot(*a, *b);
+        }
+
+        void typed_dot(VM::Stack &stack) {
+            util::bind_native<typed_dot_impl>(stack);
+        }
+
+        /**
+         * Applies the in-place kernel with a scalar argument to the array.
+         */
+        template<void (*Kernel)(VM::TypedArray &, const VM::Value &)>
+        static void typed_update(VM::Stack &stack) {
+            if (stack.size() < 3 || stack[-3].type != Type::SEP || stack[-2].type != Type::PTR ||
+                stack[-1].type == Type::SEP) {
+                return util::native_args_panic(stack, {Type::PTR, Type::INT});
+            }
+            auto *arr = get_typed_array(stack, stack[-2].data.ptr);
+            if (!arr) return;
+            if (arr->is_frozen()) return stack.raise_panic("array is frozen");
+            if (!check_elem(stack, *arr, stack[-1])) return;
+            Kernel(*arr, stack[-1]);
+            stack.pop(stack.find_sep());
+        }
+
+        void typed_fill(VM::Stack &stack) {
+            typed_update<kernels::fill>(stack);
+        }
+
+        void typed_scale(VM::Stack &stack) {
+            typed_update<kernels::scale>(stack);
+        }
+
+        void freeze(VM::Stack &stack) {
+            // Frozen values are referenced by VMs of the whole process, so the heap is never destroyed
+            static auto *heap = new FrozenHeap();
+            if (stack[-1].type == Type::SEP || stack[-2].type != Type::SEP) stack.panic("single value expected");
+            try {
+                auto result = heap->freeze(stack[-1]);
+                stack.pop(stack.find_sep());
+                stack.push(result);
+            } catch (const TransferError &err) {
+                stack.panic(err.what());
+            }
+        }
+
+        void is_frozen(VM::Stack &stack) {
+            fbln result = false;
+            stack[-1].get_ref([&result](Allocation *alloc) -> void { result = alloc->is_frozen(); });
+            stack.pop(stack.find_sep());
+            stack.push_bln(result);
+        }
+
     }
 
     namespace sys {
 
+        static fint posix_get_errno_impl(VM::Stack &stack) {
+            return fint(errno);
+        }
+
         void posix_get_errno(VM::Stack &stack) {
-            std::function fn([]() -> fint { return fint(errno); });
-            util::call_native_function(stack, fn);
+            util::bind_native<posix_get_errno_impl>(stack);
+        }
+
+        static fint posix_write_impl(VM::Stack &stack, fint fd, Allocation *data, fint beg, fint end) {
+            Tracer::Span span(stack.vm.tracer, "io", "write");
+            char *bytes = dynamic_cast<ArrayAllocation<char> *>(data)->data();
+            auto cnt = write(int(fd), bytes + beg, size_t(end - beg));
+            if (stack.vm.tracer) {
+                span.args = "{\"fd\": " + std::to_string(fd) + ", \"result\": " + std::to_string(cnt) + "}";
+            }
+            return fint(cnt);
         }
 
         void posix_write(VM::Stack &stack) {
-            std::function fn([](fint fd, MemoryManager::AutoPtr<Allocation> data, fint beg, fint end) -> fint {
-                char *bytes = dynamic_cast<ArrayAllocation<char> *>(data.get())->data();
-                return fint(write(int(fd), bytes + beg, size_t(end - beg)));
-            });
-            util::call_native_function(stack, fn);
+            util::bind_native<posix_write_impl>(stack);
+        }
+
+        static fint posix_read_impl(VM::Stack &stack, fint fd, Allocation *data, fint beg, fint end) {
+            Tracer::Span span(stack.vm.tracer, "io", "read");
+            char *bytes = dynamic_cast<ArrayAllocation<char> *>(data)->data();
+            auto cnt = read(int(fd), bytes + beg, size_t(end - beg));
+            if (stack.vm.tracer) {
+                span.args = "{\"fd\": " + std::to_string(fd) + ", \"result\": " + std::to_string(cnt) + "}";
+            }
+            return fint(cnt);
         }
 
         void posix_read(VM::Stack &stack) {
-            std::function fn([](fint fd, MemoryManager::AutoPtr<Allocation> data, fint beg, fint end) -> fint {
-                char *bytes = dynamic_cast<ArrayAllocation<char> *>(data.get())->data();
-                return fint(read(int(fd), bytes + beg, size_t(end - beg)));
+            util::bind_native<posix_read_impl>(stack);
+        }
+
+        struct posix_error_t {}; // Thrown by the sinks and sources of serialization when a system call fails.
+
+        void posix_write_values(VM::Stack &stack) {
+            VM::Stack::pos_t beg = stack.find_sep() + 1;
+            if (beg == stack.size() || stack[beg].type != Type::INT) return util::native_args_panic(stack, {Type::INT});
+            Tracer::Span span(stack.vm.tracer, "io", "write_values");
+            int fd = int(stack[beg].data.num);
+            Serializer serializer([fd](const char *data, size_t len) -> void {
+                while (len) {
+                    auto cnt = write(fd, data, len);
+                    if (cnt < 0 && errno == EINTR) continue;
+                    if (cnt < 0) throw posix_error_t();
+                    data += cnt;
+                    len -= cnt;
+                }
             });
-            util::call_native_function(stack, fn);
+            fint result = 0;
+            try {
+                const auto *values = stack.get_values().data();
+                serializer.write(values + beg + 1, values + stack.size());
+            } catch (const posix_error_t &) {
+                result = -1;
+            } catch (const SerializationError &err) {
+                stack.panic(err.what());
+            }
+            stack.pop(stack.find_sep());
+            stack.push_int(result);
         }
 
-        void posix_strerror(VM::Stack &stack) {
-            std::function fn([&stack](fint err_num) -> MemoryManager::AutoPtr<VM::String> {
-                FStr err_str(strerror(int(err_num)), stack.vm.mem.str_alloc());
-                return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, err_str);
+        void posix_read_values(VM::Stack &stack) {
+            if (stack.size() < 2 || stack[-2].type != Type::SEP || stack[-1].type != Type::INT) {
+                return util::native_args_panic(stack, {Type::INT});
+            }
+            Tracer::Span span(stack.vm.tracer, "io", "read_values");
+            int fd = int(stack[-1].data.num);
+            Deserializer deserializer([fd](char *data, size_t len) -> size_t {
+                while (true) {
+                    auto cnt = read(fd, data, len);
+                    if (cnt < 0 && errno == EINTR) continue;
+                    if (cnt < 0) throw posix_error_t();
+                    return size_t(cnt);
+                }
             });
-            util::call_native_function(stack, fn);
+            stack.pop(stack.find_sep());
+            VM::Stack::pos_t beg = stack.size();
+            fbln ok = true;
+            try {
+                while (deserializer.read(stack)); // The input is read until its end
+            } catch (const posix_error_t &) {
+                ok = false;
+                if (stack.size() > beg) stack.pop(beg);
+            } catch (const SerializationError &err) {
+                stack.panic(err.what());
+            }
+            auto values = stack.vm.mem.gc_new_auto<VM::Array>(
+                    stack.vm, const_cast<VM::Value *>(stack.get_values().data() + beg), size_t(stack.size() - beg)
+            );
+            if (stack.size() > beg) stack.pop(beg);
+            stack.push_bln(ok);
+            stack.push_arr(values.get());
+        }
+
+        static fint posix_set_nonblocking_impl(VM::Stack &stack, fint fd, fbln nonblocking) {
+            int flags = fcntl(int(fd), F_GETFL);
+            if (flags < 0) return -1;
+            flags = nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+            return fint(fcntl(int(fd), F_SETFL, flags));
+        }
+
+        void posix_set_nonblocking(VM::Stack &stack) {
+            util::bind_native<posix_set_nonblocking_impl>(stack);
+        }
+
+        static MemoryManager::AutoPtr<VM::String> posix_strerror_impl(VM::Stack &stack, fint err_num) {
+            FStr err_str(strerror(int(err_num)), stack.vm.mem.str_alloc());
+            return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, err_str);
+        }
+
+        void posix_strerror(VM::Stack &stack) {
+            util::bind_native<posix_strerror_impl>(stack);
         }
     }
 
@@ -350,7 +736,7 @@ namespace funscript::stdlib {
         void stack_execute(VM::Stack &stack) {
             std::function fn([](MemoryManager::AutoPtr<Allocation> stack_ptr) -> void {
                 VM::Stack &stack = *dynamic_cast<VM::Stack *>(stack_ptr.get());
-                stack.execute();
+                stack.resume();
             });
             util::call_native_function(stack, fn);
         }
@@ -395,4 +781,837 @@ namespace funscript::stdlib {
             util::call_native_function(stack, fn);
         }
     }
-}
\ No newline at end of file
+
+    namespace events {
+
+        /**
+         * Coroutine managed by an event loop.
+         */
+        class Task final : public Allocation {
+            void get_refs(const std::function<void(Allocation *)> &callback) override {
+                callback(stack);
+            }
+
+        public:
+            enum class State {
+                READY, // Task is in the run queue.
+                RUNNING, // Task is being executed.
+                BLOCKED, // Task is waiting for a timer or a file descriptor.
+                PARKED, // Task is waiting to be woken up by another task.
+                FINISHED,
+                CANCELLED // Task was still parked when the loop ran out of work.
+            };
+
+            VM::Stack *const stack;
+            const size_t priority;
+            State state = State::READY;
+
+            Task(VM::Stack *stack, size_t priority) : Allocation(stack->vm), stack(stack), priority(priority) {}
+        };
+
+        /**
+         * Single-threaded event loop which schedules execution stacks as green threads.
+         * Tasks are preempted at safe points once their time slice is exhausted, suspended while waiting for timers or
+         * file descriptors and resumed once epoll reports them ready. Run queues are served in strict priority order.
+         */
+        class EventLoop final : public Allocation {
+        public:
+            static constexpr size_t PRIORITIES = 8; // Amount of priority levels (0 is the highest one).
+            static constexpr size_t DEFAULT_TIME_SLICE = 10000; // Default time slice of each task, in instructions.
+
+        private:
+            using clock = std::chrono::steady_clock;
+
+            struct Timer {
+                clock::time_point deadline;
+                uint64_t seq; // Keeps timers with equal deadlines in FIFO order.
+                Task *task;
+
+                bool operator>(const Timer &other) const {
+                    return std::tie(deadline, seq) > std::tie(other.deadline, other.seq);
+                }
+            };
+
+            struct Waiters {
+                Task *reader = nullptr;
+                Task *writer = nullptr;
+            };
+
+            int epoll_fd;
+            int timer_fd;
+            FVec<FDeq<Task *>> ready; // Run queues of tasks which can be resumed right now.
+            size_t ready_cnt = 0;
+            std::priority_queue<Timer, FVec<Timer>, std::greater<>> timers;
+            FMap<int, Waiters> waiters; // Tasks waiting for file descriptors, by file descriptor.
+            FSet<Task *> tasks; // All unfinished tasks of the loop.
+            size_t blocked_cnt = 0; // Amount of tasks which wait for timers or file descriptors.
+            uint64_t timers_seq = 0;
+            Task *current = nullptr; // The task being executed.
+            size_t time_slice = DEFAULT_TIME_SLICE;
+
+            void get_refs(const std::function<void(Allocation *)> &callback) override {
+                for (auto *task : tasks) callback(task);
+            }
+
+            void make_ready(Task *task) {
+                task->state = Task::State::READY;
+                ready[task->priority].push_back(task);
+                ready_cnt++;
+            }
+
+            Task *pop_ready() {
+                for (auto &queue : ready) {
+                    if (queue.empty()) continue;
+                    auto *task = queue.front();
+                    queue.pop_front();
+                    ready_cnt--;
+                    return task;
+                }
+                return nullptr;
+            }
+
+            void unblock(Task *task) {
+                blocked_cnt--;
+                make_ready(task);
+            }
+
+            void arm_timer() {
+                itimerspec spec{};
+                if (!timers.empty()) {
+                    auto delay = std::max(timers.top().deadline - clock::now(), clock::duration(1));
+                    auto secs = std::chrono::duration_cast<std::chrono::seconds>(delay);
+                    spec.it_value.tv_sec = secs.count();
+                    spec.it_value.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(delay - secs).count();
+                }
+                timerfd_settime(timer_fd, 0, &spec, nullptr);
+            }
+
+            void update_interest(int fd) {
+                const auto &w = waiters.at(fd);
+                epoll_event event{.events = 0, .data = {.fd = fd}};
+                if (w.reader) event.events |= EPOLLIN;
+                if (w.writer) event.events |= EPOLLOUT;
+                if (!event.events) {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                    waiters.erase(fd);
+                } else if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0) {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+                }
+            }
+
+            void poll(int timeout) {
+                epoll_event events[64];
+                int cnt;
+                do cnt = epoll_wait(epoll_fd, events, 64, timeout);
+                while (cnt < 0 && errno == EINTR && !VM::Stack::kbd_int);
+                for (int i = 0; i < cnt; i++) {
+                    int fd = events[i].data.fd;
+                    if (fd == timer_fd) {
+                        uint64_t expirations;
+                        [[maybe_unused]] auto res = read(timer_fd, &expirations, sizeof(expirations));
+                        auto now = clock::now();
+                        while (!timers.empty() && timers.top().deadline <= now) {
+                            unblock(timers.top().task);
+                            timers.pop();
+                        }
+                        arm_timer();
+                        continue;
+                    }
+                    auto &w = waiters.at(fd);
+                    if (w.reader && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                        unblock(std::exchange(w.reader, nullptr));
+                    }
+                    if (w.writer && (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) {
+                        unblock(std::exchange(w.writer, nullptr));
+                    }
+                    update_interest(fd);
+                }
+            }
+
+            Task &get_current(VM::Stack &stack) {
+                if (!current || current->stack != &stack) stack.panic("not running in a task of this event loop");
+                return *current;
+            }
+
+            void block(VM::Stack &stack, Task::State state) {
+                current->state = state;
+                if (state == Task::State::BLOCKED) blocked_cnt++;
+                stack.suspend();
+            }
+
+        public:
+            explicit EventLoop(VM &vm) : Allocation(vm), epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+                                         timer_fd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+                                         ready(PRIORITIES, FDeq<Task *>(vm.mem.std_alloc<Task *>()),
+                                               vm.mem.std_alloc<FDeq<Task *>>()),
+                                         timers(std::greater<>(), FVec<Timer>(vm.mem.std_alloc<Timer>())),
+                                         waiters(vm.mem.std_alloc<std::pair<const int, Waiters>>()),
+                                         tasks(vm.mem.std_alloc<Task *>()) {
+                epoll_event event{.events = EPOLLIN, .data = {.fd = timer_fd}};
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+            }
+
+            MemoryManager::AutoPtr<Task> spawn(VM::Stack &stack, VM::Function *start, fint priority) {
+                if (priority < 0 || priority >= fint(PRIORITIES)) stack.panic("invalid task priority");
+                auto task_stack = vm.mem.gc_new_auto<VM::Stack>(vm, start);
+                task_stack->push_sep(); // No arguments
+                task_stack->set_time_slice(time_slice);
+                auto task = vm.mem.gc_new_auto<Task>(task_stack.get(), size_t(priority));
+                tasks.insert(task.get());
+                make_ready(task.get());
+                return task;
+            }
+
+            void set_time_slice(size_t instructions) {
+                time_slice = instructions;
+            }
+
+            void sleep(VM::Stack &stack, fint ms) {
+                auto &task = get_current(stack);
+                timers.push({clock::now() + std::chrono::milliseconds(ms), timers_seq++, &task});
+                if (timers.top().task == &task) arm_timer();
+                block(stack, Task::State::BLOCKED);
+            }
+
+            void yield(VM::Stack &stack) {
+                get_current(stack);
+                block(stack, Task::State::READY);
+            }
+
+            void park(VM::Stack &stack) {
+                get_current(stack);
+                block(stack, Task::State::PARKED);
+            }
+
+            bool wake(Task *task) {
+                if (task->state != Task::State::PARKED) return false;
+                make_ready(task);
+                return true;
+            }
+
+            void wait_fd(VM::Stack &stack, int fd, bool writable) {
+                auto &task = get_current(stack);
+                auto &w = waiters[fd];
+                auto &slot = writable ? w.writer : w.reader;
+                if (slot) stack.panic("another task is already waiting for this file descriptor");
+                slot = &task;
+                update_interest(fd);
+                block(stack, Task::State::BLOCKED);
+            }
+
+            /**
+             * Runs all the spawned tasks until none of them can make any progress. Tasks which are still parked then
+             * are cancelled, so that they do not hold their stacks until the VM is destroyed.
+             * @param stack The stack which runs the loop. Receives panics of the tasks.
+             */
+            void run(VM::Stack &stack) {
+                if (current) stack.panic("the event loop is already running");
+                while (ready_cnt || blocked_cnt) {
+                    // Blocked tasks are checked once per round, so that busy tasks cannot delay them indefinitely
+                    if (blocked_cnt) poll(ready_cnt ? 0 : -1);
+                    if (VM::Stack::kbd_int) {
+                        VM::Stack::kbd_int = 0;
+                        stack.panic("keyboard interrupt");
+                    }
+                    for (size_t round = ready_cnt; round; round--) {
+                        auto task = MemoryManager::AutoPtr(pop_ready());
+                        task->state = Task::State::RUNNING;
+                        current = task.get();
+                        try {
+                            task->stack->resume();
+                        } catch (...) {
+                            current = nullptr;
+                            throw;
+                        }
+                        current = nullptr;
+                        if (task->state == Task::State::RUNNING || task->state == Task::State::READY) {
+                            if (task->stack->is_suspended()) make_ready(task.get()); // Preempted or yielded
+                            else {
+                                task->state = Task::State::FINISHED;
+                                tasks.erase(task.get());
+                            }
+                        }
+                        if (task->stack->is_panicked()) {
+                            const auto &msg = (*task->stack)[-1];
+                            stack.panic("task panicked: " +
+                                        (msg.type == Type::STR ? std::string(msg.data.str->bytes) : "?"));
+                        }
+                    }
+                }
+                // Only parked tasks are left, and no task is able to wake them up anymore
+                while (!tasks.empty()) {
+                    auto task = MemoryManager::AutoPtr(*tasks.begin());
+                    tasks.erase(task.get());
+                    task->state = Task::State::CANCELLED;
+                    task->stack->cancel();
+                }
+            }
+
+            ~EventLoop() override {
+                close(timer_fd);
+                close(epoll_fd);
+            }
+        };
+
+        static EventLoop &get_loop(const MemoryManager::AutoPtr<Allocation> &ptr) {
+            return *dynamic_cast<EventLoop *>(ptr.get());
+        }
+
+        static Task &get_task(const MemoryManager::AutoPtr<Allocation> &ptr) {
+            return *dynamic_cast<Task *>(ptr.get());
+        }
+
+        void loop_create(VM::Stack &stack) {
+            std::function fn([&stack]() -> MemoryManager::AutoPtr<Allocation> {
+                return stack.vm.mem.gc_new_auto<EventLoop>(stack.vm);
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void loop_spawn(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<Allocation> loop,
+                                      MemoryManager::AutoPtr<VM::Function> start,
+                                      fint priority) -> MemoryManager::AutoPtr<Allocation> {
+                return get_loop(loop).spawn(stack, start.get(), priority);
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void loop_set_time_slice(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<Allocation> loop, fint instructions) {
+                if (instructions < 0) stack.panic("invalid time slice");
+                get_loop(loop).set_time_slice(size_t(instructions));
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void loop_sleep(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<Allocation> loop, fint ms) {
+                get_loop(loop).sleep(stack, ms);
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void loop_yield(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<Allocation> loop) {
+                get_loop(loop).yield(stack);
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void loop_park(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<Allocation> loop) {
+                get_loop(loop).park(stack);
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void loop_wake(VM::Stack &stack) {
+            std::function fn([](MemoryManager::AutoPtr<Allocation> loop,
+                                MemoryManager::AutoPtr<Allocation> task) -> fbln {
+                return get_loop(loop).wake(&get_task(task));
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void loop_run(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<Allocation> loop) {
+                get_loop(loop).run(stack);
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void loop_read(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<Allocation> loop, fint fd,
+                                      MemoryManager::AutoPtr<Allocation> data, fint beg, fint end) -> fint {
+                char *bytes = dynamic_cast<ArrayAllocation<char> *>(data.get())->data();
+                while (true) {
+                    auto cnt = read(int(fd), bytes + beg, size_t(end - beg));
+                    if (cnt >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) return fint(cnt);
+                    get_loop(loop).wait_fd(stack, int(fd), false);
+                }
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void loop_write(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<Allocation> loop, fint fd,
+                                      MemoryManager::AutoPtr<Allocation> data, fint beg, fint end) -> fint {
+                char *bytes = dynamic_cast<ArrayAllocation<char> *>(data.get())->data();
+                while (true) {
+                    auto cnt = write(int(fd), bytes + beg, size_t(end - beg));
+                    if (cnt >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) return fint(cnt);
+                    get_loop(loop).wait_fd(stack, int(fd), true);
+                }
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void task_is_finished(VM::Stack &stack) {
+            std::function fn([](MemoryManager::AutoPtr<Allocation> task) -> fbln {
+                return get_task(task).state == Task::State::FINISHED;
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void task_is_cancelled(VM::Stack &stack) {
+            std::function fn([](MemoryManager::AutoPtr<Allocation> task) -> fbln {
+                return get_task(task).state == Task::State::CANCELLED;
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void task_get_cpu_time(VM::Stack &stack) {
+            std::function fn([](MemoryManager::AutoPtr<Allocation> task) -> fint {
+                return fint(get_task(task).stack->get_cpu_time() / 1000);
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void task_get_switches(VM::Stack &stack) {
+            std::function fn([](MemoryManager::AutoPtr<Allocation> task) -> fint {
+                return fint(get_task(task).stack->get_switches());
+            });
+            util::call_native_function(stack, fn);
+        }
+    }
+
+    namespace channels {
+
+        /**
+         * Handle of a channel which is shared between all the VMs of the process.
+         */
+        class ChannelHandle final : public Allocation {
+            void get_refs(const std::function<void(Allocation *)> &callback) override {}
+
+        public:
+            const std::shared_ptr<Channel> channel;
+
+            ChannelHandle(VM &vm, std::shared_ptr<Channel> channel) : Allocation(vm), channel(std::move(channel)) {}
+        };
+
+        static std::mutex registry_mutex;
+        static std::map<std::string, std::weak_ptr<Channel>> registry; // Named channels of the process.
+
+        static Channel &get_channel(VM::Stack &stack, VM::Stack::pos_t pos) {
+            const auto &val = stack[pos];
+            auto *handle = val.type == Type::PTR ? dynamic_cast<ChannelHandle *>(val.data.ptr) : nullptr;
+            if (!handle) stack.panic("channel expected");
+            return *handle->channel;
+        }
+
+        void channel_open(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<VM::String> name, fint capacity)
+                                     -> MemoryManager::AutoPtr<Allocation> {
+                if (capacity <= 0) stack.panic("invalid channel capacity");
+                std::lock_guard lock(registry_mutex);
+                auto &entry = registry[std::string(name->bytes)];
+                auto channel = entry.lock();
+                if (!channel) entry = channel = std::make_shared<Channel>(size_t(capacity));
+                return stack.vm.mem.gc_new_auto<ChannelHandle>(stack.vm, channel);
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        static std::unique_ptr<TransferBuffer> pack_message(VM::Stack &stack) {
+            VM::Stack::pos_t beg = stack.find_sep() + 2;
+            try {
+                const auto *values = stack.get_values().data();
+                return std::make_unique<TransferBuffer>(TransferBuffer::pack(values + beg, values + stack.size()));
+            } catch (const TransferError &err) {
+                stack.panic(err.what());
+            }
+        }
+
+        void channel_send(VM::Stack &stack) {
+            Channel &channel = get_channel(stack, stack.find_sep() + 1);
+            auto msg = pack_message(stack);
+            while (true) {
+                auto seen = channel.get_events();
+                if (channel.is_closed()) stack.panic("channel is closed");
+                if (channel.try_send(msg)) break;
+                channel.wait(seen);
+            }
+            stack.pop(stack.find_sep());
+        }
+
+        void channel_try_send(VM::Stack &stack) {
+            Channel &channel = get_channel(stack, stack.find_sep() + 1);
+            auto msg = pack_message(stack);
+            stack.pop(stack.find_sep());
+            stack.push_bln(channel.try_send(msg));
+        }
+
+        static void unpack_message(VM::Stack &stack, std::unique_ptr<TransferBuffer> msg) {
+            stack.pop(stack.find_sep());
+            if (!msg) {
+                stack.push_bln(false);
+                stack.push_arr(stack.vm.mem.gc_new_auto<VM::Array>(stack.vm, 0).get());
+                return;
+            }
+            stack.push_bln(true);
+            VM::Stack::pos_t beg = stack.size();
+            msg->unpack(stack);
+            auto values = stack.vm.mem.gc_new_auto<VM::Array>(
+                    stack.vm, const_cast<VM::Value *>(stack.get_values().data() + beg), size_t(stack.size() - beg)
+            );
+            stack.pop(beg);
+            stack.push_arr(values.get());
+        }
+
+        void channel_receive(VM::Stack &stack) {
+            Channel &channel = get_channel(stack, -1);
+            while (true) {
+                auto seen = channel.get_events();
+                if (auto msg = channel.try_receive()) return unpack_message(stack, std::move(msg));
+                if (channel.is_closed()) return unpack_message(stack, nullptr);
+                channel.wait(seen);
+            }
+        }
+
+        void channel_try_receive(VM::Stack &stack) {
+            Channel &channel = get_channel(stack, -1);
+            unpack_message(stack, channel.try_receive());
+        }
+
+        void channel_close(VM::Stack &stack) {
+            get_channel(stack, -1).close();
+            stack.pop(stack.find_sep());
+        }
+    }
+
+    namespace parallel {
+
+        /**
+         * Single parallel map or reduce operation split into chunks.
+         */
+        struct Job {
+            enum class Kind {
+                MAP, // Each chunk is transformed into an array of results.
+                REDUCE // Each chunk is folded into a single value.
+            };
+
+            const Kind kind;
+            const std::string fn_src; // Source of the function expression.
+            std::vector<TransferBuffer> chunks; // Input chunks, replaced with results when processed.
+            std::optional<std::string> error; // The first error encountered by workers.
+            size_t remaining;
+            std::mutex mutex;
+            std::condition_variable done;
+
+            Job(Kind kind, std::string fn_src, size_t chunks_cnt) :
+                    kind(kind), fn_src(std::move(fn_src)), chunks(chunks_cnt), remaining(chunks_cnt) {}
+
+            void finish_chunk(std::optional<std::string> chunk_error) {
+                std::lock_guard lock(mutex);
+                if (chunk_error && !error) error = std::move(chunk_error);
+                if (!--remaining) done.notify_all();
+            }
+        };
+
+        /**
+         * Pool of worker threads, each running its own VM. Every worker owns a deque of chunks: it takes chunks from
+         * the back of its own deque and steals chunks from the front of other deques when it runs out of work.
+         */
+        class WorkerPool {
+            struct Chunk {
+                Job *job;
+                size_t index;
+            };
+
+            class Worker {
+                DefaultAllocator allocator;
+                VM vm;
+                MemoryManager::AutoPtr<VM::Scope> scope;
+
+                MemoryManager::AutoPtr<VM::Function> get_function(const std::string &src) {
+                    // Bytecode is kept in the compilation cache of the worker's VM, which bounds the amount of sources
+                    MemoryManager::AutoPtr<VM::Function> expr(nullptr);
+                    try {
+                        expr = util::compile_fn(vm, nullptr, scope.get(), "<parallel>", src, true);
+                    } catch (const CompilationError &err) {
+                        throw TransferError("compilation error: " + std::string(err.what()));
+                    }
+                    expr->assign_name(FStr("<parallel>", vm.mem.str_alloc()));
+                    auto stack = util::eval_fn(vm, expr.get());
+                    if (stack->is_panicked()) throw TransferError(std::string((*stack)[-1].data.str->bytes));
+                    if (stack->size() != 1 || (*stack)[0].type != Type::FUN) {
+                        throw TransferError("single function expected");
+                    }
+                    return MemoryManager::AutoPtr((*stack)[0].data.fun);
+                }
+
+                VM::Value call(VM::Function *fn, const VM::Value *args, size_t cnt,
+                               MemoryManager::AutoPtr<VM::Stack> &stack) {
+                    stack = vm.mem.gc_new_auto<VM::Stack>(vm, fn);
+                    stack->push_sep();
+                    for (size_t pos = 0; pos < cnt; pos++) stack->push(args[pos]);
+                    stack->execute();
+                    if (stack->is_panicked()) throw TransferError(std::string((*stack)[-1].data.str->bytes));
+                    if (stack->size() != 1) throw TransferError("function must return a single value");
+                    return (*stack)[0];
+                }
+
+            public:
+                explicit Worker(const VM::Config &config) :
+                        vm({.mm{.allocator = &allocator},
+                            .stack_values_max = config.stack_values_max,
+                            .stack_frames_max = config.stack_frames_max,
+                            .compile_cache_size = config.compile_cache_size}),
+                        scope(vm.mem.gc_new_auto<VM::Scope>(vm.mem.gc_new_auto<VM::Object>(vm).get(), nullptr)) {}
+
+                void process(Job &job, TransferBuffer &chunk) {
+                    auto fn = get_function(job.fn_src);
+                    auto input = vm.mem.gc_new_auto<VM::Stack>(vm);
+                    chunk.unpack(*input);
+                    const VM::Value *values = &(*input)[0];
+                    size_t cnt = input->size();
+                    MemoryManager::AutoPtr<VM::Stack> stack(nullptr);
+                    if (job.kind == Job::Kind::MAP) {
+                        auto results = vm.mem.gc_new_auto<VM::Array>(vm, cnt);
+                        for (size_t pos = 0; pos < cnt; pos++) (*results)[pos] = call(fn.get(), values + pos, 1, stack);
+                        VM::Value result(Type::ARR, {.arr = results.get()});
+                        chunk = TransferBuffer::pack(&result, &result + 1);
+                    } else {
+                        auto acc = vm.mem.gc_new_auto<VM::Stack>(vm);
+                        acc->push(values[0]);
+                        for (size_t pos = 1; pos < cnt; pos++) {
+                            VM::Value args[2] = {(*acc)[0], values[pos]};
+                            auto result = call(fn.get(), args, 2, stack);
+                            acc->pop(0);
+                            acc->push(result);
+                        }
+                        chunk = TransferBuffer::pack(&(*acc)[0], &(*acc)[0] + 1);
+                    }
+                }
+            };
+
+            std::mutex mutex;
+            std::condition_variable work_available;
+            std::vector<std::deque<Chunk>> deques; // Chunks of every worker (guarded by the mutex).
+            size_t pending = 0; // Total amount of chunks in all deques.
+
+            std::optional<Chunk> take(size_t id) {
+                if (!deques[id].empty()) {
+                    auto chunk = deques[id].back();
+                    deques[id].pop_back();
+                    return chunk;
+                }
+                for (size_t off = 1; off < deques.size(); off++) {
+                    auto &victim = deques[(id + off) % deques.size()];
+                    if (victim.empty()) continue;
+                    auto chunk = victim.front();
+                    victim.pop_front();
+                    return chunk;
+                }
+                return std::nullopt;
+            }
+
+            void run_worker(size_t id, const VM::Config &config) {
+                Worker worker(config);
+                while (true) {
+                    Chunk chunk{};
+                    {
+                        std::unique_lock lock(mutex);
+                        work_available.wait(lock, [this]() { return pending != 0; });
+                        chunk = take(id).value();
+                        pending--;
+                    }
+                    std::optional<std::string> error;
+                    try {
+                        worker.process(*chunk.job, chunk.job->chunks[chunk.index]);
+                    } catch (const TransferError &err) {
+                        error = err.what();
+                    } catch (const VM::StackOverflowError &) {
+                        error = "stack overflow";
+                    } catch (const OutOfMemoryError &) {
+                        error = "out of memory";
+                    }
+                    chunk.job->finish_chunk(std::move(error));
+                }
+            }
+
+        public:
+            explicit WorkerPool(const VM::Config &config) : deques(std::max(std::thread::hardware_concurrency(), 1u)) {
+                for (size_t id = 0; id < deques.size(); id++) {
+                    std::thread([this, id, config]() { run_worker(id, config); }).detach();
+                }
+            }
+
+            void execute(Job &job) {
+                {
+                    std::lock_guard lock(mutex);
+                    for (size_t index = 0; index < job.chunks.size(); index++) {
+                        deques[index % deques.size()].push_back({&job, index});
+                    }
+                    pending += job.chunks.size();
+                }
+                work_available.notify_all();
+                std::unique_lock lock(job.mutex);
+                job.done.wait(lock, [&job]() { return job.remaining == 0; });
+            }
+        };
+
+        /**
+         * Returns the worker pool whose VMs have the same stack limits and compilation cache size as the specified VM.
+         * A pool is started on the first job with such limits, its workers are detached and live until the process
+         * exits.
+         */
+        static WorkerPool &get_pool(VM &vm) {
+            using Limits = std::tuple<size_t, size_t, size_t>;
+            static std::mutex mutex;
+            static std::map<Limits, WorkerPool *> pools;
+            Limits limits(vm.config.stack_values_max, vm.config.stack_frames_max, vm.config.compile_cache_size);
+            std::lock_guard lock(mutex);
+            auto &pool = pools[limits];
+            if (!pool) pool = new WorkerPool(vm.config);
+            return *pool;
+        }
+
+        static std::unique_ptr<Job> run_job(VM::Stack &stack, Job::Kind kind, const VM::Array &arr, const FStr &fn_src,
+                                            fint chunk_size) {
+            if (chunk_size <= 0) stack.panic("invalid chunk size");
+            size_t chunks_cnt = (arr.len() + chunk_size - 1) / chunk_size;
+            auto job = std::make_unique<Job>(kind, std::string(fn_src), chunks_cnt);
+            try {
+                for (size_t index = 0; index < chunks_cnt; index++) {
+                    const auto *beg = arr.begin() + index * chunk_size;
+                    job->chunks[index] = TransferBuffer::pack(beg, std::min(beg + chunk_size, arr.end()));
+                }
+            } catch (const TransferError &err) {
+                stack.panic(err.what());
+            }
+            if (chunks_cnt) get_pool(stack.vm).execute(*job);
+            if (job->error) stack.panic(job->error.value());
+            return job;
+        }
+
+        void map(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<VM::Array> arr, MemoryManager::AutoPtr<VM::String> fn_src,
+                                      fint chunk_size) -> MemoryManager::AutoPtr<VM::Array> {
+                auto job = run_job(stack, Job::Kind::MAP, *arr, fn_src->bytes, chunk_size);
+                auto result = stack.vm.mem.gc_new_auto<VM::Array>(stack.vm, arr->len());
+                size_t pos = 0;
+                for (const auto &chunk : job->chunks) {
+                    chunk.unpack(stack);
+                    for (const auto &val : *stack[-1].data.arr) (*result)[pos++] = val;
+                    stack.pop();
+                }
+                return result;
+            });
+            util::call_native_function(stack, fn);
+        }
+
+        void reduce(VM::Stack &stack) {
+            std::function fn([&stack](MemoryManager::AutoPtr<VM::Array> arr, MemoryManager::AutoPtr<VM::String> fn_src,
+                                      fint chunk_size) -> void {
+                if (arr->len() == 0) stack.panic("cannot reduce an empty array");
+                // Partial results are reduced again until a single value remains
+                while (arr->len() != 1) {
+                    auto job = run_job(stack, Job::Kind::REDUCE, *arr, fn_src->bytes, std::max(chunk_size, fint(2)));
+                    auto partials = stack.vm.mem.gc_new_auto<VM::Array>(stack.vm, job->chunks.size());
+                    for (size_t pos = 0; pos < job->chunks.size(); pos++) {
+                        job->chunks[pos].unpack(stack);
+                        (*partials)[pos] = stack[-1];
+                        stack.pop();
+                    }
+                    arr = std::move(partials);
+                }
+                stack.push((*arr)[0]); // The result is left on the stack
+            });
+            util::call_native_function(stack, fn);
+        }
+    }
+
+    namespace {
+
+        // The registration table of the module, names of the functions match their usage in the source modules.
+        const native_entry_t NATIVES[] = {
+            {"lang.is_object", lang::is_object},
+            {"lang.is_integer", lang::is_integer},
+            {"lang.is_string", lang::is_string},
+            {"lang.is_array", lang::is_array},
+            {"lang.is_boolean", lang::is_boolean},
+            {"lang.is_float", lang::is_float},
+            {"lang.is_function", lang::is_function},
+            {"lang.is_pointer", lang::is_pointer},
+            {"lang.int_to_str", lang::int_to_str},
+            {"lang.flp_to_str", lang::flp_to_str},
+            {"lang.fun_to_str", lang::fun_to_str},
+            {"lang.ptr_to_str", lang::ptr_to_str},
+            {"lang.str_to_str", lang::str_to_str},
+            {"lang.native.panic", lang::panic},
+            {"lang.native.module", lang::module_},
+            {"lang.native.submodule", lang::submodule},
+            {"lang.native.import", lang::import_},
+            {"lang.native.bytes_allocate", lang::bytes_allocate},
+            {"lang.native.bytes_paste_from_string", lang::bytes_paste_from_string},
+            {"lang.native.bytes_paste_from_bytes", lang::bytes_paste_from_bytes},
+            {"lang.native.bytes_find_string", lang::bytes_find_string},
+            {"lang.native.bytes_to_string", lang::bytes_to_string},
+            {"lang.native.concat", lang::concat},
+            {"lang.native.compile_expr", lang::compile_expr},
+            {"lang.native.load_data", lang::load_data},
+            {"lang.native.serialize", lang::serialize},
+            {"lang.native.typed_allocate", lang::typed_allocate},
+            {"lang.native.typed_from_array", lang::typed_from_array},
+            {"lang.native.typed_to_array", lang::typed_to_array},
+            {"lang.native.typed_get_elem_type", lang::typed_get_elem_type},
+            {"lang.native.typed_add", lang::typed_add},
+            {"lang.native.typed_mul", lang::typed_mul},
+            {"lang.native.typed_less", lang::typed_less},
+            {"lang.native.typed_equal", lang::typed_equal},
+            {"lang.native.typed_sum", lang::typed_sum},
+            {"lang.native.typed_min", lang::typed_min},
+            {"lang.native.typed_max", lang::typed_max},
+            {"lang.native.typed_dot", lang::typed_dot},
+            {"lang.native.typed_fill", lang::typed_fill},
+            {"lang.native.typed_scale", lang::typed_scale},
+            {"lang.native.deserialize", lang::deserialize},
+            {"lang.native.string_is_suffix", lang::string_is_suffix},
+            {"lang.native.freeze", lang::freeze},
+            {"lang.native.is_frozen", lang::is_frozen},
+            {"sys.get_errno", sys::posix_get_errno},
+            {"sys.write", sys::posix_write},
+            {"sys.read", sys::posix_read},
+            {"sys.write_values", sys::posix_write_values},
+            {"sys.read_values", sys::posix_read_values},
+            {"sys.strerror", sys::posix_strerror},
+            {"sys.set_nonblocking", sys::posix_set_nonblocking},
+            {"coroutines.stack_create", coroutines::stack_create},
+            {"coroutines.stack_execute", coroutines::stack_execute},
+            {"coroutines.stack_generate_stack_trace", coroutines::stack_generate_stack_trace},
+            {"coroutines.stack_is_panicked", coroutines::stack_is_panicked},
+            {"coroutines.stack_top", coroutines::stack_top},
+            {"coroutines.stack_push_sep", coroutines::stack_push_sep},
+            {"events.loop_create", events::loop_create},
+            {"events.loop_spawn", events::loop_spawn},
+            {"events.loop_sleep", events::loop_sleep},
+            {"events.loop_set_time_slice", events::loop_set_time_slice},
+            {"events.loop_yield", events::loop_yield},
+            {"events.loop_park", events::loop_park},
+            {"events.loop_wake", events::loop_wake},
+            {"events.loop_run", events::loop_run},
+            {"events.loop_read", events::loop_read},
+            {"events.loop_write", events::loop_write},
+            {"events.task_is_finished", events::task_is_finished},
+            {"events.task_is_cancelled", events::task_is_cancelled},
+            {"events.task_get_cpu_time", events::task_get_cpu_time},
+            {"events.task_get_switches", events::task_get_switches},
+            {"channels.channel_open", channels::channel_open},
+            {"channels.channel_send", channels::channel_send},
+            {"channels.channel_try_send", channels::channel_try_send},
+            {"channels.channel_receive", channels::channel_receive},
+            {"channels.channel_try_receive", channels::channel_try_receive},
+            {"channels.channel_close", channels::channel_close},
+            {"parallel.map", parallel::map},
+            {"parallel.reduce", parallel::reduce},
+        };
+
+        const native_module_t NATIVE_MODULE = {NATIVES, std::size(NATIVES)};
+    }
+}
+
+extern "C" const funscript::native_module_t *funscript_native_module() {
+    return &funscript::stdlib::NATIVE_MODULE;
+}
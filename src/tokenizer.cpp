@@ -108,7 +108,7 @@ namespace funscript {
                                       get_hex_digit(filename, loc, token_str[pos + 3]));
                         result += c;
                         pos += 4;
-                    }
+                    } else throw CompilationError(filename, loc, "invalid escape sequence");
                 } else result += token_str[pos++];
             }
             return {Token::STRING, result};
@@ -161,9 +161,10 @@ namespace funscript {
         return {Token::UNKNOWN};
     }
 
-    void tokenize(const std::string &filename, const std::string &code, const std::function<void(Token)> &cb) {
+    void tokenize(const std::string &filename, const std::string &code, const std::function<void(Token)> &cb,
+                  code_pos_t start) {
         size_t left = 0; // Position of leftmost character of current token
-        code_pos_t left_pos = {1, 1};
+        code_pos_t left_pos = start;
         // Skip whitespaces at the beginning
         while (left < code.length() && isspace(code[left])) {
             if (code[left] == '\n') left_pos = {left_pos.row + 1, 1};
@@ -0,0 +1,138 @@
+#include "tracer.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace funscript {
+
+    namespace {
+
+        struct buffer_cache_t {
+            uint64_t tracer_id = 0;
+            void *buffer = nullptr;
+        };
+
+        thread_local buffer_cache_t buffer_cache; // The buffer of the last tracer used by the current thread.
+
+        std::string describe(VM::Function *fun) {
+            std::string name = fun->get_name().has_value() ? std::string(fun->display()) : "function";
+            if (auto *bytecode_fun = dynamic_cast<VM::BytecodeFunction *>(fun)) {
+                auto loc = bytecode_fun->get_location();
+                if (loc.filename) name += std::string(" at ") + loc.filename + ':' + loc.position.to_string();
+            }
+            return name;
+        }
+    }
+
+    Tracer::Tracer(std::optional<uint64_t> call_threshold) : call_threshold(call_threshold), id(now()) {}
+
+    uint64_t Tracer::now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    Tracer::thread_buffer_t &Tracer::get_buffer() {
+        if (buffer_cache.tracer_id == id) return *static_cast<thread_buffer_t *>(buffer_cache.buffer);
+        long tid = syscall(SYS_gettid);
+        std::lock_guard lock(mutex);
+        thread_buffer_t *buffer = nullptr;
+        for (auto &buf : buffers) {
+            if (buf->tid == tid) buffer = buf.get();
+        }
+        if (!buffer) buffer = buffers.emplace_back(new thread_buffer_t{.tid = tid}).get();
+        buffer_cache = {.tracer_id = id, .buffer = buffer};
+        return *buffer;
+    }
+
+    void Tracer::attach(VM &vm) {
+        std::lock_guard lock(mutex);
+        if (vms.contains(&vm)) return;
+        if (call_threshold && vm.call_hook) throw std::runtime_error("function calls are already instrumented");
+        auto prev_gc_stats_hook = vm.mem.gc_stats_hook;
+        vms[&vm] = {.prev_call_hook = vm.call_hook, .prev_gc_stats_hook = prev_gc_stats_hook};
+        vm.tracer = this;
+        if (call_threshold) vm.call_hook = this;
+        vm.mem.gc_stats_hook = [this, prev_gc_stats_hook](const MemoryManager::gc_stats_t &stats) -> void {
+            record("gc", "mark", stats.beg_time, stats.mark_end_time);
+            record("gc", "sweep", stats.mark_end_time, stats.end_time);
+            record("gc", "gc_cycle", stats.beg_time, stats.end_time,
+                   "{\"freed_allocs\": " + std::to_string(stats.freed_allocs) +
+                   ", \"freed_bytes\": " + std::to_string(stats.freed_bytes) + "}");
+            if (prev_gc_stats_hook) prev_gc_stats_hook(stats);
+        };
+    }
+
+    void Tracer::detach(VM &vm) {
+        std::lock_guard lock(mutex);
+        auto it = vms.find(&vm);
+        if (it == vms.end()) return;
+        vm.tracer = nullptr;
+        if (call_threshold) vm.call_hook = it->second.prev_call_hook;
+        vm.mem.gc_stats_hook = it->second.prev_gc_stats_hook;
+        vms.erase(it);
+    }
+
+    void Tracer::record(const char *cat, std::string name, uint64_t beg, uint64_t end, std::string args) {
+        get_buffer().events.push_back({std::move(name), cat, beg, end - beg, std::move(args)});
+    }
+
+    void Tracer::enter(VM::Stack &stack, VM::Function *fun) {
+        get_buffer().calls[&stack].push_back({fun, now()});
+    }
+
+    void Tracer::leave(VM::Stack &stack, VM::Function *fun) {
+        uint64_t end = now();
+        auto &buffer = get_buffer();
+        auto it = buffer.calls.find(&stack);
+        if (it == buffer.calls.end()) return; // The call started before the tracer was attached
+        uint64_t beg = it->second.back().beg;
+        it->second.pop_back();
+        if (it->second.empty()) buffer.calls.erase(it);
+        if (end - beg >= *call_threshold) buffer.events.push_back({describe(fun), "call", beg, end - beg, ""});
+    }
+
+    std::string Tracer::escape(const std::string &str) {
+        std::string res;
+        for (char ch : str) {
+            if (ch == '"' || ch == '\\') {
+                res += '\\';
+                res += ch;
+            } else if (uint8_t(ch) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof buf, "\\u%04x", ch);
+                res += buf;
+            } else {
+                res += ch;
+            }
+        }
+        return res;
+    }
+
+    void Tracer::write_json(std::ostream &out) const {
+        std::lock_guard lock(mutex);
+        auto pid = getpid();
+        out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+        bool first = true;
+        for (const auto &buffer : buffers) {
+            for (const auto &event : buffer->events) {
+                if (!first) out << ',';
+                first = false;
+                char times[64];
+                std::snprintf(times, sizeof times, "\"ts\": %.3f, \"dur\": %.3f", double(event.beg) / 1000,
+                              double(event.dur) / 1000);
+                out << "\n{\"name\": \"" << escape(event.name) << "\", \"cat\": \"" << event.cat
+                    << "\", \"ph\": \"X\", " << times << ", \"pid\": " << pid << ", \"tid\": " << buffer->tid;
+                if (!event.args.empty()) out << ", \"args\": " << event.args;
+                out << '}';
+            }
+        }
+        out << "\n]}\n";
+    }
+
+    Tracer::~Tracer() {
+        while (!vms.empty()) detach(*vms.begin()->first);
+    }
+}
@@ -0,0 +1,683 @@
+#include "transfer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace funscript {
+
+    namespace {
+
+        /**
+         * Counts the nesting depth of the value being processed by a recursive function, so that deeply nested values
+         * are reported by the error instead of exhausting the native stack.
+         */
+        template<typename Error, size_t MAX_DEPTH>
+        class DepthGuard {
+            size_t &depth;
+        public:
+            explicit DepthGuard(size_t &depth) : depth(depth) {
+                if (++depth > MAX_DEPTH) {
+                    depth--;
+                    throw Error("values are nested too deeply");
+                }
+            }
+
+            ~DepthGuard() {
+                depth--;
+            }
+        };
+
+        // Maximum nesting depth of transferred values. Unpacking only reads packed values, so it is bounded as well.
+        constexpr size_t TRANSFER_MAX_DEPTH = 10000;
+
+        enum class Tag : uint8_t {
+            INT, FLP, BLN, STR, ARR, OBJ, BYTES,
+            REF, // Reference to an already transferred allocation
+            FROZEN // Reference to a frozen allocation, which is shared instead of being copied
+        };
+
+        class Packer {
+            std::string &out;
+            std::unordered_map<Allocation *, uint64_t> seen; // Transferred allocations and their indices.
+            size_t depth = 0; // Nesting depth of the value being packed.
+
+            template<typename T>
+            void put(const T &val) {
+                out.append(reinterpret_cast<const char *>(&val), sizeof(val));
+            }
+
+            void put_tag(Tag tag) {
+                put(uint8_t(tag));
+            }
+
+            bool put_ref(Allocation *alloc) {
+                auto [it, inserted] = seen.insert({alloc, seen.size()});
+                if (inserted) return false;
+                put_tag(Tag::REF);
+                put(it->second);
+                return true;
+            }
+
+            void put_str(const FStr &str) {
+                put(uint64_t(str.size()));
+                out.append(str.data(), str.size());
+            }
+
+        public:
+            explicit Packer(std::string &out) : out(out) {}
+
+            void put_value(const VM::Value &val) { // NOLINT(misc-no-recursion)
+                DepthGuard<TransferError, TRANSFER_MAX_DEPTH> guard(depth);
+                if (val.type != Type::FUN) {
+                    bool frozen = false;
+                    val.get_ref([&frozen](Allocation *alloc) -> void { frozen = alloc->is_frozen(); });
+                    if (frozen) {
+                        put_tag(Tag::FROZEN);
+                        put(val);
+                        return;
+                    }
+                }
+                switch (val.type) {
+                    case Type::INT:
+                        put_tag(Tag::INT);
+                        put(val.data.num);
+                        break;
+                    case Type::FLP:
+                        put_tag(Tag::FLP);
+                        put(val.data.flp);
+                        break;
+                    case Type::BLN:
+                        put_tag(Tag::BLN);
+                        put(uint8_t(val.data.bln));
+                        break;
+                    case Type::STR:
+                        if (put_ref(val.data.str)) break;
+                        put_tag(Tag::STR);
+                        put_str(val.data.str->bytes);
+                        break;
+                    case Type::ARR: {
+                        if (put_ref(val.data.arr)) break;
+                        put_tag(Tag::ARR);
+                        put(uint64_t(val.data.arr->len()));
+                        for (const auto &elem : *val.data.arr) put_value(elem);
+                        break;
+                    }
+                    case Type::OBJ: {
+                        if (put_ref(val.data.obj)) break;
+                        put_tag(Tag::OBJ);
+                        const auto &values = val.data.obj->get_values();
+                        put(uint64_t(values.size()));
+                        for (const auto &elem : values) put_value(elem);
+                        const auto &fields = val.data.obj->get_fields();
+                        put(uint64_t(fields.size()));
+                        for (const auto &[key, field] : fields) {
+                            put_str(key);
+                            put_value(field);
+                        }
+                        break;
+                    }
+                    case Type::PTR: {
+                        auto *bytes = dynamic_cast<ArrayAllocation<char> *>(val.data.ptr);
+                        if (!bytes) throw TransferError("pointers cannot be transferred");
+                        if (put_ref(bytes)) break;
+                        put_tag(Tag::BYTES);
+                        put(uint64_t(bytes->size()));
+                        out.append(bytes->data(), bytes->size());
+                        break;
+                    }
+                    case Type::FUN:
+                        throw TransferError("functions cannot be transferred");
+                    default:
+                        throw TransferError("value cannot be transferred");
+                }
+            }
+        };
+
+        class Unpacker {
+            VM &vm;
+            const char *pos;
+            std::vector<MemoryManager::AutoPtr<Allocation>> allocs; // Materialized allocations by their indices.
+
+            template<typename T>
+            T get() {
+                T val;
+                std::memcpy(&val, pos, sizeof(val));
+                pos += sizeof(val);
+                return val;
+            }
+
+            FStr get_str() {
+                auto len = get<uint64_t>();
+                FStr str(pos, len, vm.mem.str_alloc());
+                pos += len;
+                return str;
+            }
+
+            template<typename A>
+            A *remember(MemoryManager::AutoPtr<A> &&alloc) {
+                A *ptr = alloc.get();
+                allocs.emplace_back(std::move(alloc));
+                return ptr;
+            }
+
+        public:
+            Unpacker(VM &vm, const char *pos) : vm(vm), pos(pos) {}
+
+            VM::Value get_value() {
+                switch (get<Tag>()) {
+                    case Tag::INT:
+                        return {Type::INT, {.num = get<fint>()}};
+                    case Tag::FLP:
+                        return {Type::FLP, {.flp = get<fflp>()}};
+                    case Tag::BLN:
+                        return {Type::BLN, {.bln = get<uint8_t>() != 0}};
+                    case Tag::STR:
+                        return {Type::STR, {.str = remember(vm.mem.gc_new_auto<VM::String>(vm, get_str()))}};
+                    case Tag::ARR: {
+                        auto len = get<uint64_t>();
+                        auto *arr = remember(vm.mem.gc_new_auto<VM::Array>(vm, len));
+                        for (size_t i = 0; i < len; i++) (*arr)[i] = get_value();
+                        return {Type::ARR, {.arr = arr}};
+                    }
+                    case Tag::OBJ: {
+                        auto *obj = remember(vm.mem.gc_new_auto<VM::Object>(vm));
+                        auto len = get<uint64_t>();
+                        FVec<VM::Value> values(vm.mem.std_alloc<VM::Value>());
+                        values.reserve(len);
+                        for (size_t i = 0; i < len; i++) values.push_back(get_value());
+                        obj->init_values(values.data(), values.data() + values.size());
+                        len = get<uint64_t>();
+                        for (size_t i = 0; i < len; i++) {
+                            auto key = get_str();
+                            obj->set_field(key, get_value());
+                        }
+                        return {Type::OBJ, {.obj = obj}};
+                    }
+                    case Tag::BYTES: {
+                        auto len = get<uint64_t>();
+                        auto *bytes = remember(vm.mem.gc_new_auto_arr(vm, len, char(0)));
+                        std::memcpy(bytes->data(), pos, len);
+                        pos += len;
+                        return {Type::PTR, {.ptr = bytes}};
+                    }
+                    case Tag::FROZEN:
+                        return get<VM::Value>();
+                    case Tag::REF: {
+                        auto *alloc = allocs.at(get<uint64_t>()).get();
+                        if (auto *str = dynamic_cast<VM::String *>(alloc)) return {Type::STR, {.str = str}};
+                        if (auto *arr = dynamic_cast<VM::Array *>(alloc)) return {Type::ARR, {.arr = arr}};
+                        if (auto *obj = dynamic_cast<VM::Object *>(alloc)) return {Type::OBJ, {.obj = obj}};
+                        return {Type::PTR, {.ptr = alloc}};
+                    }
+                }
+                assertion_failed("invalid transfer buffer");
+            }
+        };
+
+    }
+
+    TransferBuffer TransferBuffer::pack(const VM::Value *beg, const VM::Value *end) {
+        TransferBuffer buf;
+        Packer packer(buf.data);
+        uint64_t cnt = end - beg;
+        buf.data.append(reinterpret_cast<const char *>(&cnt), sizeof(cnt));
+        for (const auto *val = beg; val != end; val++) packer.put_value(*val);
+        return buf;
+    }
+
+    void TransferBuffer::unpack(VM::Stack &stack) const {
+        Unpacker unpacker(stack.vm, data.data() + sizeof(uint64_t));
+        uint64_t cnt;
+        std::memcpy(&cnt, data.data(), sizeof(cnt));
+        for (uint64_t i = 0; i < cnt; i++) stack.push(unpacker.get_value());
+    }
+
+    size_t TransferBuffer::size() const {
+        return data.size();
+    }
+
+    namespace {
+
+        enum class SerialTag : uint8_t {
+            INT, FLP, FALSE, TRUE, STR, ARR, OBJ, BYTES,
+            REF // Reference to an already written allocation of the message
+        };
+
+        // Every message begins with the magic bytes and the version of the format.
+        constexpr std::string_view SERIAL_MAGIC("FSV\x01", 4);
+
+        // Maximum nesting depth of serialized values, so that reading malformed input cannot exhaust the native stack.
+        constexpr size_t SERIAL_MAX_DEPTH = 10000;
+
+        using SerialDepthGuard = DepthGuard<SerializationError, SERIAL_MAX_DEPTH>;
+
+        uint64_t zigzag_encode(fint num) {
+            return (uint64_t(num) << 1) ^ uint64_t(num >> 63);
+        }
+
+        fint zigzag_decode(uint64_t num) {
+            return fint(num >> 1) ^ -fint(num & 1);
+        }
+
+        size_t ref_hash(Allocation *alloc) {
+            return (reinterpret_cast<uintptr_t>(alloc) * 0x9e3779b97f4a7c15) >> 7; // Low bits of pointers are zeros
+        }
+    }
+
+    Serializer::Serializer(Sink sink, size_t chunk_size) : sink(std::move(sink)), chunk_size(chunk_size) {}
+
+    bool Serializer::put_ref(Allocation *alloc) {
+        if (2 * (seen_cnt + 1) > seen.size()) { // The load factor is kept below 1/2
+            std::vector<std::pair<Allocation *, uint64_t>> old(std::max(size_t(64), 2 * seen.size()));
+            old.swap(seen);
+            for (const auto &entry : old) {
+                if (!entry.first) continue;
+                size_t pos = ref_hash(entry.first);
+                while (seen[pos & (seen.size() - 1)].first) pos++;
+                seen[pos & (seen.size() - 1)] = entry;
+            }
+        }
+        size_t pos = ref_hash(alloc);
+        while (true) {
+            auto &entry = seen[pos & (seen.size() - 1)];
+            if (!entry.first) {
+                entry = {alloc, seen_cnt++};
+                return false;
+            }
+            if (entry.first == alloc) break;
+            pos++;
+        }
+        buf += char(SerialTag::REF);
+        put_varint(seen[pos & (seen.size() - 1)].second);
+        return true;
+    }
+
+    void Serializer::put_varint(uint64_t num) {
+        char bytes[10];
+        size_t len = 0;
+        while (num >= 0x80) {
+            bytes[len++] = char(num | 0x80);
+            num >>= 7;
+        }
+        bytes[len++] = char(num);
+        buf.append(bytes, len);
+    }
+
+    void Serializer::put_bytes(const char *data, size_t len) {
+        if (sink && len >= chunk_size) { // Large arrays of bytes are passed to the sink as is
+            flush();
+            sink(data, len);
+            return;
+        }
+        buf.append(data, len);
+    }
+
+    void Serializer::put_value(const VM::Value &val) { // NOLINT(misc-no-recursion)
+        if (sink && buf.size() >= chunk_size) flush();
+        SerialDepthGuard guard(depth);
+        auto put_tag = [this](SerialTag tag) -> void { buf += char(tag); };
+        switch (val.type) {
+            case Type::INT:
+                put_tag(SerialTag::INT);
+                put_varint(zigzag_encode(val.data.num));
+                break;
+            case Type::FLP: {
+                put_tag(SerialTag::FLP);
+                auto bits = std::bit_cast<uint64_t>(val.data.flp);
+                char bytes[8];
+                for (size_t pos = 0; pos < 8; pos++) bytes[pos] = char(bits >> (pos * 8)); // Little-endian
+                buf.append(bytes, 8);
+                break;
+            }
+            case Type::BLN:
+                put_tag(val.data.bln ? SerialTag::TRUE : SerialTag::FALSE);
+                break;
+            case Type::STR:
+                if (put_ref(val.data.str)) break;
+                put_tag(SerialTag::STR);
+                put_varint(val.data.str->bytes.size());
+                put_bytes(val.data.str->bytes.data(), val.data.str->bytes.size());
+                break;
+            case Type::ARR:
+                if (put_ref(val.data.arr)) break;
+                put_tag(SerialTag::ARR);
+                put_varint(val.data.arr->len());
+                for (const auto &elem : *val.data.arr) put_value(elem);
+                break;
+            case Type::OBJ: {
+                if (put_ref(val.data.obj)) break;
+                put_tag(SerialTag::OBJ);
+                const auto &values = val.data.obj->get_values();
+                put_varint(values.size());
+                for (const auto &elem : values) put_value(elem);
+                const auto &fields = val.data.obj->get_fields();
+                put_varint(fields.size());
+                for (const auto &[key, field] : fields) {
+                    // New names are written with their length (even numbers), known ones with their index (odd)
+                    auto [it, inserted] = keys.insert({std::string_view(key), keys.size()});
+                    if (inserted) {
+                        put_varint(uint64_t(key.size()) << 1);
+                        put_bytes(key.data(), key.size());
+                    } else put_varint((it->second << 1) | 1);
+                    put_value(field);
+                }
+                break;
+            }
+            case Type::PTR: {
+                auto *bytes = dynamic_cast<ArrayAllocation<char> *>(val.data.ptr);
+                if (!bytes) throw SerializationError("pointers cannot be serialized");
+                if (put_ref(bytes)) break;
+                put_tag(SerialTag::BYTES);
+                put_varint(bytes->size());
+                put_bytes(bytes->data(), bytes->size());
+                break;
+            }
+            case Type::FUN:
+                throw SerializationError("functions cannot be serialized");
+            default:
+                throw SerializationError("value cannot be serialized");
+        }
+    }
+
+    void Serializer::write(const VM::Value *beg, const VM::Value *end) {
+        size_t start = buf.size();
+        try {
+            buf.append(SERIAL_MAGIC);
+            put_varint(end - beg);
+            for (const auto *val = beg; val != end; val++) put_value(*val);
+        } catch (...) {
+            seen.clear();
+            seen_cnt = 0;
+            keys.clear();
+            if (!sink) buf.resize(start); // The partial message is discarded unless it has been passed to the sink
+            throw;
+        }
+        seen.clear();
+        seen_cnt = 0;
+        keys.clear();
+        if (sink) flush();
+    }
+
+    void Serializer::flush() {
+        if (!sink || buf.empty()) return;
+        sink(buf.data(), buf.size());
+        buf.clear();
+    }
+
+    const std::string &Serializer::get_buffer() const {
+        return buf;
+    }
+
+    Deserializer::Deserializer(std::string_view data) : chunk_size(0), pos(data.data()), end(data.data() + data.size()) {}
+
+    Deserializer::Deserializer(Source source, size_t chunk_size) : source(std::move(source)), chunk_size(chunk_size),
+                                                                   pos(nullptr), end(nullptr) {}
+
+    bool Deserializer::fill(size_t len) {
+        auto avail = size_t(end - pos);
+        if (avail >= len) return true;
+        if (!source) return false;
+        // Move the unread part to the beginning of the buffer and read the source until there is enough data
+        if (avail) std::memmove(buf.data(), pos, avail);
+        buf.resize(std::max(buf.size(), chunk_size));
+        size_t size = avail;
+        while (size < len) {
+            // The buffer grows with the read data, so that a malformed length cannot make it allocated up front
+            if (size == buf.size()) buf.resize(2 * size);
+            size_t cnt = source(buf.data() + size, buf.size() - size);
+            if (!cnt) break;
+            size += cnt;
+        }
+        pos = buf.data();
+        end = pos + size;
+        return size >= len;
+    }
+
+    void Deserializer::require(size_t len) {
+        if (!fill(len)) throw SerializationError("unexpected end of serialized data");
+    }
+
+    uint8_t Deserializer::get_byte() {
+        if (pos == end) require(1);
+        return uint8_t(*pos++);
+    }
+
+    uint64_t Deserializer::get_varint() {
+        uint64_t num = 0;
+        for (size_t shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = get_byte();
+            num |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                if (shift == 63 && byte > 1) break; // The number does not fit into 64 bits
+                return num;
+            }
+        }
+        throw SerializationError("invalid serialized data");
+    }
+
+    uint64_t Deserializer::get_len() {
+        auto len = get_varint();
+        // Every element takes at least one byte, so the data is read up to the length before anything is allocated for
+        // the elements. Thus a malformed length is reported as the end of the data instead of exhausting the memory
+        require(len);
+        return len;
+    }
+
+    void Deserializer::get_bytes(char *data, size_t len) {
+        while (len) {
+            if (pos == end) require(1);
+            size_t cnt = std::min(len, size_t(end - pos));
+            std::memcpy(data, pos, cnt);
+            data += cnt;
+            pos += cnt;
+            len -= cnt;
+        }
+    }
+
+    FStr Deserializer::get_str(VM &vm, size_t len) {
+        require(len);
+        FStr str(pos, len, vm.mem.str_alloc());
+        pos += len;
+        return str;
+    }
+
+    VM::Value Deserializer::get_value(VM &vm) { // NOLINT(misc-no-recursion)
+        auto remember = [this](auto &&alloc, VM::Value val) -> void {
+            refs.push_back(val);
+            allocs.emplace_back(std::move(alloc));
+        };
+        SerialDepthGuard guard(depth);
+        switch (SerialTag(get_byte())) {
+            case SerialTag::INT:
+                return {Type::INT, {.num = zigzag_decode(get_varint())}};
+            case SerialTag::FLP: {
+                require(8);
+                uint64_t bits = 0;
+                for (size_t byte = 0; byte < 8; byte++) bits |= uint64_t(uint8_t(pos[byte])) << (byte * 8);
+                pos += 8;
+                return {Type::FLP, {.flp = std::bit_cast<fflp>(bits)}};
+            }
+            case SerialTag::FALSE:
+                return {Type::BLN, {.bln = false}};
+            case SerialTag::TRUE:
+                return {Type::BLN, {.bln = true}};
+            case SerialTag::STR: {
+                auto str = vm.mem.gc_new_auto<VM::String>(vm, get_str(vm, get_len()));
+                VM::Value val{Type::STR, {.str = str.get()}};
+                remember(std::move(str), val);
+                return val;
+            }
+            case SerialTag::ARR: {
+                auto len = get_len();
+                auto arr = vm.mem.gc_new_auto<VM::Array>(vm, len);
+                auto *arr_ptr = arr.get();
+                remember(std::move(arr), {Type::ARR, {.arr = arr_ptr}});
+                for (size_t elem = 0; elem < len; elem++) (*arr_ptr)[elem] = get_value(vm);
+                return {Type::ARR, {.arr = arr_ptr}};
+            }
+            case SerialTag::OBJ: {
+                auto obj = vm.mem.gc_new_auto<VM::Object>(vm);
+                auto *obj_ptr = obj.get();
+                remember(std::move(obj), {Type::OBJ, {.obj = obj_ptr}});
+                auto len = get_len();
+                FVec<VM::Value> values(vm.mem.std_alloc<VM::Value>());
+                values.reserve(len);
+                for (size_t elem = 0; elem < len; elem++) values.push_back(get_value(vm));
+                obj_ptr->init_values(values.data(), values.data() + values.size());
+                len = get_len();
+                for (size_t field = 0; field < len; field++) {
+                    auto key = get_varint();
+                    size_t key_pos = key >> 1;
+                    if (!(key & 1)) {
+                        keys.push_back(get_str(vm, key_pos));
+                        key_pos = keys.size() - 1;
+                    } else if (key_pos >= keys.size()) throw SerializationError("invalid serialized data");
+                    auto val = get_value(vm);
+                    obj_ptr->set_field(keys[key_pos], val);
+                }
+                return {Type::OBJ, {.obj = obj_ptr}};
+            }
+            case SerialTag::BYTES: {
+                auto len = get_len();
+                auto bytes = vm.mem.gc_new_auto_arr(vm, len, char(0));
+                get_bytes(bytes->data(), len);
+                VM::Value val{Type::PTR, {.ptr = bytes.get()}};
+                remember(std::move(bytes), val);
+                return val;
+            }
+            case SerialTag::REF: {
+                auto ref = get_varint();
+                if (ref >= refs.size()) throw SerializationError("invalid serialized data");
+                return refs[ref];
+            }
+            default:
+                throw SerializationError("invalid serialized data");
+        }
+    }
+
+    bool Deserializer::read(VM::Stack &stack) {
+        if (!fill(1)) return false;
+        require(SERIAL_MAGIC.size());
+        if (std::string_view(pos, SERIAL_MAGIC.size()) != SERIAL_MAGIC) {
+            throw SerializationError("invalid serialized data");
+        }
+        pos += SERIAL_MAGIC.size();
+        auto base = stack.size();
+        try {
+            auto cnt = get_len();
+            for (uint64_t val = 0; val < cnt; val++) stack.push(get_value(stack.vm));
+        } catch (...) {
+            if (stack.size() > base) stack.pop(base);
+            refs.clear();
+            allocs.clear();
+            keys.clear();
+            throw;
+        }
+        refs.clear();
+        allocs.clear();
+        keys.clear();
+        return true;
+    }
+
+    Channel::Channel(size_t capacity) : mask(std::bit_ceil(std::max(capacity, size_t(2))) - 1),
+                                        cells(new Cell[mask + 1]) {
+        for (size_t pos = 0; pos <= mask; pos++) cells[pos].seq.store(pos, std::memory_order_relaxed);
+    }
+
+    void Channel::notify() {
+        events.fetch_add(1, std::memory_order_release);
+        events.notify_all();
+    }
+
+    bool Channel::try_send(std::unique_ptr<TransferBuffer> &msg) {
+        if (closed.load(std::memory_order_acquire)) return false;
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.msg = msg.release();
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    notify();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // The channel is full
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::unique_ptr<TransferBuffer> Channel::try_receive() {
+        size_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = intptr_t(seq) - intptr_t(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    std::unique_ptr<TransferBuffer> msg(cell.msg);
+                    cell.seq.store(pos + mask + 1, std::memory_order_release);
+                    notify();
+                    return msg;
+                }
+            } else if (diff < 0) {
+                return nullptr; // The channel is empty
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Channel::wait(uint32_t seen) const {
+        events.wait(seen, std::memory_order_acquire);
+    }
+
+    uint32_t Channel::get_events() const {
+        return events.load(std::memory_order_acquire);
+    }
+
+    void Channel::close() {
+        closed.store(true, std::memory_order_release);
+        notify();
+    }
+
+    bool Channel::is_closed() const {
+        return closed.load(std::memory_order_acquire);
+    }
+
+    Channel::~Channel() {
+        while (try_receive());
+    }
+
+    void *FrozenHeap::SharedAllocator::allocate(size_t size) {
+        void *ptr = std::malloc(size);
+        if (!ptr) throw OutOfMemoryError();
+        return ptr;
+    }
+
+    void FrozenHeap::SharedAllocator::free(void *ptr, size_t size) noexcept {
+        std::free(ptr);
+    }
+
+    FrozenHeap::FrozenHeap() : vm({.mm{.allocator = &allocator}}) {}
+
+    VM::Value FrozenHeap::freeze(const VM::Value &val) {
+        bool frozen = true;
+        val.get_ref([&frozen](Allocation *alloc) -> void { frozen = alloc->is_frozen(); });
+        if (frozen) return val;
+        auto buf = TransferBuffer::pack(&val, &val + 1);
+        std::lock_guard lock(mutex);
+        auto stack = vm.mem.gc_new_auto<VM::Stack>(vm);
+        buf.unpack(*stack);
+        VM::Value result = (*stack)[-1];
+        result.get_ref([this](Allocation *alloc) -> void { vm.mem.gc_freeze(alloc); });
+        return result;
+    }
+}
@@ -1,14 +1,128 @@
 #include "vm.hpp"
+#include "ast.hpp"
+#include "tracer.hpp"
 
 #include <queue>
 #include <utility>
 #include <sstream>
+#include <fstream>
 #include <cstring>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/common_interface_defs.h>
+#endif
 
 namespace funscript {
 
+#ifdef FUNSCRIPT_EXEC_STATS
+
+    struct VM::ExecStats {
+        static constexpr size_t OPCODES_CNT = size_t(Opcode::LAZ) + 1;
+        static constexpr size_t OPERATORS_CNT = size_t(Operator::SIZEOF) + 1;
+        static constexpr size_t OPERANDS_CNT = size_t(Type::PTR) + 3; // Value types, no values and multiple values
+        static constexpr size_t NO_OPCODE = OPCODES_CNT;
+
+        uint64_t opcodes[OPCODES_CNT]{};
+        uint64_t pairs[OPCODES_CNT][OPCODES_CNT]{};
+        uint64_t triples[OPCODES_CNT][OPCODES_CNT][OPCODES_CNT]{};
+        uint64_t operators[OPERATORS_CNT][OPERANDS_CNT][OPERANDS_CNT]{};
+
+        /**
+         * Counts an executed instruction together with the sequences it ends.
+         * @param op The opcode of the instruction.
+         * @param last Opcodes of the two previous instructions in the same function call (`NO_OPCODE` if none).
+         */
+        void count_instruction(Opcode op, size_t (&last)[2]) {
+            auto cur = size_t(op);
+            opcodes[cur]++;
+            if (last[1] != NO_OPCODE) pairs[last[1]][cur]++;
+            if (last[0] != NO_OPCODE) triples[last[0]][last[1]][cur]++;
+            last[0] = last[1];
+            last[1] = cur;
+        }
+
+        static size_t operand_kind(const Stack &stack, Stack::pos_t pos, Stack::pos_t cnt) {
+            if (cnt == 0) return OPERANDS_CNT - 2;
+            if (cnt > 1) return OPERANDS_CNT - 1;
+            return size_t(stack[pos].type);
+        }
+
+        static const char *operand_kind_name(size_t kind) {
+            static const char *NAMES[OPERANDS_CNT] = {"sep", "int", "obj", "fun", "bln", "str", "arr", "flp", "ptr",
+                                                      "none", "pack"};
+            return NAMES[kind];
+        }
+
+        static const char *operator_name(size_t op) {
+            static const char *NAMES[OPERATORS_CNT] = {
+                    "TIMES", "DIVIDE", "PLUS", "MINUS", "ASSIGN", "APPEND", "DISCARD", "CALL", "LAMBDA", "INDEX",
+                    "MODULO", "EQUALS", "DIFFERS", "NOT", "LESS", "GREATER", "LESS_EQUAL", "GREATER_EQUAL", "THEN",
+                    "ELSE", "UNTIL", "REPEATS", "AND", "OR", "IS", "EXTRACT", "CHECK", "HAS", "BW_AND", "BW_OR",
+                    "BW_XOR", "BW_SHL", "BW_SHR", "BW_NOT", "SIZEOF"
+            };
+            return NAMES[op];
+        }
+
+        /**
+         * Writes all the non-zero counters as `kind,item,count` rows.
+         */
+        void write_csv(std::ostream &out) const {
+            auto name = [](size_t op) -> const char * { return get_opcode_name(Opcode(op)); };
+            out << "kind,item,count\n";
+            for (size_t a = 0; a < OPCODES_CNT; a++) {
+                if (opcodes[a]) out << "opcode," << name(a) << ',' << opcodes[a] << '\n';
+            }
+            for (size_t a = 0; a < OPCODES_CNT; a++) {
+                for (size_t b = 0; b < OPCODES_CNT; b++) {
+                    if (pairs[a][b]) out << "pair," << name(a) << ' ' << name(b) << ',' << pairs[a][b] << '\n';
+                }
+            }
+            for (size_t a = 0; a < OPCODES_CNT; a++) {
+                for (size_t b = 0; b < OPCODES_CNT; b++) {
+                    for (size_t c = 0; c < OPCODES_CNT; c++) {
+                        if (!triples[a][b][c]) continue;
+                        out << "triple," << name(a) << ' ' << name(b) << ' ' << name(c) << ','
+                            << triples[a][b][c] << '\n';
+                    }
+                }
+            }
+            for (size_t op = 0; op < OPERATORS_CNT; op++) {
+                for (size_t a = 0; a < OPERANDS_CNT; a++) {
+                    for (size_t b = 0; b < OPERANDS_CNT; b++) {
+                        if (!operators[op][a][b]) continue;
+                        out << "operator," << operator_name(op) << ' ' << operand_kind_name(a) << ' '
+                            << operand_kind_name(b) << ',' << operators[op][a][b] << '\n';
+                    }
+                }
+            }
+        }
+    };
+
+#endif
+
     VM::VM(VM::Config config) : config(config), mem(config.mm),
-                                modules(mem.std_alloc<decltype(modules)::value_type>()) {}
+                                modules(mem.std_alloc<decltype(modules)::value_type>()),
+                                suspended_stacks(mem.std_alloc<Stack *>()),
+                                compile_cache(mem.std_alloc<compile_cache_entry_t>()),
+                                compile_cache_index(mem.std_alloc<decltype(compile_cache_index)::value_type>()) {
+#ifdef FUNSCRIPT_EXEC_STATS
+        if (config.exec_stats_path) exec_stats = new ExecStats();
+#endif
+    }
+
+    VM::~VM() {
+        // Suspended stacks pin allocations from their native stacks, so they have to be unwound first
+        while (!suspended_stacks.empty()) (*suspended_stacks.begin())->cancel();
+#ifdef FUNSCRIPT_EXEC_STATS
+        if (exec_stats) {
+            std::ofstream out(config.exec_stats_path);
+            exec_stats->write_csv(out);
+            delete exec_stats;
+        }
+#endif
+    }
 
     void VM::register_module(const funscript::FStr &name, funscript::VM::Module *mod) {
         modules.insert({name, MemoryManager::AutoPtr(mod)});
@@ -19,6 +133,39 @@ namespace funscript {
         return modules.at(name).get();
     }
 
+    VM::Bytecode *VM::find_compiled(const std::string &filename, const std::string &src) {
+        FStr key(filename, mem.str_alloc());
+        key += '\0'; // Filenames never contain zero bytes
+        key += src;
+        auto it = compile_cache_index.find(key);
+        if (it == compile_cache_index.end()) {
+            compile_cache_stats.misses++;
+            return nullptr;
+        }
+        compile_cache_stats.hits++;
+        compile_cache.splice(compile_cache.begin(), compile_cache, it->second);
+        return it->second->second.get();
+    }
+
+    void VM::cache_compiled(const std::string &filename, const std::string &src, VM::Bytecode *bytecode) {
+        if (config.compile_cache_size == 0) return;
+        FStr key(filename, mem.str_alloc());
+        key += '\0';
+        key += src;
+        if (compile_cache_index.contains(key)) return;
+        if (compile_cache.size() == config.compile_cache_size) {
+            compile_cache_index.erase(compile_cache.back().first);
+            compile_cache.pop_back();
+            compile_cache_stats.evictions++;
+        }
+        compile_cache.emplace_front(std::move(key), MemoryManager::AutoPtr(bytecode));
+        compile_cache_index.insert({compile_cache.front().first, compile_cache.begin()});
+    }
+
+    const VM::compile_cache_stats_t &VM::get_compile_cache_stats() const {
+        return compile_cache_stats;
+    }
+
     void VM::Stack::get_refs(const std::function<void(Allocation *)> &callback) {
         for (const auto &val : values) val.get_ref(callback);
         callback(cur_frame);
@@ -39,6 +186,10 @@ namespace funscript {
         return values[pos];
     }
 
+    std::span<const VM::Value> VM::Stack::get_values() const {
+        return {values.data(), values.size()};
+    }
+
     void VM::Stack::push_sep() { return push({Type::SEP}); }
 
     void VM::Stack::push_int(fint num) { return push({Type::INT, {.num = num}}); }
@@ -93,17 +244,24 @@ namespace funscript {
         auto cur_scope = MemoryManager::AutoPtr(scope);
         const char *meta_chunk = nullptr;
         code_met_t meta{.filename = nullptr, .position = {0, 0}, .scope = nullptr};
+#ifdef FUNSCRIPT_EXEC_STATS
+        size_t last_ops[2] = {ExecStats::NO_OPCODE, ExecStats::NO_OPCODE};
+#endif
         try {
             while (true) {
                 if (kbd_int) {
                     kbd_int = 0;
-                    panic("keyboard interrupt");
+                    return raise_panic("keyboard interrupt");
                 }
                 Instruction ins = *ip;
+                slice_left--;
                 if (meta_chunk && ins.meta) {
                     meta.position = *reinterpret_cast<const code_pos_t *>(meta_chunk + ins.meta);
                     meta.scope = cur_scope.get();
                 }
+#ifdef FUNSCRIPT_EXEC_STATS
+                if (vm.exec_stats) vm.exec_stats->count_instruction(ins.op, last_ops);
+#endif
                 switch (ins.op) {
                     case Opcode::NOP:
                         ip++;
@@ -131,6 +289,13 @@ namespace funscript {
                         ip++;
                         break;
                     }
+                    case Opcode::LAZ: {
+                        auto fun = vm.mem.gc_new_auto<BytecodeFunction>(vm, mod, cur_scope.get(), bytecode_obj,
+                                                                        size_t(ins.u64), true);
+                        push_fun(fun.get());
+                        ip++;
+                        break;
+                    }
                     case Opcode::OBJ: {
                         cur_scope->vars->init_values(values.data() + find_sep() + 1, values.data() + size());
                         pop(find_sep());
@@ -154,12 +319,12 @@ namespace funscript {
                     }
                     case Opcode::IND: {
                         if (get(-1).type != Type::OBJ || get(-2).type != Type::SEP) {
-                            panic("single object expected");
+                            return raise_panic("single object expected");
                         }
                         auto obj = MemoryManager::AutoPtr(get(-1).data.obj);
                         pop(-2);
                         if (obj->get_values().size() <= ins.u64) {
-                            panic("object index out of range");
+                            return raise_panic("object index out of range");
                         }
                         push(obj->get_values()[ins.u64]);
                         ip++;
@@ -172,12 +337,12 @@ namespace funscript {
                             push_bln(cur_scope->vars->get_field(name).has_value());
                         } else {
                             if (get(-1).type != Type::OBJ) {
-                                panic("only objects are able to be indexed");
+                                return raise_panic("only objects are able to be indexed");
                             }
                             auto obj = MemoryManager::AutoPtr(get(-1).data.obj);
                             pop();
                             if (get(-1).type != Type::SEP) {
-                                panic("can't index multiple values");
+                                return raise_panic("can't index multiple values");
                             }
                             pop();
                             push_bln(obj->get_field(name).has_value());
@@ -191,22 +356,22 @@ namespace funscript {
                             pop();
                             auto var = cur_scope->vars->get_field(name);
                             if (!var.has_value()) {
-                                panic("no such field: '" + std::string(name) + "'");
+                                return raise_panic("no such field: '" + std::string(name) + "'");
                             }
                             push(var.value());
                         } else {
                             if (get(-1).type != Type::OBJ) {
-                                panic("only objects are able to be indexed");
+                                return raise_panic("only objects are able to be indexed");
                             }
                             auto obj = MemoryManager::AutoPtr(get(-1).data.obj);
                             pop();
                             if (get(-1).type != Type::SEP) {
-                                panic("can't index multiple values");
+                                return raise_panic("can't index multiple values");
                             }
                             pop();
                             auto field = obj->get_field(name);
                             if (!field.has_value()) {
-                                panic("no such field: '" + std::string(name) + "'");
+                                return raise_panic("no such field: '" + std::string(name) + "'");
                             }
                             push(field.value());
                         }
@@ -217,24 +382,26 @@ namespace funscript {
                         FStr name(reinterpret_cast<const FStr::value_type *>(bytecode + ins.u64), vm.mem.str_alloc());
                         if (get(-1).type == Type::SEP) {
                             pop();
-                            if (get(-1).type == Type::SEP) panic("not enough values");
+                            if (get(-1).type == Type::SEP) return raise_panic("not enough values");
                             if (get(-1).type == Type::FUN && !get(-1).data.fun->get_name().has_value()) {
                                 get(-1).data.fun->assign_name(name);
                             }
+                            if (cur_scope->vars->is_frozen()) return raise_panic("object is frozen");
                             cur_scope->vars->set_field(name, get(-1));
                             pop();
                         } else {
                             if (get(-1).type != Type::OBJ) {
-                                panic("only objects are able to be indexed");
+                                return raise_panic("only objects are able to be indexed");
                             }
                             auto obj = MemoryManager::AutoPtr(get(-1).data.obj);
                             pop();
-                            if (get(-1).type != Type::SEP) return panic("can't index multiple values");
+                            if (get(-1).type != Type::SEP) return raise_panic("can't index multiple values");
                             pop();
-                            if (get(-1).type == Type::SEP) return panic("not enough values");
+                            if (get(-1).type == Type::SEP) return raise_panic("not enough values");
                             if (get(-1).type == Type::FUN && !get(-1).data.fun->get_name().has_value()) {
                                 get(-1).data.fun->assign_name(name);
                             }
+                            if (obj->is_frozen()) return raise_panic("object is frozen");
                             obj->set_field(name, get(-1));
                             pop();
                         }
@@ -245,7 +412,7 @@ namespace funscript {
                         FStr name(reinterpret_cast<const FStr::value_type *>(bytecode + ins.u64), vm.mem.str_alloc());
                         auto var = cur_scope->get_var(name);
                         if (!var.has_value()) {
-                            panic("no such variable: '" + std::string(name) + "'");
+                            return raise_panic("no such variable: '" + std::string(name) + "'");
                         }
                         push(var.value());
                         ip++;
@@ -253,10 +420,11 @@ namespace funscript {
                     }
                     case Opcode::VST: {
                         FStr name(reinterpret_cast<const FStr::value_type *>(bytecode + ins.u64), vm.mem.str_alloc());
-                        if (get(-1).type == Type::SEP) return panic("not enough values");
-                        if (!cur_scope->set_var(name, get(-1))) {
-                            panic("no such variable: '" + std::string(name) + "'");
-                        }
+                        if (get(-1).type == Type::SEP) return raise_panic("not enough values");
+                        auto *vars = cur_scope->find_var(name);
+                        if (!vars) return raise_panic("no such variable: '" + std::string(name) + "'");
+                        if (vars->is_frozen()) return raise_panic("variable is frozen: '" + std::string(name) + "'");
+                        vars->set_field(name, get(-1));
                         if (get(-1).type == Type::FUN && !get(-1).data.fun->get_name().has_value()) {
                             get(-1).data.fun->assign_name(name);
                         }
@@ -276,7 +444,7 @@ namespace funscript {
                     }
                     case Opcode::OSC: {
                         if (get(-1).type != Type::OBJ || get(-2).type != Type::SEP) {
-                            panic("single object expected");
+                            return raise_panic("single object expected");
                         }
                         cur_scope = vm.mem.gc_new_auto<Scope>(get(-1).data.obj, cur_scope.get());
                         pop(-2);
@@ -284,7 +452,7 @@ namespace funscript {
                         break;
                     }
                     case Opcode::DIS: {
-                        if (discard() && ins.u16) panic("too many values");
+                        if (discard() && ins.u16) return raise_panic("too many values");
                         ip++;
                         break;
                     }
@@ -296,6 +464,7 @@ namespace funscript {
                     case Opcode::OPR: {
                         auto op = static_cast<Operator>(ins.u16);
                         call_operator(op);
+                        if (panicked) [[unlikely]] return;
                         ip++;
                         break;
                     }
@@ -304,24 +473,34 @@ namespace funscript {
                     }
                     case Opcode::JNO: {
                         if (get(-1).type != Type::BLN || get(-2).type != Type::SEP) {
-                            panic("single boolean expected");
+                            return raise_panic("single boolean expected");
                         }
-                        if (!get(-1).data.bln) ip = reinterpret_cast<const Instruction *>(bytecode + ins.u64);
-                        else ip++;
+                        bool jump = !get(-1).data.bln;
                         pop(-2);
+                        if (jump) {
+                            const auto *target = reinterpret_cast<const Instruction *>(bytecode + ins.u64);
+                            if (target < ip) safe_point();
+                            ip = target;
+                        } else ip++;
                         break;
                     }
                     case Opcode::JYS: {
                         if (get(-1).type != Type::BLN || get(-2).type != Type::SEP) {
-                            panic("single boolean expected");
+                            return raise_panic("single boolean expected");
                         }
-                        if (get(-1).data.bln) ip = reinterpret_cast<const Instruction *>(bytecode + ins.u64);
-                        else ip++;
+                        bool jump = get(-1).data.bln;
                         pop(-2);
+                        if (jump) {
+                            const auto *target = reinterpret_cast<const Instruction *>(bytecode + ins.u64);
+                            if (target < ip) safe_point();
+                            ip = target;
+                        } else ip++;
                         break;
                     }
                     case Opcode::JMP: {
-                        ip = reinterpret_cast<const Instruction *>(bytecode + ins.u64);
+                        const auto *target = reinterpret_cast<const Instruction *>(bytecode + ins.u64);
+                        if (target < ip) safe_point();
+                        ip = target;
                         break;
                     }
                     case Opcode::STR: {
@@ -343,6 +522,7 @@ namespace funscript {
                     }
                     case Opcode::MOV: {
                         call_assignment();
+                        if (panicked) [[unlikely]] return;
                         ip++;
                         break;
                     }
@@ -357,10 +537,10 @@ namespace funscript {
                         break;
                     }
                     case Opcode::EXT: {
-                        if (get(-1).type != Type::OBJ) panic("object expected");
+                        if (get(-1).type != Type::OBJ) return raise_panic("object expected");
                         auto obj = MemoryManager::AutoPtr(get(-1).data.obj);
                         pop();
-                        if (get(-1).type != Type::SEP) panic("too many values");
+                        if (get(-1).type != Type::SEP) return raise_panic("too many values");
                         pop();
                         bool is_err = obj->contains_field(ERR_FLAG_NAME);
                         if (ins.u64) {
@@ -391,17 +571,20 @@ namespace funscript {
                     case Opcode::CHK: {
                         pos_t i = find_sep() + 1, j = find_sep(i - 1) + 1;
                         size_t cnt_i = size() - i, cnt_j = i - 1 - j;
-                        if (cnt_j < cnt_i) panic("not enough values");
-                        if (cnt_j > cnt_i && !ins.u16) panic("too many values");
+                        if (cnt_j < cnt_i) return raise_panic("not enough values");
+                        if (cnt_j > cnt_i && !ins.u16) return raise_panic("too many values");
                         j = pos_t(i - 1 - cnt_i);
                         for (; i < size(); i++, j++) {
-                            if (get(i).type != Type::OBJ) panic("type must be an object");
+                            if (get(i).type != Type::OBJ) return raise_panic("type must be an object");
                             Value fn_val = get(i).data.obj->get_field(TYPE_CHECK_NAME).value_or(Type::INT);
-                            if (fn_val.type != Type::FUN) panic("type object does not provide typecheck function");
+                            if (fn_val.type != Type::FUN) {
+                                return raise_panic("type object does not provide typecheck function");
+                            }
                             push_sep();
                             push_sep();
                             push(get(j));
                             call_function(fn_val.data.fun);
+                            if (panicked) [[unlikely]] return;
                             discard();
                         }
                         discard();
@@ -413,10 +596,10 @@ namespace funscript {
         } catch (const OutOfMemoryError &e) {
             pop(frame_start);
             scope = nullptr;
-            panic("out of memory");
+            return raise_panic("out of memory");
         } catch (const StackOverflowError &e) {
             pop(frame_start);
-            panic("stack overflow");
+            return raise_panic("stack overflow");
         }
     }
 
@@ -424,6 +607,12 @@ namespace funscript {
         // Calculate stack positions of operands and their lengths
         pos_t pos_a = find_sep() + 1, pos_b = find_sep(pos_a - 1) + 1;
         pos_t cnt_a = size() - pos_a, cnt_b = pos_a - pos_b - 1;
+#ifdef FUNSCRIPT_EXEC_STATS
+        if (vm.exec_stats) {
+            vm.exec_stats->operators[size_t(op)][ExecStats::operand_kind(*this, pos_a, cnt_a)]
+            [ExecStats::operand_kind(*this, pos_b, cnt_b)]++;
+        }
+#endif
         switch (op) {
             case Operator::TIMES: {
                 if (cnt_a == 1 && cnt_b == 1 && get(pos_a).type == Type::INT && get(pos_b).type == Type::INT) {
@@ -489,7 +678,7 @@ namespace funscript {
             case Operator::DIVIDE: {
                 if (cnt_a == 1 && cnt_b == 1 && get(pos_a).type == Type::INT && get(pos_b).type == Type::INT) {
                     fint a = get(pos_a).data.num, b = get(pos_b).data.num;
-                    if (b == 0) panic("division by zero");
+                    if (b == 0) return raise_panic("division by zero");
                     pop(-4);
                     push_int(a / b);
                     break;
@@ -683,12 +872,26 @@ namespace funscript {
                     pos_t beg = size();
                     for (const auto &val : *ind) {
                         if (val.type != Type::INT || val.data.num < 0 || arr->len() <= val.data.num) {
-                            panic("invalid array index");
+                            return raise_panic("invalid array index");
                         }
                         push((*arr)[val.data.num]);
                     }
                     break;
                 }
+                if (cnt_a == 1 && cnt_b == 1 && get(pos_a).type == Type::PTR && get(pos_b).type == Type::ARR) {
+                    auto *arr = dynamic_cast<TypedArray *>(get(pos_a).data.ptr);
+                    if (!arr) return op_panic(op);
+                    MemoryManager::AutoPtr<TypedArray> arr_ptr(arr);
+                    MemoryManager::AutoPtr<Array> ind(get(pos_b).data.arr);
+                    pop(-4);
+                    for (const auto &val : *ind) {
+                        if (val.type != Type::INT || val.data.num < 0 || arr->len() <= val.data.num) {
+                            return raise_panic("invalid array index");
+                        }
+                        push(arr->get(val.data.num));
+                    }
+                    break;
+                }
                 if (cnt_a == 1 && get(pos_a).type == Type::FUN) {
                     auto fn = MemoryManager::AutoPtr(get(pos_a).data.fun);
                     pop(-2);
@@ -762,7 +965,10 @@ namespace funscript {
                         push_sep();
                         push(obj_a->get_values()[pos]);
                         call_operator(Operator::EQUALS);
-                        if (get(-1).type != Type::BLN || get(-2).type != Type::SEP) panic("boolean expected");
+                        if (panicked) [[unlikely]] return;
+                        if (get(-1).type != Type::BLN || get(-2).type != Type::SEP) {
+                            return raise_panic("boolean expected");
+                        }
                         fbln result = get(-1).data.bln;
                         pop(-2);
                         if (!result) {
@@ -781,7 +987,10 @@ namespace funscript {
                         push_sep();
                         push(val);
                         call_operator(Operator::EQUALS);
-                        if (get(-1).type != Type::BLN || get(-2).type != Type::SEP) panic("boolean expected");
+                        if (panicked) [[unlikely]] return;
+                        if (get(-1).type != Type::BLN || get(-2).type != Type::SEP) {
+                            return raise_panic("boolean expected");
+                        }
                         fbln result = get(-1).data.bln;
                         pop(-2);
                         if (!result) {
@@ -955,6 +1164,14 @@ namespace funscript {
                     }
                     break;
                 }
+                if (cnt_a == 0 && cnt_b == 1 && get(pos_b).type == Type::PTR) {
+                    auto *arr = dynamic_cast<TypedArray *>(get(pos_b).data.ptr);
+                    if (!arr) return op_panic(op);
+                    fint size = fint(arr->len());
+                    pop(-3);
+                    push_int(size);
+                    break;
+                }
                 if (cnt_a == 0 && cnt_b == 1 && get(pos_b).type == Type::STR) {
                     fint size = fint(get(pos_b).data.str->bytes.size());
                     pop(-3);
@@ -975,6 +1192,7 @@ namespace funscript {
         if (cnt_a == 1 && cnt_b == 1 && get(pos_a).type == Type::ARR && get(pos_b).type == Type::ARR) {
             Array &arr = *get(pos_a).data.arr;
             Array &ind = *get(pos_b).data.arr;
+            if (arr.is_frozen()) return raise_panic("array is frozen");
             vm.mem.gc_pin(&arr);
             vm.mem.gc_pin(&ind);
             pop(-4);
@@ -983,12 +1201,12 @@ namespace funscript {
                 if (val.type != Type::INT || val.data.num < 0 || arr.len() <= val.data.num) {
                     vm.mem.gc_unpin(&arr);
                     vm.mem.gc_unpin(&ind);
-                    panic("invalid array index");
+                    return raise_panic("invalid array index");
                 }
                 if (get(-1).type == Type::SEP) {
                     vm.mem.gc_unpin(&arr);
                     vm.mem.gc_unpin(&ind);
-                    panic("not enough values");
+                    return raise_panic("not enough values");
                 }
                 arr[val.data.num] = get(-1);
                 pop();
@@ -997,21 +1215,265 @@ namespace funscript {
             vm.mem.gc_unpin(&ind);
             return;
         }
+        if (cnt_a == 1 && cnt_b == 1 && get(pos_a).type == Type::PTR && get(pos_b).type == Type::ARR) {
+            auto *arr = dynamic_cast<TypedArray *>(get(pos_a).data.ptr);
+            if (!arr) return op_panic(Operator::CALL);
+            if (arr->is_frozen()) return raise_panic("array is frozen");
+            MemoryManager::AutoPtr<TypedArray> arr_ptr(arr);
+            MemoryManager::AutoPtr<Array> ind(get(pos_b).data.arr);
+            pop(-4);
+            for (const auto &val : *ind) {
+                if (val.type != Type::INT || val.data.num < 0 || arr->len() <= val.data.num) {
+                    return raise_panic("invalid array index");
+                }
+                if (get(-1).type == Type::SEP) return raise_panic("not enough values");
+                if (!arr->set(val.data.num, get(-1))) {
+                    return raise_panic(TypedArray::is_integral(arr->elem_type) ? "integer expected" : "float expected");
+                }
+                pop();
+            }
+            return;
+        }
         return op_panic(Operator::CALL);
     }
 
     void VM::Stack::call_function(Function *fun) {
-        if (cur_frame->depth + 1 >= vm.config.stack_frames_max) panic("stack overflow");
+        if (cur_frame->depth + 1 >= vm.config.stack_frames_max) return raise_panic("stack overflow");
+        safe_point();
         cur_frame = vm.mem.gc_new_auto<Frame>(fun, cur_frame).get();
+        if (vm.call_hook) [[unlikely]] return call_function_hooked(fun);
         fun->call(*this);
+        if (panicked) [[unlikely]] return; // Frames are left for the stack trace
         cur_frame = cur_frame->prev_frame;
     }
 
+    void VM::Stack::call_function_hooked(Function *fun) {
+        CallHook *hook = vm.call_hook;
+        hook->enter(*this, fun);
+        try {
+            fun->call(*this);
+        } catch (...) {
+            hook->leave(*this, fun);
+            throw;
+        }
+        hook->leave(*this, fun);
+        if (!panicked) cur_frame = cur_frame->prev_frame;
+    }
+
     void VM::Stack::execute() {
         if (!cur_frame) assertion_failed("this execution stack is dead");
+        Stack *prev_active = std::exchange(vm.active_stack, this);
         try {
             cur_frame->fun->call(*this);
-        } catch (Panic) {}
+        } catch (Panic) {
+        } catch (...) {
+            vm.active_stack = prev_active;
+            throw;
+        }
+        vm.active_stack = prev_active;
+    }
+
+    void VM::Stack::reset() {
+        if (!cur_frame) assertion_failed("this execution stack is dead");
+        if (coroutine) assertion_failed("coroutine stacks cannot be reset");
+        while (cur_frame->prev_frame) cur_frame = cur_frame->prev_frame; // Frames are left by a panic
+        cur_frame->fallback_meta = {.filename = nullptr, .position = {.row = 0, .col = 0}, .scope = nullptr};
+        cur_frame->meta_ptr = &cur_frame->fallback_meta;
+        values.clear();
+        panicked = false;
+    }
+
+    /**
+     * Native execution context of a resumable execution stack.
+     */
+    struct VM::Stack::Coroutine {
+        enum class State {
+            CREATED, RUNNING, SUSPENDED, FINISHED
+        } state = State::CREATED;
+        bool cancelled = false; // Whether the suspended stack should be unwound instead of being continued.
+        bool preempted = false; // Whether the last suspension was caused by preemption.
+        uint64_t cpu_time = 0; // Total CPU time spent on the native stack of the coroutine, in nanoseconds.
+        size_t switches = 0; // Amount of switches to the coroutine.
+        ucontext_t context{}, caller_context{};
+        void *native_stack = nullptr; // Memory region of the native stack (including the guard page).
+        size_t native_stack_size = 0;
+        std::exception_ptr error = nullptr; // Unexpected exception which terminated the stack.
+        // Address sanitizer needs to be notified about every native stack switch
+        void *fake_stack = nullptr;
+        const void *caller_stack_bottom = nullptr;
+        size_t caller_stack_size = 0;
+
+        // Switches from the caller's native stack to the native stack of the coroutine.
+        void switch_in() {
+#if defined(__SANITIZE_ADDRESS__)
+            void *caller_fake_stack = nullptr;
+            __sanitizer_start_switch_fiber(&caller_fake_stack, native_stack, native_stack_size);
+            swapcontext(&caller_context, &context);
+            __sanitizer_finish_switch_fiber(caller_fake_stack, nullptr, nullptr);
+#else
+            swapcontext(&caller_context, &context);
+#endif
+        }
+
+        // Switches from the native stack of the coroutine back to the caller's native stack.
+        void switch_out() {
+#if defined(__SANITIZE_ADDRESS__)
+            __sanitizer_start_switch_fiber(&fake_stack, caller_stack_bottom, caller_stack_size);
+            swapcontext(&context, &caller_context);
+            __sanitizer_finish_switch_fiber(fake_stack, &caller_stack_bottom, &caller_stack_size);
+#else
+            swapcontext(&context, &caller_context);
+#endif
+        }
+
+        // Leaves the native stack of the coroutine forever.
+        [[noreturn]] void exit() {
+#if defined(__SANITIZE_ADDRESS__)
+            __sanitizer_start_switch_fiber(nullptr, caller_stack_bottom, caller_stack_size);
+#endif
+            setcontext(&caller_context);
+            std::abort();
+        }
+
+        // Must be called first on the native stack of the coroutine.
+        void enter() {
+#if defined(__SANITIZE_ADDRESS__)
+            __sanitizer_finish_switch_fiber(nullptr, &caller_stack_bottom, &caller_stack_size);
+#endif
+        }
+
+        void allocate_native_stack(size_t size) {
+            static const size_t PAGE_SIZE = sysconf(_SC_PAGESIZE);
+            size_t total_size = (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE + PAGE_SIZE;
+            void *mem = mmap(nullptr, total_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+            if (mem == MAP_FAILED) throw OutOfMemoryError();
+            mprotect(mem, PAGE_SIZE, PROT_NONE); // Guard page
+            native_stack = mem;
+            native_stack_size = total_size;
+        }
+
+        void free_native_stack() {
+            if (native_stack) munmap(native_stack, native_stack_size);
+            native_stack = nullptr;
+            native_stack_size = 0;
+        }
+
+        ~Coroutine() {
+            free_native_stack();
+        }
+    };
+
+    static thread_local VM::Stack *starting_stack = nullptr; // The stack being started by the current thread.
+
+    void VM::Stack::coroutine_main() {
+        Stack &stack = *starting_stack;
+        Coroutine &co = *stack.coroutine;
+        co.enter();
+        try {
+            stack.cur_frame->fun->call(stack);
+        } catch (Panic) {
+        } catch (Cancellation) {
+        } catch (...) {
+            co.error = std::current_exception();
+        }
+        co.state = Coroutine::State::FINISHED;
+        co.exit();
+    }
+
+    void VM::Stack::resume() {
+        if (!cur_frame) assertion_failed("this execution stack is dead");
+        if (!coroutine) {
+            auto *co = vm.mem.allocate<Coroutine>();
+            coroutine = new(co) Coroutine();
+        }
+        Coroutine &co = *coroutine;
+        switch (co.state) {
+            case Coroutine::State::CREATED: {
+                co.allocate_native_stack(vm.config.native_stack_size);
+                getcontext(&co.context);
+                co.context.uc_stack.ss_sp = co.native_stack;
+                co.context.uc_stack.ss_size = co.native_stack_size;
+                co.context.uc_link = nullptr;
+                makecontext(&co.context, coroutine_main, 0);
+                starting_stack = this;
+                break;
+            }
+            case Coroutine::State::SUSPENDED:
+                vm.suspended_stacks.erase(this);
+                vm.mem.gc_unpin(this);
+                break;
+            case Coroutine::State::RUNNING:
+                assertion_failed("the execution stack is already running");
+            case Coroutine::State::FINISHED:
+                return;
+        }
+        co.state = Coroutine::State::RUNNING;
+        co.preempted = false;
+        co.switches++;
+        slice_left = ssize_t(time_slice);
+        timespec cpu_beg{}, cpu_end{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_beg);
+        Stack *prev_active = std::exchange(vm.active_stack, this);
+        co.switch_in();
+        vm.active_stack = prev_active;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+        co.cpu_time += (cpu_end.tv_sec - cpu_beg.tv_sec) * 1000000000ull + cpu_end.tv_nsec - cpu_beg.tv_nsec;
+        if (co.state == Coroutine::State::SUSPENDED) {
+            // Suspended stack is kept alive until it is resumed or the VM is destroyed
+            vm.mem.gc_pin(this);
+            vm.suspended_stacks.insert(this);
+            return;
+        }
+        co.free_native_stack();
+        if (co.error) std::rethrow_exception(std::exchange(co.error, nullptr));
+    }
+
+    void VM::Stack::suspend() {
+        if (!coroutine || coroutine->state != Coroutine::State::RUNNING) {
+            panic("the execution stack is not running as a coroutine");
+        }
+        coroutine->state = Coroutine::State::SUSPENDED;
+        coroutine->switch_out();
+        if (coroutine->cancelled) throw Cancellation();
+    }
+
+    void VM::Stack::preempt() {
+        slice_left = ssize_t(time_slice);
+        if (!coroutine || coroutine->state != Coroutine::State::RUNNING) return;
+        coroutine->preempted = true;
+        suspend();
+    }
+
+    void VM::Stack::cancel() {
+        if (!is_suspended()) return;
+        coroutine->cancelled = true;
+        resume();
+    }
+
+    bool VM::Stack::is_suspended() const {
+        return coroutine && coroutine->state == Coroutine::State::SUSPENDED;
+    }
+
+    bool VM::Stack::is_finished() const {
+        return coroutine && coroutine->state == Coroutine::State::FINISHED;
+    }
+
+    void VM::Stack::set_time_slice(size_t instructions) {
+        time_slice = instructions;
+        slice_left = ssize_t(instructions);
+    }
+
+    bool VM::Stack::is_preempted() const {
+        return coroutine && coroutine->preempted;
+    }
+
+    uint64_t VM::Stack::get_cpu_time() const {
+        return coroutine ? coroutine->cpu_time : 0;
+    }
+
+    size_t VM::Stack::get_switches() const {
+        return coroutine ? coroutine->switches : 0;
     }
 
     void VM::Stack::reverse() {
@@ -1034,7 +1496,7 @@ namespace funscript {
         values.pop_back();
     }
 
-    void VM::Stack::panic(const std::string &msg, const std::source_location &loc) {
+    void VM::Stack::raise_panic(const std::string &msg, const std::source_location &loc) {
         if (size() == vm.config.stack_values_max) pop();
         push_str(vm.mem.gc_new_auto<String>(vm, FStr(msg, vm.mem.str_alloc())).get());
         panicked = true;
@@ -1046,11 +1508,15 @@ namespace funscript {
             frame->fallback_meta = *frame->meta_ptr;
             frame->meta_ptr = &frame->fallback_meta;
         }
+    }
+
+    void VM::Stack::panic(const std::string &msg, const std::source_location &loc) {
+        raise_panic(msg, loc);
         throw Panic();
     }
 
     void VM::Stack::op_panic(Operator op) {
-        panic("operator is not defined for these operands");
+        raise_panic("operator is not defined for these operands");
     }
 
     bool VM::Stack::is_panicked() const {
@@ -1061,7 +1527,11 @@ namespace funscript {
         return cur_frame;
     }
 
-    VM::Stack::~Stack() = default;
+    VM::Stack::~Stack() {
+        if (!coroutine) return;
+        coroutine->~Coroutine();
+        vm.mem.free(coroutine, sizeof(Coroutine));
+    }
 
     void VM::Object::get_refs(const std::function<void(Allocation *)> &callback) {
         for (const auto &[key, val] : fields) val.get_ref(callback);
@@ -1120,13 +1590,20 @@ namespace funscript {
         return prev_scope->get_var(name);
     }
 
+    VM::Object *VM::Scope::find_var(const FStr &name) const {
+        if (vars->contains_field(name)) return vars;
+        if (!prev_scope) return nullptr;
+        return prev_scope->find_var(name);
+    }
+
     bool VM::Scope::set_var(const FStr &name, Value val) { // NOLINT(readability-make-member-function-const)
         if (vars->contains_field(name)) return vars->set_field(name, val), true;
         if (prev_scope == nullptr) return false;
         return prev_scope->set_var(name, val);
     }
 
-    VM::Scope::Scope(VM::Object *vars, VM::Scope *prev_scope) : Allocation(vars->vm), vars(vars),
+    VM::Scope::Scope(VM::Object *vars, VM::Scope *prev_scope) : Allocation(prev_scope ? prev_scope->vm : vars->vm),
+                                                                vars(vars),
                                                                 prev_scope(prev_scope) {}
 
     VM::Frame::Frame(Function *fun, Frame *prev_frame) : Allocation(fun->vm), fun(fun), prev_frame(prev_frame),
@@ -1141,25 +1618,102 @@ namespace funscript {
         return *meta_ptr;
     }
 
-    VM::Bytecode::Bytecode(VM &vm, std::string data) : Allocation(vm), bytes(std::move(data)) {}
+    VM::Bytecode::Bytecode(VM &vm, std::string data, String *source) :
+            Allocation(vm),
+            bytes(std::move(data)),
+            source(source),
+            functions(vm.mem.std_alloc<decltype(functions)::value_type>()) {}
 
-    void VM::Bytecode::get_refs(const std::function<void(Allocation *)> &callback) {}
+    void VM::Bytecode::get_refs(const std::function<void(Allocation *)> &callback) {
+        if (source) callback(source);
+        for (const auto &[offset, fun_code] : functions) callback(fun_code);
+    }
+
+    VM::Bytecode *VM::Bytecode::compile_function(size_t offset) {
+        if (auto it = functions.find(offset); it != functions.end()) return it->second;
+        const auto &fn = *reinterpret_cast<const lazy_fn_t *>(bytes.data() + offset);
+        std::string filename(bytes.data() + fn.meta);
+        std::string code(source->bytes.data() + fn.src_beg, fn.src_end - fn.src_beg);
+        std::vector<Token> tokens;
+        {
+            Tracer::Span span(vm.tracer, "compile", "tokenize");
+            tokenize(filename, code, [&tokens](auto token) { tokens.push_back(token); }, fn.src_pos);
+        }
+        ast_ptr ast;
+        {
+            Tracer::Span span(vm.tracer, "compile", "parse");
+            ast = parse(filename, tokens, fn.src_pos);
+        }
+        // Nested functions of the function are compiled lazily as well
+        Assembler as;
+        as.set_lazy_source(code, fn.src_beg, fn.src_pos);
+        std::string fun_bytes;
+        {
+            Tracer::Span span(vm.tracer, "compile", "assemble");
+            as.compile_function(ast.get());
+            fun_bytes.resize(as.total_size(), '\0');
+            as.assemble(fun_bytes.data());
+        }
+        auto fun_code = vm.mem.gc_new_auto<Bytecode>(vm, std::move(fun_bytes), source);
+        functions.insert({offset, fun_code.get()});
+        return fun_code.get();
+    }
 
     void VM::BytecodeFunction::get_refs(const std::function<void(Allocation *)> &callback) {
         VM::Function::get_refs(callback);
         callback(bytecode);
         callback(scope);
+        if (code) callback(code);
     }
 
     void VM::BytecodeFunction::call(VM::Stack &stack) {
+        if (lazy) [[unlikely]] {
+            if (!code) {
+                try {
+                    code = bytecode->compile_function(offset);
+                } catch (const CompilationError &err) {
+                    return stack.raise_panic("compilation error: " + std::string(err.what()));
+                }
+            }
+            return stack.exec_bytecode(mod, scope, code, 0, stack.find_sep());
+        }
         stack.exec_bytecode(mod, scope, bytecode, offset, stack.find_sep());
     }
 
-    VM::BytecodeFunction::BytecodeFunction(VM &vm, Module *mod, Scope *scope, Bytecode *bytecode, size_t offset) :
+    VM::BytecodeFunction::BytecodeFunction(VM &vm, Module *mod, Scope *scope, Bytecode *bytecode, size_t offset,
+                                           bool lazy) :
             Function(vm, mod),
             scope(scope),
             bytecode(bytecode),
-            offset(offset) {}
+            offset(offset),
+            lazy(lazy) {}
+
+    VM::Bytecode *VM::BytecodeFunction::get_bytecode() const {
+        return bytecode;
+    }
+
+    size_t VM::BytecodeFunction::get_offset() const {
+        return offset;
+    }
+
+    VM::code_met_t VM::BytecodeFunction::get_location() const {
+        const auto *bytes = bytecode->bytes.data();
+        if (lazy) {
+            const auto &fn = *reinterpret_cast<const lazy_fn_t *>(bytes + offset);
+            return {.filename = bytes + fn.meta, .position = fn.pos, .scope = nullptr};
+        }
+        const char *meta_chunk = nullptr;
+        code_met_t meta{.filename = nullptr, .position = {0, 0}, .scope = nullptr};
+        for (const auto *ip = reinterpret_cast<const Instruction *>(bytes + offset); ip->op != Opcode::END; ip++) {
+            if (ip->op == Opcode::MET) {
+                meta.filename = meta_chunk = bytes + ip->u64;
+            } else if (meta_chunk && ip->meta) {
+                meta.position = *reinterpret_cast<const code_pos_t *>(meta_chunk + ip->meta);
+                break;
+            }
+        }
+        return meta;
+    }
 
     FStr VM::BytecodeFunction::display() const {
         if (get_name().has_value()) return "function " + get_name().value();
@@ -1169,6 +1723,9 @@ namespace funscript {
     VM::NativeFunction::NativeFunction(VM &vm, Module *mod, decltype(fn) fn) :
             Function(vm, mod), fn(std::move(fn)) {}
 
+    VM::NativeFunction::NativeFunction(VM &vm, Module *mod, void (&fn_ref)(VM::Stack &)) :
+            Function(vm, mod), fn_ptr(&fn_ref) {}
+
     void VM::NativeFunction::get_refs(const std::function<void(Allocation *)> &callback) {
         VM::Function::get_refs(callback);
     }
@@ -1179,7 +1736,11 @@ namespace funscript {
     }
 
     void VM::NativeFunction::call(VM::Stack &stack) {
-        return fn(stack);
+        // Panics thrown by `Stack::panic()` stop here, the interpreter only sees the panicked stack
+        try {
+            if (fn_ptr) return fn_ptr(stack);
+            return fn(stack);
+        } catch (Panic) {}
     }
 
     VM::String::String(VM &vm, FStr bytes) : Allocation(vm), bytes(std::move(bytes)) {}
@@ -1227,6 +1788,94 @@ namespace funscript {
         return values.size();
     }
 
+    void VM::TypedArray::get_refs(const std::function<void(Allocation *)> &callback) {}
+
+    VM::TypedArray::TypedArray(VM &vm, ElemType elem_type, size_t len) : Allocation(vm), elem_type(elem_type),
+                                                                         bytes(len * elem_size(elem_type), char(0),
+                                                                               vm.mem.std_alloc<char>()) {}
+
+    size_t VM::TypedArray::elem_size(ElemType elem_type) {
+        switch (elem_type) {
+            case ElemType::INT64:
+            case ElemType::FLOAT64:
+                return 8;
+            case ElemType::INT32:
+            case ElemType::FLOAT32:
+                return 4;
+            case ElemType::UINT8:
+                return 1;
+        }
+        assertion_failed("unknown element type");
+    }
+
+    bool VM::TypedArray::is_integral(ElemType elem_type) {
+        return elem_type != ElemType::FLOAT64 && elem_type != ElemType::FLOAT32;
+    }
+
+    char *VM::TypedArray::data() {
+        return bytes.data();
+    }
+
+    const char *VM::TypedArray::data() const {
+        return bytes.data();
+    }
+
+    size_t VM::TypedArray::len() const {
+        return bytes.size() / elem_size(elem_type);
+    }
+
+    namespace {
+        template<typename T>
+        T load_elem(const char *data, size_t pos) {
+            T elem;
+            std::memcpy(&elem, data + pos * sizeof(T), sizeof(T));
+            return elem;
+        }
+
+        template<typename T>
+        void store_elem(char *data, size_t pos, T elem) {
+            std::memcpy(data + pos * sizeof(T), &elem, sizeof(T));
+        }
+    }
+
+    VM::Value VM::TypedArray::get(size_t pos) const {
+        switch (elem_type) {
+            case ElemType::INT64:
+                return {Type::INT, {.num = load_elem<int64_t>(data(), pos)}};
+            case ElemType::FLOAT64:
+                return {Type::FLP, {.flp = load_elem<double>(data(), pos)}};
+            case ElemType::INT32:
+                return {Type::INT, {.num = load_elem<int32_t>(data(), pos)}};
+            case ElemType::FLOAT32:
+                return {Type::FLP, {.flp = load_elem<float>(data(), pos)}};
+            case ElemType::UINT8:
+                return {Type::INT, {.num = load_elem<uint8_t>(data(), pos)}};
+        }
+        assertion_failed("unknown element type");
+    }
+
+    bool VM::TypedArray::set(size_t pos, const Value &val) {
+        if (val.type != (is_integral(elem_type) ? Type::INT : Type::FLP)) return false;
+        switch (elem_type) {
+            case ElemType::INT64:
+                store_elem<int64_t>(data(), pos, val.data.num);
+                break;
+            case ElemType::FLOAT64:
+                store_elem<double>(data(), pos, val.data.flp);
+                break;
+            case ElemType::INT32:
+                store_elem<int32_t>(data(), pos, int32_t(val.data.num));
+                break;
+            case ElemType::FLOAT32:
+                store_elem<float>(data(), pos, float(val.data.flp));
+                break;
+            case ElemType::UINT8:
+                store_elem<uint8_t>(data(), pos, uint8_t(val.data.num));
+                break;
+        }
+        return true;
+    }
+
     VM::StackOverflowError::StackOverflowError() = default;
 
     VM::Function::Function(VM &vm, Module *mod) : Allocation(vm), name(std::nullopt), mod(mod) {}
@@ -1246,6 +1895,7 @@ namespace funscript {
 
     void VM::Module::get_refs(const std::function<void(Allocation *)> &callback) {
         callback(globals);
+        callback(object);
         for (const auto &[alias, mod] : deps) callback(mod);
     }
 
@@ -1275,4 +1925,19 @@ namespace funscript {
         if (type == Type::ARR) callback(data.arr);
         if (type == Type::PTR) callback(data.ptr);
     }
+
+    static std::map<std::string, const native_module_t *> &get_static_native_modules() {
+        static std::map<std::string, const native_module_t *> modules;
+        return modules;
+    }
+
+    void register_static_native_module(const std::string &name, const native_module_t *table) {
+        get_static_native_modules()[name] = table;
+    }
+
+    const native_module_t *find_static_native_module(const std::string &name) {
+        auto &modules = get_static_native_modules();
+        auto it = modules.find(name);
+        return it == modules.end() ? nullptr : it->second;
+    }
 }
\ No newline at end of file
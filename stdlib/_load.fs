@@ -4,6 +4,9 @@ exports = {
     .sys = submodule 'sys';
     .io = submodule 'io';
     .coroutines = submodule 'coroutines';
+    .events = submodule 'events';
+    .channels = submodule 'channels';
+    .parallel = submodule 'parallel';
 
     .print = io.Printer.with_destination(io.BufferedWriter.bufferize(io.stdout, 8192));
     .input = io.Scanner.with_source(io.BufferedReader.bufferize(io.stdin, 8192));
@@ -0,0 +1,30 @@
+import submodule 'native';
+
+.native = natives.channels;
+
+# Channels are shared by all the VMs of the process and are identified by their names.
+# Messages are deep-copied, so only integers, floats, booleans, strings, arrays, plain objects and byte storage can be sent.
+.Channel = Type.create('Channel');
+Channel.(
+    .open = (.name: string, .capacity: integer) -> Channel: {
+        .type = Channel;
+
+        .channel: pointer = native.channel_open(name, capacity);
+
+        .send = (*.values) -> (): native.channel_send(channel, *values);
+        .try_send = (*.values) -> boolean: native.channel_try_send(channel, *values);
+        .receive = -> Result[array][]: (
+            .ok, .values = native.channel_receive(channel);
+            ok then Result[array][].ok(values) else Result[array][].err()
+        );
+        .try_receive = -> Result[array][]: (
+            .ok, .values = native.channel_try_receive(channel);
+            ok then Result[array][].ok(values) else Result[array][].err()
+        );
+        .close = -> (): native.channel_close(channel);
+    };
+);
+
+exports = {
+    .Channel = Channel;
+};
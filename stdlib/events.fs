@@ -0,0 +1,64 @@
+import submodule 'native';
+
+.sys = submodule 'sys';
+.io = submodule 'io';
+
+.native = natives.events;
+
+.Task = Type.create('Task');
+
+.Loop = Type.create('Loop');
+Loop.(
+    .create = -> Loop: {
+        .type = Loop;
+
+        .loop: pointer = native.loop_create();
+
+        # Tasks are scheduled in strict priority order (0 is the highest, 7 is the lowest)
+        .spawn_with_priority = (.fn: function, .priority: integer) -> Task: {
+            .type = Task;
+
+            .task: pointer = native.loop_spawn(loop, fn, priority);
+
+            .wake = -> boolean: native.loop_wake(loop, task);
+            .is_finished = -> boolean: native.task_is_finished(task);
+            .is_cancelled = -> boolean: native.task_is_cancelled(task); # Parked when the loop has run out of work
+            .cpu_time = -> integer: native.task_get_cpu_time(task); # In microseconds
+            .switches = -> integer: native.task_get_switches(task);
+        };
+        .spawn = .fn: function -> Task: spawn_with_priority(fn, 4);
+
+        .set_time_slice = .instructions: integer -> (): native.loop_set_time_slice(loop, instructions);
+        .sleep = .ms: integer -> (): native.loop_sleep(loop, ms);
+        .yield = -> (): native.loop_yield(loop);
+        .park = -> (): native.loop_park(loop);
+        .run = -> (): native.loop_run(loop);
+    };
+);
+
+.AsyncFD = Type.create('AsyncFD');
+AsyncFD.(
+    .call = (.loop: Loop, .num: integer) -> AsyncFD: {
+        .type = AsyncFD;
+
+        .posix = sys.get_posix().unwrap();
+        posix.set_nonblocking(num, yes) < 0 then panic posix.strerror(posix.get_errno());
+
+        .write = .buf: ByteSpan -> Result[integer][io.SystemError]: (
+            .cnt = native.loop_write(loop.loop, num, buf.get_bytes().data, buf.get_beg(), buf.get_end());
+            cnt >= 0 then Result[integer][io.SystemError].ok(cnt)
+            else Result[integer][io.SystemError].err(io.SystemError.from_posix_call('write'))
+        );
+        .read = .buf: ByteSpan -> Result[integer][io.SystemError]: (
+            .cnt = native.loop_read(loop.loop, num, buf.get_bytes().data, buf.get_beg(), buf.get_end());
+            cnt >= 0 then Result[integer][io.SystemError].ok(cnt)
+            else Result[integer][io.SystemError].err(io.SystemError.from_posix_call('read'))
+        );
+    };
+);
+
+exports = {
+    .Loop = Loop;
+    .Task = Task;
+    .AsyncFD = AsyncFD;
+};
@@ -24,6 +24,9 @@ FD.(
 
         .write = .buf: ByteSpan -> Result[integer][SystemError]: panic 'not implemented';
         .read = .buf: ByteSpan -> Result[integer][SystemError]: panic 'not implemented';
+        # Values are written as a single serialized message, reading returns the values of all the messages until the end of input
+        .write_values = (*.values) -> Result[][SystemError]: panic 'not implemented';
+        .read_values = -> Result[array][SystemError]: panic 'not implemented';
 
         sys.get_posix().is_ok() then (
             .posix = sys.get_posix().unwrap();
@@ -38,6 +41,15 @@ FD.(
                 cnt >= 0 then Result[integer][SystemError].ok(cnt)
                 else Result[integer][SystemError].err(SystemError.from_posix_call('read'))
             );
+            write_values = (*.values) -> Result[][SystemError]: (
+                posix.write_values(num, *values) >= 0 then Result[][SystemError].ok()
+                else Result[][SystemError].err(SystemError.from_posix_call('write'))
+            );
+            read_values = -> Result[array][SystemError]: (
+                .res = posix.read_values(num);
+                res.is_ok() then Result[array][SystemError].ok(res.unwrap())
+                else Result[array][SystemError].err(SystemError.from_posix_call('read'))
+            );
         );
     };
 );
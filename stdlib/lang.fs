@@ -1,37 +1,19 @@
-.is_object = load_native_sym '_ZN9funscript6stdlib4lang9is_objectERNS_2VM5StackE';
-.is_integer = load_native_sym '_ZN9funscript6stdlib4lang10is_integerERNS_2VM5StackE';
-.is_string = load_native_sym '_ZN9funscript6stdlib4lang9is_stringERNS_2VM5StackE';
-.is_array = load_native_sym '_ZN9funscript6stdlib4lang8is_arrayERNS_2VM5StackE';
-.is_boolean = load_native_sym '_ZN9funscript6stdlib4lang10is_booleanERNS_2VM5StackE';
-.is_float = load_native_sym '_ZN9funscript6stdlib4lang8is_floatERNS_2VM5StackE';
-.is_function = load_native_sym '_ZN9funscript6stdlib4lang11is_functionERNS_2VM5StackE';
-.is_pointer = load_native_sym '_ZN9funscript6stdlib4lang10is_pointerERNS_2VM5StackE';
-
-.int_to_str = load_native_sym '_ZN9funscript6stdlib4lang10int_to_strERNS_2VM5StackE';
-.flp_to_str = load_native_sym '_ZN9funscript6stdlib4lang10flp_to_strERNS_2VM5StackE';
-.fun_to_str = load_native_sym '_ZN9funscript6stdlib4lang10fun_to_strERNS_2VM5StackE';
-.ptr_to_str = load_native_sym '_ZN9funscript6stdlib4lang10ptr_to_strERNS_2VM5StackE';
-.str_to_str = load_native_sym '_ZN9funscript6stdlib4lang10str_to_strERNS_2VM5StackE';
-
-.native = {
-    .panic = load_native_sym '_ZN9funscript6stdlib4lang5panicERNS_2VM5StackE';
-
-    .module = load_native_sym '_ZN9funscript6stdlib4lang7module_ERNS_2VM5StackE';
-    .submodule = load_native_sym '_ZN9funscript6stdlib4lang9submoduleERNS_2VM5StackE';
-    .import = load_native_sym '_ZN9funscript6stdlib4lang7import_ERNS_2VM5StackE';
-
-    .bytes_allocate = load_native_sym '_ZN9funscript6stdlib4lang14bytes_allocateERNS_2VM5StackE';
-    .bytes_paste_from_string = load_native_sym '_ZN9funscript6stdlib4lang23bytes_paste_from_stringERNS_2VM5StackE';
-    .bytes_paste_from_bytes = load_native_sym '_ZN9funscript6stdlib4lang22bytes_paste_from_bytesERNS_2VM5StackE';
-    .bytes_find_string = load_native_sym '_ZN9funscript6stdlib4lang17bytes_find_stringERNS_2VM5StackE';
-    .bytes_to_string = load_native_sym '_ZN9funscript6stdlib4lang15bytes_to_stringERNS_2VM5StackE';
-
-    .concat = load_native_sym '_ZN9funscript6stdlib4lang6concatERNS_2VM5StackE';
-
-    .compile_expr = load_native_sym '_ZN9funscript6stdlib4lang12compile_exprERNS_2VM5StackE';
-
-    .string_is_suffix = load_native_sym '_ZN9funscript6stdlib4lang16string_is_suffixERNS_2VM5StackE';
-};
+.is_object = natives.lang.is_object;
+.is_integer = natives.lang.is_integer;
+.is_string = natives.lang.is_string;
+.is_array = natives.lang.is_array;
+.is_boolean = natives.lang.is_boolean;
+.is_float = natives.lang.is_float;
+.is_function = natives.lang.is_function;
+.is_pointer = natives.lang.is_pointer;
+
+.int_to_str = natives.lang.int_to_str;
+.flp_to_str = natives.lang.flp_to_str;
+.fun_to_str = natives.lang.fun_to_str;
+.ptr_to_str = natives.lang.ptr_to_str;
+.str_to_str = natives.lang.str_to_str;
+
+.native = natives.lang.native;
 
 # Temporary placeholders
 .Type = 0;
@@ -122,11 +104,14 @@ Type.create = .name: string -> Type: create_type(name);
 .Bytes = Type.create('Bytes');
 .ByteSpan = Type.create('ByteSpan');
 Bytes.(
-    .allocate = .size: integer -> Bytes: (
+    .allocate = .size: integer -> Bytes: Bytes.wrap(native.bytes_allocate(size), size);
+
+    # Creates the object of byte storage which has been allocated by a native function
+    .wrap = (.storage: pointer, .size: integer) -> Bytes: (
         .bytes = {
             .type = Bytes;
 
-            .data = native.bytes_allocate(size);
+            .data = storage;
 
             .get_size = -> size;
 
@@ -399,10 +384,46 @@ Formatter.create = -> Formatter: {
     ThisFlow
 );
 
+# Typed arrays store numbers of a single element type ('int64', 'float64', 'int32', 'float32' or 'uint8') unboxed.
+# They are pointers whose elements are accessed by indexing and `sizeof` as the ones of usual arrays.
+# Elementwise operations return new arrays (comparisons return 'uint8' arrays of 1 and 0), `fill` and `scale` modify the array.
+# `min` and `max` of a float array containing NaN are NaN, wherever the NaN is.
+.TypedArray = {
+    .allocate = (.elem_type: string, .len: integer) -> pointer: native.typed_allocate(elem_type, len);
+    .from_array = (.elem_type: string, .arr: array) -> pointer: native.typed_from_array(elem_type, arr);
+    .to_array = .arr: pointer -> array: native.typed_to_array(arr);
+    .get_elem_type = .arr: pointer -> string: native.typed_get_elem_type(arr);
+
+    .add = (.a: pointer, .b: pointer) -> pointer: native.typed_add(a, b);
+    .mul = (.a: pointer, .b: pointer) -> pointer: native.typed_mul(a, b);
+    .less = (.a: pointer, .b: pointer) -> pointer: native.typed_less(a, b);
+    .equal = (.a: pointer, .b: pointer) -> pointer: native.typed_equal(a, b);
+
+    .sum = .arr: pointer -> native.typed_sum(arr);
+    .min = .arr: pointer -> native.typed_min(arr);
+    .max = .arr: pointer -> native.typed_max(arr);
+    .dot = (.a: pointer, .b: pointer) -> native.typed_dot(a, b);
+
+    .fill = (.arr: pointer, .val) -> (): native.typed_fill(arr, val);
+    .scale = (.arr: pointer, .factor) -> (): native.typed_scale(arr, factor);
+};
+
 .compile_expr = (.expr: string, .filename: string, .name: string, .globals: object) -> function: (
     native.compile_expr(expr, filename, name, globals)
 );
 
+# Literal-only data expressions (e.g. configuration files) are loaded without compilation, other ones are evaluated
+.load_data = (.data: string, .filename: string) -> native.load_data(data, filename);
+
+# Values are serialized to a compact binary format which does not depend on the process, shared references and cycles
+# are preserved. Only integers, floats, booleans, strings, arrays, plain objects and byte storage can be serialized.
+.serialize = (*.values) -> Bytes: Bytes.wrap(native.serialize(*values));
+.deserialize = .span: ByteSpan -> native.deserialize(span.get_bytes().data, span.get_beg(), span.get_end());
+
+# Frozen values are immutable deep copies which are shared by all the VMs of the process
+.freeze = .val -> native.freeze(val);
+.is_frozen = .val -> boolean: native.is_frozen(val);
+
 exports = {
     .panic = panic;
     .panic_format = panic_format;
@@ -427,6 +448,8 @@ exports = {
     .Bytes = Bytes;
     .ByteSpan = ByteSpan;
 
+    .TypedArray = TypedArray;
+
     .Result = Result;
 
     .Formatter = Formatter;
@@ -436,6 +459,13 @@ exports = {
     .Flow = Flow;
 
     .compile_expr = compile_expr;
+    .load_data = load_data;
+
+    .serialize = serialize;
+    .deserialize = deserialize;
+
+    .freeze = freeze;
+    .is_frozen = is_frozen;
 };
 
 exports.lang = exports;
@@ -0,0 +1,21 @@
+import submodule 'native';
+
+.native = natives.parallel;
+
+# Functions are passed as source code rather than function values: a function value references its scopes and
+# bytecode in the caller's VM, which workers cannot use. Every worker compiles the source in its own VM (the bytecode
+# is kept in the bounded compilation cache of the worker) and evaluates it with empty globals, so the function cannot
+# capture variables. Elements and results are transferred by structured clone.
+# Workers are shared by all VMs with the same stack limits and compilation cache size, and run with these limits:
+# a pool of workers is started for each distinct set of limits and lives until the process exits.
+
+# Applies the function to every element of the array, processing chunks of the specified size in parallel.
+.map = (.arr: array, .fn: string, .chunk: integer) -> array: native.map(arr, fn, chunk);
+
+# Folds the array with the (associative) function, processing chunks of the specified size in parallel.
+.reduce = (.arr: array, .fn: string, .chunk: integer) -> native.reduce(arr, fn, chunk);
+
+exports = {
+    .map = map;
+    .reduce = reduce;
+};
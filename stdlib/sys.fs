@@ -3,13 +3,8 @@ import submodule 'native';
 .posix = 0;
 
 .get_posix = -> Result[object][]: (
-    posix is 0 and has_native_sym '_ZN9funscript6stdlib3sys15posix_get_errnoERNS_2VM5StackE' then (
-        .native = {
-            .get_errno = load_native_sym '_ZN9funscript6stdlib3sys15posix_get_errnoERNS_2VM5StackE';
-            .write = load_native_sym '_ZN9funscript6stdlib3sys11posix_writeERNS_2VM5StackE';
-            .read = load_native_sym '_ZN9funscript6stdlib3sys10posix_readERNS_2VM5StackE';
-            .strerror = load_native_sym '_ZN9funscript6stdlib3sys14posix_strerrorERNS_2VM5StackE';
-        };
+    posix is 0 and natives has sys then (
+        .native = natives.sys;
         posix = {
             .get_errno = -> integer: native.get_errno();
             .write = (.fd: integer, .bytes: Bytes, .beg: integer, .end: integer) -> integer: (
@@ -20,7 +15,13 @@ import submodule 'native';
                 beg < 0 or end > sizeof bytes or beg > end then panic 'invalid range';
                 native.read(fd, bytes.data, beg, end)
             );
+            .write_values = (.fd: integer, *.values) -> integer: native.write_values(fd, *values);
+            .read_values = .fd: integer -> Result[array][]: (
+                .ok, .values = native.read_values(fd);
+                ok then Result[array][].ok(values) else Result[array][].err()
+            );
             .strerror = .err_num: integer -> string: native.strerror(err_num);
+            .set_nonblocking = (.fd: integer, .nonblocking: boolean) -> integer: native.set_nonblocking(fd, nonblocking);
         };
     );
     posix is 0 then Result[object][].err()
@@ -2,6 +2,22 @@
 #include "catch2/matchers/catch_matchers_string.hpp"
 
 #include "tests.hpp"
+#include "transfer.hpp"
+#include "profiler.hpp"
+#include "tracer.hpp"
+#include "data.hpp"
+#include "kernels.hpp"
+
+#include <thread>
+#include <cstring>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include <unistd.h>
 
 #define EVALUATES_TO(...) EvaluatesTo(env, ##__VA_ARGS__)
 #define PANICS Panics(env)
@@ -275,4 +291,1008 @@ TEST_CASE("Objects", "[objects]") {
         CHECK_THAT("obj.var", EVALUATES_TO(6));
         CHECK_THAT("var", PANICS);
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Value transfer", "[transfer]") {
+    TestEnv src, dst;
+    SECTION("Structured clone") {
+        auto values = src.evaluate(".o = {.x = 1}; 1, 2.5, 'str', [o, o]");
+        auto buf = TransferBuffer::pack(&(*values)[0], &(*values)[0] + values->size());
+        auto stack = dst.get_vm().mem.gc_new_auto<VM::Stack>(dst.get_vm());
+        buf.unpack(*stack);
+        REQUIRE(stack->size() == 4);
+        CHECK(check_value((*stack)[0], 1));
+        CHECK(check_value((*stack)[1], 2.5));
+        CHECK(check_value<const char *>((*stack)[2], "str"));
+        REQUIRE((*stack)[3].type == Type::ARR);
+        const auto &arr = *(*stack)[3].data.arr;
+        REQUIRE(arr.len() == 2);
+        CHECK(arr[0].data.obj == arr[1].data.obj); // Shared references are preserved
+        CHECK(arr[0].data.obj != (*values)[3].data.arr->begin()->data.obj);
+        CHECK(check_value(arr[0].data.obj->get_field("x").value(), 1));
+        auto fun = src.evaluate("-> 1");
+        CHECK_THROWS_AS(TransferBuffer::pack(&(*fun)[0], &(*fun)[0] + 1), TransferError);
+    };
+    SECTION("Deep values") {
+        TestEnv env(268435456 /* 256 MiB */);
+        auto &vm = env.get_vm();
+        auto make_chain = [&vm](size_t depth) -> MemoryManager::AutoPtr<VM::Array> {
+            auto chain = vm.mem.gc_new_auto<VM::Array>(vm, 1);
+            (*chain)[0] = {Type::INT, {.num = 1}};
+            for (size_t level = 1; level < depth; level++) {
+                auto next = vm.mem.gc_new_auto<VM::Array>(vm, 1);
+                (*next)[0] = {Type::ARR, {.arr = chain.get()}};
+                chain = std::move(next);
+            }
+            return chain;
+        };
+        // Values which are nested too deeply are rejected instead of exhausting the native stack
+        auto deep_chain = make_chain(1000000);
+        VM::Value deep(Type::ARR, {.arr = deep_chain.get()});
+        CHECK_THROWS_AS(TransferBuffer::pack(&deep, &deep + 1), TransferError);
+        CHECK_THROWS_AS(FrozenHeap().freeze(deep), TransferError);
+        auto chain = make_chain(5000);
+        VM::Value val(Type::ARR, {.arr = chain.get()});
+        auto buf = TransferBuffer::pack(&val, &val + 1);
+        auto stack = dst.get_vm().mem.gc_new_auto<VM::Stack>(dst.get_vm());
+        buf.unpack(*stack);
+        REQUIRE(stack->size() == 1);
+        size_t depth = 0;
+        for (auto elem = (*stack)[0]; elem.type == Type::ARR; elem = (*elem.data.arr)[0]) depth++;
+        CHECK(depth == 5000);
+    };
+    SECTION("Frozen values") {
+        FrozenHeap heap;
+        auto values = src.evaluate("{.x = 1; .y = {.z = 'str'}}");
+        auto frozen = heap.freeze((*values)[0]);
+        REQUIRE(frozen.type == Type::OBJ);
+        CHECK(frozen.data.obj->is_frozen());
+        CHECK(frozen.data.obj->get_field("y").value().data.obj->is_frozen());
+        CHECK(!(*values)[0].data.obj->is_frozen());
+        auto buf = TransferBuffer::pack(&frozen, &frozen + 1);
+        auto stack = dst.get_vm().mem.gc_new_auto<VM::Stack>(dst.get_vm());
+        buf.unpack(*stack);
+        CHECK((*stack)[0].data.obj == frozen.data.obj); // Frozen values are shared instead of being copied
+    };
+    SECTION("Frozen value stores") {
+        TestEnv &env = src;
+        env.import_std();
+        REQUIRE_THAT(".a = freeze([1, 2]); .o = freeze({.x = 1; .n = {.y = 2}})", EVALUATES);
+        CHECK_THAT("is_frozen(a), is_frozen(o.n)", EVALUATES_TO(true, true));
+        CHECK_THAT("a[0] = {.x = 'heap'}", PANICS); // Array stores
+        CHECK_THAT("a[1], a[0] = 3, 4", PANICS);
+        CHECK_THAT("o.x = 2", PANICS); // Field stores
+        CHECK_THAT("o.n.y = 3", PANICS);
+        CHECK_THAT("o.z = 3", PANICS);
+        CHECK_THAT("o.(x = 2)", PANICS); // Variable stores
+        CHECK_THAT("o.(.z = 3)", PANICS);
+        CHECK_THAT("a[0], a[1], o.x, o.n.y, o has z", EVALUATES_TO(1, 2, 1, 2, false));
+    };
+    SECTION("Channels") {
+        constexpr int MESSAGES = 10000;
+        Channel channel(4);
+        std::thread producer([&channel]() {
+            for (int num = 0; num < MESSAGES; num++) {
+                VM::Value val(Type::INT, {.num = num});
+                auto msg = std::make_unique<TransferBuffer>(TransferBuffer::pack(&val, &val + 1));
+                while (true) {
+                    auto seen = channel.get_events();
+                    if (channel.try_send(msg)) break;
+                    channel.wait(seen);
+                }
+            }
+            channel.close();
+        });
+        auto stack = dst.get_vm().mem.gc_new_auto<VM::Stack>(dst.get_vm());
+        int expected = 0;
+        while (true) {
+            auto seen = channel.get_events();
+            bool closed = channel.is_closed();
+            if (auto msg = channel.try_receive()) {
+                msg->unpack(*stack);
+                if (check_value((*stack)[-1], expected)) expected++;
+                stack->pop();
+            } else if (closed) break;
+            else channel.wait(seen);
+        }
+        producer.join();
+        CHECK(expected == MESSAGES);
+    }
+    SECTION("Channel messages") {
+        src.import_std();
+        dst.import_std();
+        REQUIRE_THAT(".c = channels.Channel.open('messages', 4)", EvaluatesTo(src));
+        REQUIRE_THAT(".c = channels.Channel.open('messages', 4)", EvaluatesTo(dst));
+        CHECK_THAT("c.try_send(1, 'str', [2.5]), c.try_send()", EvaluatesTo(src, true, true));
+        CHECK_THAT("c.send(); c.send(no)", EvaluatesTo(src));
+        CHECK_THAT(".m = c.receive().unwrap(); sizeof m, m[0], m[1], m[2][0]", EvaluatesTo(dst, 3, 1, "str", 2.5));
+        CHECK_THAT("sizeof c.try_receive().unwrap(), sizeof c.receive().unwrap()", EvaluatesTo(dst, 0, 0));
+        CHECK_THAT("c.receive().unwrap()[0], c.try_receive().is_ok()", EvaluatesTo(dst, false, false));
+        CHECK_THAT("c.close(); c.receive().is_ok()", EvaluatesTo(dst, false));
+        CHECK_THAT("c.send(1)", Panics(src)); // The channel is closed
+    }
+}
+
+TEST_CASE("Profiling", "[profiling]") {
+    TestEnv env;
+    SECTION("Sampling profiler") {
+        REQUIRE_THAT(".spin = .n -> (.i = 0; i < n repeats (i = i + 1); i)", EVALUATES);
+        Profiler profiler(env.get_vm(), 1000);
+        profiler.start();
+        CHECK_THAT("spin(30000)", EVALUATES_TO(30000));
+        profiler.stop();
+        CHECK(profiler.get_samples() > 0);
+        std::ostringstream folded, pprof;
+        profiler.write_folded(folded);
+        CHECK(folded.str().find("function spin (<test>:1)") != std::string::npos);
+        profiler.write_pprof(pprof);
+        CHECK(!pprof.str().empty());
+    };
+    SECTION("Call statistics") {
+        REQUIRE_THAT(".fact = .n -> (n == 0 then 1 else fact(n - 1) * n)", EVALUATES);
+        CallProfiler profiler(env.get_vm());
+        profiler.start();
+        CHECK_THAT("fact(10)", EVALUATES_TO(3628800));
+        profiler.stop();
+        std::ostringstream report;
+        profiler.write_report(report);
+        CHECK(report.str().find("          11") != std::string::npos); // Amount of calls
+        CHECK(report.str().find("function fact at <test>:1:") != std::string::npos);
+    };
+    SECTION("Tracing") {
+        REQUIRE_THAT(".fact = .n -> (n == 0 then 1 else fact(n - 1) * n)", EVALUATES);
+        Tracer tracer(0);
+        tracer.attach(env.get_vm());
+        CHECK_THAT("fact(5)", EVALUATES_TO(120));
+        env.get_vm().mem.gc_cycle();
+        tracer.detach(env.get_vm());
+        std::ostringstream trace;
+        tracer.write_json(trace);
+        CHECK(trace.str().find("\"traceEvents\": [") != std::string::npos);
+        CHECK(trace.str().find("\"cat\": \"call\"") != std::string::npos);
+        CHECK(trace.str().find("function fact at <test>:1:") != std::string::npos);
+        CHECK(trace.str().find("\"name\": \"gc_cycle\"") != std::string::npos);
+    };
+}
+
+namespace {
+
+    MemoryManager::AutoPtr<VM::String> repeat_string(VM::Stack &stack, VM::String *str, fint times) {
+        FStr result(stack.vm.mem.str_alloc());
+        for (fint pos = 0; pos < times; pos++) result += str->bytes;
+        return stack.vm.mem.gc_new_auto<VM::String>(stack.vm, result);
+    }
+
+    void repeat_string_native(VM::Stack &stack) {
+        util::bind_native<repeat_string>(stack);
+    }
+
+    const native_entry_t TEST_NATIVES[] = {
+            {"strings.repeat", repeat_string_native},
+    };
+
+    const native_module_t TEST_NATIVE_MODULE = {TEST_NATIVES, std::size(TEST_NATIVES)};
+
+}
+
+TEST_CASE("Calls from C++", "[calls]") {
+    TestEnv env;
+    SECTION("Reusable call context") {
+        auto fun = env.evaluate(".n -> (n * 2, n + 1)");
+        util::CallContext ctx(env.get_vm(), (*fun)[0].data.fun);
+        REQUIRE(ctx.call({VM::Value(Type::INT, {.num = 21})}));
+        REQUIRE(ctx.results().size() == 2);
+        CHECK(check_value(ctx.results()[0], 42));
+        CHECK(check_value(ctx.results()[1], 22));
+        REQUIRE(ctx.call({VM::Value(Type::INT, {.num = 5})}));
+        CHECK(check_value(ctx.results()[0], 10));
+        CHECK(!ctx.call({VM::Value(Type::BLN, {.bln = true})}));
+        CHECK(ctx.is_panicked());
+        CHECK(ctx.results().back().type == Type::STR);
+        REQUIRE(ctx.call({VM::Value(Type::INT, {.num = 3})})); // The context is reusable after a panic
+        REQUIRE(ctx.results().size() == 2);
+        CHECK(check_value(ctx.results()[0], 6));
+    };
+    SECTION("Stack overflow") {
+        auto fun = env.evaluate(".f = .n -> f(n + 1); f");
+        util::CallContext ctx(env.get_vm(), (*fun)[0].data.fun);
+        CHECK(!ctx.call({VM::Value(Type::INT, {.num = 0})}));
+        CHECK(check_value<const char *>(ctx.results().back(), "stack overflow"));
+        CHECK(ctx.get_stack().get_current_frame()->depth > 0);
+        CHECK(!ctx.call({VM::Value(Type::INT, {.num = 0})}));
+        CHECK(check_value<const char *>(ctx.results().back(), "stack overflow"));
+    };
+    SECTION("Panic propagation") {
+        auto fun = env.evaluate(".cnt = 0; .g = .n -> 10 / n; .f = .n -> (.r = g(n); cnt = cnt + 1; r); f");
+        util::CallContext ctx(env.get_vm(), (*fun)[0].data.fun);
+        CHECK(!ctx.call({VM::Value(Type::INT, {.num = 0})}));
+        CHECK(check_value<const char *>(ctx.results().back(), "division by zero"));
+        size_t depth = 0;
+        ctx.get_stack().generate_stack_trace([&depth](auto) -> void { depth++; });
+        CHECK(depth == 2); // The frames of both functions are left for the stack trace
+        CHECK_THAT("cnt", EVALUATES_TO(0)); // The rest of the caller is not executed
+        REQUIRE(ctx.call({VM::Value(Type::INT, {.num = 2})}));
+        CHECK(check_value(ctx.results()[0], 5));
+        CHECK_THAT("cnt", EVALUATES_TO(1));
+    };
+}
+
+TEST_CASE("Native functions", "[natives]") {
+    TestEnv env;
+    auto stack = env.get_vm().mem.gc_new_auto<VM::Stack>(env.get_vm());
+    auto str = env.get_vm().mem.gc_new_auto<VM::String>(env.get_vm(), FStr("ab", env.get_vm().mem.str_alloc()));
+    SECTION("Compile-time binding") {
+        stack->push_int(42); // Values below the argument pack are preserved
+        stack->push_sep();
+        stack->push_str(str.get());
+        stack->push_int(3);
+        util::bind_native<repeat_string>(*stack);
+        REQUIRE(stack->size() == 2);
+        CHECK(check_value((*stack)[0], 42));
+        CHECK(check_value<const char *>((*stack)[1], "ababab"));
+    };
+    SECTION("Wrong arguments") {
+        stack->push_sep();
+        stack->push_str(str.get());
+        stack->push_str(str.get());
+        CHECK_NOTHROW(util::bind_native<repeat_string>(*stack));
+        CHECK(stack->is_panicked());
+        CHECK(check_value<const char *>((*stack)[-1], "value #2 is absent or is of wrong type"));
+    };
+    SECTION("Too many arguments") {
+        stack->push_sep();
+        stack->push_str(str.get());
+        stack->push_int(3);
+        stack->push_int(4);
+        CHECK_NOTHROW(util::bind_native<repeat_string>(*stack));
+        CHECK(check_value<const char *>((*stack)[-1], "too many values, required 2"));
+    };
+    SECTION("Too few arguments") {
+        stack->push_sep();
+        stack->push_str(str.get());
+        CHECK_NOTHROW(util::bind_native<repeat_string>(*stack));
+        CHECK(check_value<const char *>((*stack)[-1], "value #2 is absent or is of wrong type"));
+    };
+    SECTION("Registration tables") {
+        register_static_native_module("test.natives", &TEST_NATIVE_MODULE);
+        auto mod = util::load_native_module(env.get_vm(), "test.natives");
+        auto exports = mod->object->get_field(FStr(MODULE_EXPORTS_VAR, env.get_vm().mem.str_alloc())).value();
+        CHECK(!exports.data.obj->get_field(FStr(NATIVE_MODULE_SYMBOL_LOADER_VAR, env.get_vm().mem.str_alloc())));
+        auto natives = exports.data.obj->get_field(FStr(NATIVE_MODULE_TABLE_VAR, env.get_vm().mem.str_alloc()));
+        REQUIRE(natives.has_value());
+        auto strings = natives->data.obj->get_field(FStr("strings", env.get_vm().mem.str_alloc())).value();
+        auto repeat = strings.data.obj->get_field(FStr("repeat", env.get_vm().mem.str_alloc())).value();
+        REQUIRE(repeat.type == Type::FUN);
+        auto *fun = dynamic_cast<VM::NativeFunction *>(repeat.data.fun);
+        REQUIRE(fun);
+        CHECK(fun->display() == "function #[native]# strings.repeat");
+        auto call = env.get_vm().mem.gc_new_auto<VM::Stack>(env.get_vm(), fun);
+        call->push_sep();
+        call->push_str(str.get());
+        call->push_int(2);
+        call->execute();
+        REQUIRE(!call->is_panicked());
+        CHECK(check_value<const char *>((*call)[-1], "abab"));
+    };
+}
+
+namespace {
+
+    size_t unwound_natives = 0; // Amount of native calls unwound by cancellation of their stacks.
+
+    void suspend_native(VM::Stack &stack) {
+        struct Guard {
+            ~Guard() {
+                if (std::uncaught_exceptions()) unwound_natives++;
+            }
+        } guard;
+        stack.suspend();
+        stack.pop(stack.find_sep());
+    }
+
+    const native_entry_t COROUTINE_NATIVES[] = {
+            {"coroutines.suspend", suspend_native},
+    };
+
+    const native_module_t COROUTINE_NATIVE_MODULE = {COROUTINE_NATIVES, std::size(COROUTINE_NATIVES)};
+
+    /**
+     * Creates a stack which calls the function with the native suspending function as its argument.
+     */
+    MemoryManager::AutoPtr<VM::Stack> create_coroutine(TestEnv &env, const std::string &expr) {
+        auto &vm = env.get_vm();
+        register_static_native_module("test.coroutines", &COROUTINE_NATIVE_MODULE);
+        auto mod = util::load_native_module(vm, "test.coroutines");
+        auto exports = mod->object->get_field(MODULE_EXPORTS_VAR).value();
+        auto natives = exports.data.obj->get_field(NATIVE_MODULE_TABLE_VAR).value();
+        auto suspend = natives.data.obj->get_field("coroutines").value().data.obj->get_field("suspend").value();
+        auto fun = env.evaluate(expr);
+        auto stack = vm.mem.gc_new_auto<VM::Stack>(vm, (*fun)[0].data.fun);
+        stack->push_sep();
+        stack->push(suspend);
+        return stack;
+    }
+
+}
+
+TEST_CASE("Coroutines", "[coroutines]") {
+    TestEnv env;
+    SECTION("Resume and suspend") {
+        auto a = create_coroutine(env, ".suspend -> (.x = 1; suspend(); x = x + 1; suspend(); x * 10)");
+        auto b = create_coroutine(env, ".suspend -> (suspend(); 'b')");
+        a->resume();
+        b->resume();
+        CHECK(a->is_suspended());
+        CHECK(b->is_suspended());
+        a->resume();
+        b->resume();
+        CHECK(a->is_suspended());
+        REQUIRE(b->is_finished());
+        CHECK(check_value<const char *>((*b)[-1], "b"));
+        a->resume();
+        REQUIRE(a->is_finished());
+        CHECK(!a->is_panicked());
+        CHECK(check_value((*a)[-1], 20));
+        CHECK(a->get_switches() == 3);
+        a->resume(); // Finished stacks are not resumed again
+        CHECK(a->get_switches() == 3);
+    };
+    SECTION("Panics") {
+        auto stack = create_coroutine(env, ".suspend -> (suspend(); 1 / 0)");
+        stack->resume();
+        stack->resume();
+        CHECK(stack->is_finished());
+        REQUIRE(stack->is_panicked());
+        CHECK(check_value<const char *>((*stack)[-1], "division by zero"));
+        auto outside = create_coroutine(env, ".suspend -> suspend()");
+        outside->execute(); // Stacks which are not coroutines cannot be suspended
+        REQUIRE(outside->is_panicked());
+        CHECK(check_value<const char *>((*outside)[-1], "the execution stack is not running as a coroutine"));
+    };
+    SECTION("Preemption") {
+        // Time slices end at backward jumps and at calls
+        auto loop = create_coroutine(env, ".suspend -> (.i = 0; i < 10000 repeats i = i + 1; i)");
+        std::string calls = ".g = -> 1; .suspend -> (0";
+        for (size_t cnt = 0; cnt < 200; cnt++) calls += " + g()";
+        auto call = create_coroutine(env, calls + ")");
+        for (auto *stack : {loop.get(), call.get()}) {
+            stack->set_time_slice(20);
+            size_t preemptions = 0;
+            for (stack->resume(); stack->is_suspended(); stack->resume()) {
+                if (stack->is_preempted()) preemptions++;
+            }
+            CHECK(preemptions > 10);
+            CHECK(stack->get_switches() == preemptions + 1);
+            CHECK(stack->get_cpu_time() > 0);
+        }
+        CHECK(check_value((*loop)[-1], 10000));
+        CHECK(check_value((*call)[-1], 200));
+    };
+    SECTION("Cancellation") {
+        REQUIRE_THAT(".cnt = 0", EVALUATES);
+        auto stack = create_coroutine(env, ".suspend -> (suspend(); cnt = cnt + 1)");
+        stack->resume();
+        size_t unwound = unwound_natives;
+        stack->cancel();
+        CHECK(stack->is_finished());
+        CHECK(unwound_natives == unwound + 1); // The suspended native call is unwound
+        CHECK_THAT("cnt", EVALUATES_TO(0)); // The rest of the function is not executed
+        stack->cancel();
+        auto created = create_coroutine(env, ".suspend -> (cnt = cnt + 1)");
+        created->cancel(); // Only suspended stacks are cancelled
+        created->resume();
+        CHECK(created->is_finished());
+        CHECK_THAT("cnt", EVALUATES_TO(1));
+    };
+    SECTION("Destruction of the VM") {
+        size_t unwound = unwound_natives;
+        {
+            TestEnv other;
+            auto a = create_coroutine(other, ".suspend -> (suspend(); 1)");
+            auto b = create_coroutine(other, ".suspend -> (.i = 0; i < 3 repeats (suspend(); i = i + 1))");
+            a->resume();
+            b->resume();
+            b->resume();
+            REQUIRE(a->is_suspended());
+            REQUIRE(b->is_suspended());
+        } // Suspended stacks are cancelled by the VM
+        CHECK(unwound_natives == unwound + 2);
+    };
+}
+
+TEST_CASE("Event loop", "[events]") {
+    TestEnv env(67108864 /* 64 MiB */, 256, 65536 /* 64 Ki */);
+    env.import_std();
+    REQUIRE_THAT(".loop = events.Loop.create(); .log = []", EVALUATES);
+    SECTION("Timers") {
+        auto beg = std::chrono::steady_clock::now();
+        REQUIRE_THAT("loop.spawn(-> (loop.sleep(30); log = log + ['a30']));"
+                     "loop.spawn(-> (loop.sleep(10); log = log + ['b10']; loop.sleep(5); log = log + ['b15']));"
+                     "loop.spawn(-> (log = log + ['c0']));"
+                     "loop.run()", EVALUATES);
+        CHECK(std::chrono::steady_clock::now() - beg >= std::chrono::milliseconds(30));
+        CHECK_THAT("log[0], log[1], log[2], log[3]", EVALUATES_TO("c0", "b10", "b15", "a30"));
+    };
+    SECTION("Pipes") {
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+        // The reader waits for the empty pipe, the writer waits for the full one (the data exceeds the pipe buffer)
+        REQUIRE_THAT(".r, .w = events.AsyncFD(loop, " + std::to_string(fds[0]) + "), events.AsyncFD(loop, " +
+                     std::to_string(fds[1]) + "); .total, .first = 0, ''", EVALUATES);
+        REQUIRE_THAT("loop.spawn(-> (.buf = Bytes.allocate(4096); .n = 0; total < 1048576 repeats ("
+                     "    n = r.read(buf.span(0, 4096)).unwrap();"
+                     "    total == 0 then first = buf.to_string(0, 4);"
+                     "    total = total + n; log = log + [n]"
+                     ")));"
+                     "loop.spawn(-> (.buf = Bytes.allocate(65536); buf.paste_string(0, 'abcd'); .i, .off = 0, 0;"
+                     "    i < 16 repeats ("
+                     "        off = 0;"
+                     "        off < 65536 repeats off = off + w.write(buf.span(off, 65536)).unwrap();"
+                     "        i = i + 1"
+                     "    )"
+                     "));"
+                     "loop.run()", EVALUATES);
+        close(fds[0]);
+        close(fds[1]);
+        CHECK_THAT("total, first", EVALUATES_TO(1048576, "abcd"));
+        CHECK_THAT("sizeof log > 16", EVALUATES_TO(true)); // The reader was resumed many times
+    };
+    SECTION("Priorities") {
+        REQUIRE_THAT("loop.spawn_with_priority(-> (log = log + ['low']), 7);"
+                     "loop.spawn(-> (log = log + ['normal']; loop.yield(); log = log + ['yielded']));"
+                     "loop.spawn_with_priority(-> (log = log + ['high']), 0);"
+                     "loop.run()", EVALUATES);
+        CHECK_THAT("log[0], log[1], log[2], log[3]", EVALUATES_TO("high", "normal", "yielded", "low"));
+        CHECK_THAT("loop.spawn_with_priority(-> (), 8)", PANICS);
+    };
+    SECTION("Parking") {
+        REQUIRE_THAT(".parked = loop.spawn(-> (loop.park(); log = log + ['woken']));"
+                     ".forever = loop.spawn(-> (loop.park(); log = log + ['never']));"
+                     "loop.spawn(-> (log = log + [parked.wake(), parked.wake()]));"
+                     "loop.run()", EVALUATES);
+        CHECK_THAT("log[0], log[1], log[2], sizeof log", EVALUATES_TO(true, false, "woken", 3));
+        CHECK_THAT("parked.is_finished(), parked.is_cancelled()", EVALUATES_TO(true, false));
+        // Tasks which are parked when the loop runs out of work are cancelled
+        CHECK_THAT("forever.is_finished(), forever.is_cancelled(), forever.wake()", EVALUATES_TO(false, true, false));
+        CHECK_THAT("loop.park()", PANICS); // Not running in a task
+    };
+    SECTION("Fairness") {
+        // The busy task is preempted, so that the other ones keep making progress until it finishes
+        REQUIRE_THAT("loop.set_time_slice(1000);"
+                     ".busy = loop.spawn(-> (.i = 0; i < 500000 repeats i = i + 1; log = log + ['busy']));"
+                     ".sleeper = loop.spawn(-> (loop.sleep(1); log = log + ['slept']));"
+                     "loop.spawn(-> (.i = 0; i < 3 repeats (loop.yield(); i = i + 1); log = log + ['yielded']));"
+                     "loop.run()", EVALUATES);
+        CHECK_THAT("sizeof log, log[2]", EVALUATES_TO(3, "busy"));
+        CHECK_THAT("busy.switches() > 10, sleeper.switches()", EVALUATES_TO(true, 2));
+        CHECK_THAT("busy.cpu_time() > 0, busy.cpu_time() >= sleeper.cpu_time()", EVALUATES_TO(true, true));
+    };
+}
+
+TEST_CASE("Parallel map and reduce", "[parallel]") {
+    TestEnv env(67108864 /* 64 MiB */, 256, 65536 /* 64 Ki */);
+    env.import_std();
+    REQUIRE_THAT(".i = 0; .arr = [i < 1000 repeats (i = i + 1; i)]", EVALUATES);
+    SECTION("Map") {
+        CHECK_THAT(".sq = parallel.map(arr, '.x -> x * x', 7); sizeof sq, sq[0], sq[500], sq[999]",
+                   EVALUATES_TO(1000, 1, 251001, 1000000));
+        CHECK_THAT("parallel.map([1, 2], '.x -> {.v = [x, x * 2]}', 1)[1].v[1]", EVALUATES_TO(4));
+        CHECK_THAT("sizeof parallel.map([], '.x -> x', 10)", EVALUATES_TO(0));
+    };
+    SECTION("Reduce") {
+        CHECK_THAT("parallel.reduce(arr, '(.a, .b) -> a + b', 10)", EVALUATES_TO(500500));
+        // Partial results are combined in order
+        CHECK_THAT("parallel.reduce(['a', 'b', 'c', 'd', 'e'], '(.a, .b) -> a + b', 2)", EVALUATES_TO("abcde"));
+        CHECK_THAT("parallel.reduce([5], '(.a, .b) -> a + b', 10)", EVALUATES_TO(5));
+        CHECK_THAT("parallel.reduce([], '(.a, .b) -> a + b', 10)", PANICS);
+    };
+    SECTION("Errors") {
+        REQUIRE_THAT(".try = .fn -> (.cs = coroutines.Stack.create(fn); cs.push_sep(); cs.execute(); cs.top())",
+                     EVALUATES);
+        // Panics of workers are propagated to the caller
+        CHECK_THAT("try(-> parallel.map([1, 0, 3], '.x -> 1 / x', 1))", EVALUATES_TO("division by zero"));
+        CHECK_THAT("try(-> parallel.reduce([1, 2, 3], '(.a, .b) -> a + c', 2))", EVALUATES_TO("no such variable: 'c'"));
+        CHECK_THAT("try(-> parallel.map([1], '1', 1))", EVALUATES_TO("single function expected"));
+        CHECK_THAT("parallel.map([1], '.x -> (', 1)", PANICS); // Compilation error
+        CHECK_THAT("parallel.map([-> 1], '.x -> x', 1)", PANICS); // Functions cannot be transferred
+        CHECK_THAT("parallel.map([1], '.x -> x', 0)", PANICS);
+        CHECK_THAT("parallel.map([1, 2], '.x -> x * 3', 1)[1]", EVALUATES_TO(6)); // Workers keep working after errors
+    };
+    SECTION("Limits") {
+        // Workers run with the stack limits of the calling VM
+        REQUIRE_THAT(".depth = '.n -> (.f = .n -> (n == 0 then 0 else f(n - 1) + 1); f(n))'", EVALUATES);
+        TestEnv small(67108864 /* 64 MiB */, 16, 65536 /* 64 Ki */);
+        small.import_std();
+        REQUIRE_THAT(".depth = '.n -> (.f = .n -> (n == 0 then 0 else f(n - 1) + 1); f(n))'", Evaluates(small));
+        REQUIRE_THAT(".try = .fn -> (.cs = coroutines.Stack.create(fn); cs.push_sep(); cs.execute(); cs.top())",
+                     Evaluates(small));
+        CHECK_THAT("parallel.map([40], depth, 1)[0]", EVALUATES_TO(40));
+        CHECK_THAT("try(-> parallel.map([40], depth, 1))", EvaluatesTo(small, "stack overflow"));
+        CHECK_THAT("parallel.map([40], depth, 1)[0]", EVALUATES_TO(40));
+    };
+}
+
+TEST_CASE("Compilation cache", "[compile-cache]") {
+    DefaultAllocator allocator;
+    VM vm({.mm{.allocator = &allocator}, .compile_cache_size = 2});
+    auto eval_in = [&vm](const std::string &filename, const std::string &expr, fint a) -> fint {
+        auto vars = vm.mem.gc_new_auto<VM::Object>(vm);
+        vars->set_field(FStr("a", vm.mem.str_alloc()), {Type::INT, {.num = a}});
+        auto scope = vm.mem.gc_new_auto<VM::Scope>(vars.get(), nullptr);
+        auto stack = util::eval_fn(vm, util::compile_fn(vm, nullptr, scope.get(), filename, expr, true).get());
+        REQUIRE(!stack->is_panicked());
+        return (*stack)[-1].data.num;
+    };
+    const auto &stats = vm.get_compile_cache_stats();
+    SECTION("Hits and misses") {
+        CHECK(eval_in("<rule>", "a * 2", 1) == 2);
+        CHECK(eval_in("<rule>", "a * 2", 5) == 10); // The cached bytecode runs in the new scope
+        CHECK(eval_in("<other>", "a * 2", 3) == 6);
+        CHECK(stats.hits == 1);
+        CHECK(stats.misses == 2);
+        CHECK(stats.evictions == 0);
+    };
+    SECTION("Eviction") {
+        eval_in("<rule>", "a + 1", 0);
+        eval_in("<rule>", "a + 2", 0);
+        eval_in("<rule>", "a + 1", 0); // `a + 2` becomes the least recently used one
+        eval_in("<rule>", "a + 3", 0);
+        CHECK(stats.evictions == 1);
+        CHECK(eval_in("<rule>", "a + 1", 0) == 1);
+        CHECK(stats.hits == 2);
+        CHECK(eval_in("<rule>", "a + 2", 0) == 2);
+        CHECK(stats.misses == 4);
+    };
+    SECTION("Uncached compilation") {
+        auto scope = vm.mem.gc_new_auto<VM::Scope>(vm.mem.gc_new_auto<VM::Object>(vm).get(), nullptr);
+        util::compile_fn(vm, nullptr, scope.get(), "<module>", "1");
+        CHECK(stats.hits + stats.misses == 0);
+    };
+}
+
+TEST_CASE("Lazy compilation", "[lazy]") {
+    DefaultAllocator allocator;
+    VM vm({.mm{.allocator = &allocator}});
+    auto scope = vm.mem.gc_new_auto<VM::Scope>(vm.mem.gc_new_auto<VM::Object>(vm).get(), nullptr);
+    auto eval_lazy = [&](const std::string &expr) {
+        return util::eval_fn(vm, util::compile_fn(vm, nullptr, scope.get(), "<module>", expr, false, true).get());
+    };
+    SECTION("Calls") {
+        auto stack = eval_lazy(".add = (.a, .b) -> a + b;\n.twice = .f -> (.x -> f(f(x)));\ntwice(.x -> add(x, 3))");
+        REQUIRE(!stack->is_panicked());
+        util::CallContext ctx(vm, (*stack)[-1].data.fun);
+        REQUIRE(ctx.call({VM::Value(Type::INT, {.num = 1})}));
+        CHECK(ctx.results()[0].data.num == 7);
+        REQUIRE(ctx.call({VM::Value(Type::INT, {.num = 10})})); // The compiled code is reused
+        CHECK(ctx.results()[0].data.num == 16);
+    };
+    SECTION("Location") {
+        auto stack = eval_lazy("\n  .f = (\n    .n -> n / 0\n  );\n  f");
+        REQUIRE(!stack->is_panicked());
+        auto *fun = dynamic_cast<VM::BytecodeFunction *>((*stack)[-1].data.fun);
+        REQUIRE(fun);
+        CHECK(fun->get_location().position.row == 3);
+        CHECK(fun->get_location().position.col == 8);
+        util::CallContext ctx(vm, fun);
+        REQUIRE(!ctx.call({VM::Value(Type::INT, {.num = 1})}));
+        std::vector<std::string> trace;
+        ctx.get_stack().generate_stack_trace([&trace](auto row) -> void { trace.emplace_back(row.begin(), row.end()); });
+        REQUIRE(trace.size() == 1);
+        CHECK_THAT(trace[0], Catch::Matchers::EndsWith("<module>:3:13"));
+    };
+    SECTION("Deferred compilation errors") {
+        auto stack = eval_lazy(".f = -> (1 = 2); .g = -> 5; f, g");
+        REQUIRE(!stack->is_panicked()); // The body of `f` is not compiled until it is called
+        util::CallContext ctx(vm, (*stack)[-1].data.fun);
+        REQUIRE(ctx.call({}));
+        CHECK(ctx.results()[0].data.num == 5);
+        util::CallContext bad_ctx(vm, (*stack)[-2].data.fun);
+        CHECK(!bad_ctx.call({}));
+        const auto &msg = bad_ctx.results().back().data.str->bytes;
+        CHECK_THAT(std::string(msg.begin(), msg.end()),
+                   Catch::Matchers::Contains("expression is not assignable"));
+    };
+}
+
+TEST_CASE("Module compilation", "[modules]") {
+    TestEnv env;
+    auto &vm = env.get_vm();
+    auto dir = std::filesystem::temp_directory_path() / ("funscript-tests-" + std::to_string(getpid()));
+    std::filesystem::create_directories(dir);
+    auto write_loader = [&dir](const std::string &name, const std::string &code) -> std::filesystem::path {
+        std::ofstream(dir / name) << code;
+        return dir / name;
+    };
+    auto get_export = [&vm](VM::Module *mod, const std::string &name) -> VM::Value {
+        auto exports = mod->object->get_field(FStr(MODULE_EXPORTS_VAR, vm.mem.str_alloc())).value();
+        return exports.data.obj->get_field(FStr(name, vm.mem.str_alloc())).value();
+    };
+    SECTION("Compiled loaders") {
+        auto path = write_loader("good.fs", "exports = {.answer = 42; .twice = .x -> x * 2};");
+        auto loader = util::compile_src_module(nullptr, "good", path, true);
+        REQUIRE(!loader.error);
+        CHECK(!loader.bytes.empty());
+        auto mod = util::load_src_module(vm, "good", loader, {}, {});
+        CHECK(check_value(get_export(mod.get(), "answer"), 42));
+        util::CallContext ctx(vm, get_export(mod.get(), "twice").data.fun);
+        REQUIRE(ctx.call({VM::Value(Type::INT, {.num = 21})}));
+        CHECK(check_value(ctx.results()[0], 42));
+    };
+    SECTION("Errors") {
+        auto path = write_loader("bad.fs", "exports = (;");
+        auto loader = util::compile_src_module(nullptr, "bad", path, true);
+        CHECK(loader.error); // Compilation errors are reported when the module is loaded
+        CHECK_THROWS_AS(util::load_src_module(vm, "bad", loader, {}, {}), util::ModuleLoadingError);
+        auto missing = util::compile_src_module(nullptr, "missing", dir / "missing.fs", true);
+        CHECK_THROWS_AS(util::load_src_module(vm, "missing", missing, {}, {}), util::ModuleLoadingError);
+    };
+    SECTION("Parallel compilation") {
+        std::vector<std::filesystem::path> paths;
+        for (size_t id = 0; id < 16; id++) {
+            paths.push_back(write_loader("mod" + std::to_string(id) + ".fs",
+                                         "exports = {.id = " + std::to_string(id) + "};"));
+        }
+        std::vector<util::compiled_src_module_t> loaders(paths.size());
+        std::vector<std::thread> threads;
+        for (size_t id = 0; id < paths.size(); id++) {
+            threads.emplace_back([&loaders, &paths, id]() -> void {
+                loaders[id] = util::compile_src_module(nullptr, "mod", paths[id], true);
+            });
+        }
+        for (auto &thread : threads) thread.join();
+        for (size_t id = 0; id < paths.size(); id++) {
+            auto mod = util::load_src_module(vm, "mod", loaders[id], {}, {});
+            CHECK(get_export(mod.get(), "id").data.num == fint(id));
+        }
+    };
+    SECTION("Compilation of several modules") {
+        std::vector<std::string> names;
+        for (size_t id = 0; id < 8; id++) {
+            write_loader("mod" + std::to_string(id) + ".fs", "exports = {.id = " + std::to_string(id) + "};");
+            names.push_back("mod" + std::to_string(id));
+        }
+        write_loader("bad.fs", "exports = (;");
+        // Repeated names are compiled once, modules without source loaders (e.g. native ones) are skipped
+        names.insert(names.end(), {"mod3", "bad", "mod0", "native", "bad"});
+        auto get_loader_path = [&dir](const std::string &name) -> std::filesystem::path {
+            return dir / (name + ".fs");
+        };
+        for (size_t threads : {1, 4, 100}) {
+            auto loaders = util::compile_src_modules(vm, names, threads, get_loader_path);
+            REQUIRE(loaders.size() == 9);
+            CHECK(!loaders.contains("native"));
+            REQUIRE(loaders.contains("bad"));
+            CHECK(loaders.at("bad").error);
+            for (size_t id = 0; id < 8; id++) {
+                const auto &loader = loaders.at("mod" + std::to_string(id));
+                REQUIRE(!loader.error);
+                auto mod = util::load_src_module(vm, "mod", loader, {}, {});
+                CHECK(get_export(mod.get(), "id").data.num == fint(id));
+            }
+        }
+        CHECK(util::compile_src_modules(vm, {}, 4, get_loader_path).empty());
+    };
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Data loading", "[data]") {
+    TestEnv env;
+    auto &vm = env.get_vm();
+    auto stack = vm.mem.gc_new_auto<VM::Stack>(vm);
+    SECTION("Literals") {
+        REQUIRE(load_data(*stack, "<data>", "# Config\n{.name = 'app'; .ports = [80, -443]; .ratio = 0.5; 1, yes}"));
+        REQUIRE(stack->size() == 1);
+        auto *obj = (*stack)[0].data.obj;
+        CHECK(check_value<const char *>(obj->get_field("name").value(), "app"));
+        CHECK(check_value(obj->get_field("ratio").value(), 0.5));
+        auto ports = obj->get_field("ports").value();
+        REQUIRE(ports.type == Type::ARR);
+        CHECK(ports.data.arr->len() == 2);
+        CHECK(check_value((*ports.data.arr)[1], -443));
+        REQUIRE(obj->get_values().size() == 2);
+        CHECK(check_value(obj->get_values()[1], true));
+    };
+    SECTION("Statements") {
+        REQUIRE(load_data(*stack, "<data>", "{1, 2; .a = 3; 4, 5}, [], 'x'"));
+        REQUIRE(stack->size() == 3);
+        CHECK((*stack)[0].data.obj->get_values().size() == 2); // The values before a semicolon are discarded
+        CHECK(check_value((*stack)[0].data.obj->get_field("a").value(), 3));
+        CHECK((*stack)[1].data.arr->len() == 0);
+        CHECK(check_value<const char *>((*stack)[2], "x"));
+    };
+    SECTION("Fallback") {
+        CHECK(!load_data(*stack, "<data>", "[1, 2 + 3]"));
+        CHECK(!load_data(*stack, "<data>", "{.a, .b = 1, 2}"));
+        CHECK(stack->size() == 0); // Partially built values are discarded
+        auto result = util::eval_data(vm, "<data>", "[1, 2 + 3]");
+        REQUIRE(!result->is_panicked());
+        CHECK(check_value((*result->get_values()[0].data.arr)[1], 5));
+        CHECK(util::eval_data(vm, "<data>", "{.a = }")->is_panicked());
+    };
+}
+
+TEST_CASE("Serialization", "[serialization]") {
+    TestEnv src, dst;
+    auto stack = dst.get_vm().mem.gc_new_auto<VM::Stack>(dst.get_vm());
+    SECTION("Values") {
+        auto values = src.evaluate(".o = {.x = 1; .y = -300; 2}; o.self = o; 1, -2.5, 'str', no, [o, o, {.x = 'x'}]");
+        Serializer serializer;
+        serializer.write(&(*values)[0], &(*values)[0] + values->size());
+        Deserializer deserializer(serializer.get_buffer());
+        REQUIRE(deserializer.read(*stack));
+        CHECK(!deserializer.read(*stack));
+        REQUIRE(stack->size() == 5);
+        CHECK(check_value((*stack)[0], 1));
+        CHECK(check_value((*stack)[1], -2.5));
+        CHECK(check_value<const char *>((*stack)[2], "str"));
+        CHECK(check_value((*stack)[3], false));
+        const auto &arr = *(*stack)[4].data.arr;
+        REQUIRE(arr.len() == 3);
+        auto *obj = arr[0].data.obj;
+        CHECK(obj == arr[1].data.obj); // Shared references are preserved
+        CHECK(obj->get_field("self").value().data.obj == obj); // Cycles are preserved
+        CHECK(check_value(obj->get_field("y").value(), -300));
+        CHECK(check_value(obj->get_values()[0], 2));
+        CHECK(check_value<const char *>(arr[2].data.obj->get_field("x").value(), "x"));
+        auto size = serializer.get_buffer().size();
+        auto fun = src.evaluate("-> 1");
+        CHECK_THROWS_AS(serializer.write(&(*fun)[0], &(*fun)[0] + 1), SerializationError);
+        CHECK(serializer.get_buffer().size() == size); // Partially written messages are discarded
+    };
+    SECTION("Streaming") {
+        auto values = src.evaluate("[1, 2, 3], 'a long string which is larger than a chunk', {.x = 'x'}");
+        std::string out;
+        size_t chunks = 0;
+        Serializer serializer([&out, &chunks](const char *data, size_t len) -> void {
+            out.append(data, len);
+            chunks++;
+        }, 8);
+        serializer.write(&(*values)[0], &(*values)[0] + values->size());
+        serializer.write(&(*values)[1], &(*values)[1] + 1);
+        CHECK(chunks > 2);
+        size_t pos = 0;
+        Deserializer deserializer([&out, &pos](char *data, size_t len) -> size_t {
+            len = std::min(len, std::min(out.size() - pos, size_t(3)));
+            std::memcpy(data, out.data() + pos, len);
+            pos += len;
+            return len;
+        }, 4);
+        REQUIRE(deserializer.read(*stack));
+        REQUIRE(deserializer.read(*stack));
+        CHECK(!deserializer.read(*stack));
+        REQUIRE(stack->size() == 4);
+        CHECK(check_value((*(*stack)[0].data.arr)[2], 3));
+        CHECK(check_value<const char *>((*stack)[1], "a long string which is larger than a chunk"));
+        CHECK(check_value<const char *>((*stack)[2].data.obj->get_field("x").value(), "x"));
+        CHECK(check_value<const char *>((*stack)[3], "a long string which is larger than a chunk"));
+    };
+    SECTION("Malformed data") {
+        auto values = src.evaluate("[1, 'str', {.x = 2.5}]");
+        Serializer serializer;
+        serializer.write(&(*values)[0], &(*values)[0] + values->size());
+        const auto &data = serializer.get_buffer();
+        for (size_t len = 1; len < data.size(); len++) { // Every truncated message is rejected
+            Deserializer deserializer(std::string_view(data).substr(0, len));
+            CHECK_THROWS_AS(deserializer.read(*stack), SerializationError);
+        }
+        CHECK(stack->size() == 0);
+        Deserializer huge(std::string_view("FSV\x01\x01\x05\xff\xff\xff\xff\x0f", 11));
+        CHECK_THROWS_AS(huge.read(*stack), SerializationError);
+        Deserializer bad_ref(std::string_view("FSV\x01\x01\x08\x05", 7));
+        CHECK_THROWS_AS(bad_ref.read(*stack), SerializationError);
+        CHECK_THROWS_AS(Deserializer(std::string_view("XYZ\x01\x00", 5)).read(*stack), SerializationError);
+        // Huge lengths of strings, arrays, objects and byte arrays which are read from a stream are not trusted either
+        for (char tag : {'\x04', '\x05', '\x06', '\x07'}) {
+            std::string data = std::string("FSV\x01\x01", 5) + tag + "\xff\xff\xff\xff\x0f";
+            Deserializer stream([&data](char *buf, size_t len) -> size_t {
+                len = std::min(len, data.size());
+                std::memcpy(buf, data.data(), len);
+                data.erase(0, len);
+                return len;
+            });
+            CHECK_THROWS_AS(stream.read(*stack), SerializationError);
+        }
+        CHECK(stack->size() == 0);
+    };
+}
+
+TEST_CASE("Typed arrays", "[typed-arrays]") {
+    TestEnv env;
+    auto &vm = env.get_vm();
+    using ElemType = VM::TypedArray::ElemType;
+    SECTION("Elements") {
+        auto ints = vm.mem.gc_new_auto<VM::TypedArray>(vm, ElemType::INT32, 3);
+        CHECK(ints->len() == 3);
+        CHECK(ints->set(0, {Type::INT, {.num = -7}}));
+        CHECK(ints->set(1, {Type::INT, {.num = (fint(1) << 32) + 5}})); // Integers are truncated
+        CHECK(!ints->set(2, {Type::FLP, {.flp = 1.5}}));
+        CHECK(check_value(ints->get(0), -7));
+        CHECK(check_value(ints->get(1), 5));
+        CHECK(check_value(ints->get(2), 0));
+        auto bytes = vm.mem.gc_new_auto<VM::TypedArray>(vm, ElemType::UINT8, 1);
+        CHECK(bytes->set(0, {Type::INT, {.num = 257}}));
+        CHECK(check_value(bytes->get(0), 1));
+        auto floats = vm.mem.gc_new_auto<VM::TypedArray>(vm, ElemType::FLOAT32, 1);
+        CHECK(floats->set(0, {Type::FLP, {.flp = 0.5}}));
+        CHECK(check_value(floats->get(0), 0.5));
+        CHECK(!floats->set(0, {Type::INT, {.num = 1}}));
+    };
+    SECTION("Indexing") {
+        auto arr = vm.mem.gc_new_auto<VM::TypedArray>(vm, ElemType::FLOAT64, 4);
+        VM::Value arr_val(Type::PTR, {.ptr = arr.get()});
+        auto fun = env.evaluate(".a -> (a[1] = 2.5; a[2], a[3] = 1.0, 3.0; a[0, 1, 3], sizeof a)");
+        util::CallContext ctx(vm, (*fun)[0].data.fun);
+        REQUIRE(ctx.call({arr_val}));
+        REQUIRE(ctx.results().size() == 4);
+        CHECK(check_value(ctx.results()[0], 0.0));
+        CHECK(check_value(ctx.results()[1], 2.5));
+        CHECK(check_value(ctx.results()[2], 3.0));
+        CHECK(check_value(ctx.results()[3], 4));
+        CHECK(check_value(arr->get(2), 1.0));
+        auto bad_index = env.evaluate(".a -> a[4]");
+        CHECK(!util::CallContext(vm, (*bad_index)[0].data.fun).call({arr_val}));
+        auto bad_value = env.evaluate(".a -> (a[0] = 1)");
+        CHECK(!util::CallContext(vm, (*bad_value)[0].data.fun).call({arr_val}));
+    };
+    SECTION("Kernels") {
+        // Lengths which are not multiples of the vector sizes check the scalar tails of kernels
+        for (size_t len : {1, 7, 33, 100}) {
+            auto a = vm.mem.gc_new_auto<VM::TypedArray>(vm, ElemType::INT32, len);
+            auto b = vm.mem.gc_new_auto<VM::TypedArray>(vm, ElemType::INT32, len);
+            auto dst = vm.mem.gc_new_auto<VM::TypedArray>(vm, ElemType::INT32, len);
+            auto mask = vm.mem.gc_new_auto<VM::TypedArray>(vm, ElemType::UINT8, len);
+            fint sum = 0, dot = 0, min = 0, max = 0;
+            for (size_t pos = 0; pos < len; pos++) {
+                fint x = fint(pos * 37 % 101) - 50, y = fint(pos % 5);
+                a->set(pos, {Type::INT, {.num = x}});
+                b->set(pos, {Type::INT, {.num = y}});
+                sum += x;
+                dot += x * y;
+                min = pos ? std::min(min, x) : x;
+                max = pos ? std::max(max, x) : x;
+            }
+            CHECK(kernels::sum(*a).data.num == sum);
+            CHECK(kernels::dot(*a, *b).data.num == dot);
+            CHECK(kernels::min(*a).data.num == min);
+            CHECK(kernels::max(*a).data.num == max);
+            kernels::add(*dst, *a, *b);
+            CHECK(dst->get(len - 1).data.num == a->get(len - 1).data.num + b->get(len - 1).data.num);
+            kernels::mul(*dst, *a, *b);
+            CHECK(dst->get(len - 1).data.num == a->get(len - 1).data.num * b->get(len - 1).data.num);
+            kernels::less(*mask, *a, *b);
+            fint less = 0;
+            for (size_t pos = 0; pos < len; pos++) {
+                less += mask->get(pos).data.num;
+                if (a->get(pos).data.num < b->get(pos).data.num) less--;
+            }
+            CHECK(less == 0);
+            kernels::fill(*dst, {Type::INT, {.num = 3}});
+            kernels::scale(*dst, {Type::INT, {.num = -2}});
+            CHECK(kernels::sum(*dst).data.num == -6 * fint(len));
+        }
+        auto floats = vm.mem.gc_new_auto<VM::TypedArray>(vm, ElemType::FLOAT32, 50);
+        kernels::fill(*floats, {Type::FLP, {.flp = 0.5}});
+        CHECK(check_value(kernels::sum(*floats), 25.0));
+        CHECK(check_value(kernels::dot(*floats, *floats), 12.5));
+    };
+    SECTION("NaN") {
+        // NaN is the minimum and the maximum wherever it is, both in the vector part and in the scalar tail
+        for (auto elem_type : {ElemType::FLOAT64, ElemType::FLOAT32}) {
+            for (size_t len : {3, 11, 40}) {
+                auto arr = vm.mem.gc_new_auto<VM::TypedArray>(vm, elem_type, len);
+                for (size_t pos = 0; pos < len; pos++) arr->set(pos, {Type::FLP, {.flp = fflp(pos % 7) - 3.0}});
+                CHECK(kernels::min(*arr).data.flp == -3.0);
+                CHECK(kernels::max(*arr).data.flp == fflp(std::min(len, size_t(7)) - 1) - 3.0);
+                for (size_t nan_pos = 0; nan_pos < len; nan_pos++) {
+                    auto elem = arr->get(nan_pos);
+                    arr->set(nan_pos, {Type::FLP, {.flp = std::numeric_limits<fflp>::quiet_NaN()}});
+                    CHECK(std::isnan(kernels::min(*arr).data.flp));
+                    CHECK(std::isnan(kernels::max(*arr).data.flp));
+                    arr->set(nan_pos, elem);
+                }
+            }
+        }
+    };
+    SECTION("Natives") {
+        TestEnv std_env(67108864, 256, 65536);
+        std_env.import_std();
+        CHECK_THAT(".a = TypedArray.from_array('float64', [1.0, 0.0 / 0.0, -3.0]);"
+                   "TypedArray.min(a) != TypedArray.min(a), TypedArray.max(a) != TypedArray.max(a)",
+                   EvaluatesTo(std_env, true, true));
+        CHECK_THAT("TypedArray.allocate('int16', 1)", Panics(std_env));
+        CHECK_THAT("TypedArray.allocate('int32', -1)", Panics(std_env));
+        CHECK_THAT("TypedArray.from_array('int32', [1, 2.5])", Panics(std_env));
+        CHECK_THAT("TypedArray.add(TypedArray.allocate('int32', 2), TypedArray.allocate('int32', 3))", Panics(std_env));
+        CHECK_THAT("TypedArray.dot(TypedArray.allocate('int32', 2), TypedArray.allocate('int64', 2))", Panics(std_env));
+        CHECK_THAT("TypedArray.min(TypedArray.allocate('float32', 0))", Panics(std_env));
+        CHECK_THAT("TypedArray.fill(TypedArray.allocate('float32', 2), 1)", Panics(std_env));
+        CHECK_THAT("TypedArray.sum(serialize(1).span(0, 1).get_bytes().data)", Panics(std_env));
+        CHECK_THAT("deserialize(Bytes.allocate(3).span(0, 3))", Panics(std_env));
+        CHECK_THAT("deserialize(serialize(1, 'str', [2.5]).span(0, 3))", Panics(std_env));
+        CHECK_THAT("TypedArray.sum(TypedArray.from_array('int32', [1, 2, 3]))", EvaluatesTo(std_env, 6));
+    };
+}
+
+TEST_CASE("Command line modes", "[cli]") {
+    const auto &dir = ModulesDir::get();
+    // Every request increments the counter of its own clone, so mutations of one request never leak into another one
+    std::ofstream(dir / "counter.fs") << "exports = {};\n"
+                                         ".counter = 0;\n"
+                                         "run = -> (\n"
+                                         "    .line = input.lines().get_one().unwrap();\n"
+                                         "    counter = counter + 1;\n"
+                                         "    string.is_suffix(line, 'fail' + sys.eol) then panic 'failed';\n"
+                                         "    string.is_suffix(line, 'slow' + sys.eol) then (\n"
+                                         "        .pos = 0;\n"
+                                         "        pos < 100000 repeats pos = pos + 1;\n"
+                                         "    );\n"
+                                         "    print.with_end('')(counter, line);\n"
+                                         ");\n";
+    SECTION("Fork server") {
+        auto result = run_executable(std::string(STD_MODULES_ARGS) + " -m counter --fork-server", "a\nb\nfail\nc\n");
+        CHECK(result.code == 0);
+        CHECK(result.out == "1 a\n1 b\n1 c\n");
+        CHECK_THAT(result.err, Catch::Matchers::Contains("request 2 failed"));
+        CHECK(run_executable(std::string(STD_MODULES_ARGS) + " -m counter --fork-server").out.empty());
+    };
+    SECTION("Workers") {
+        // The slow inputs finish after the following ones, but their outputs are still written first
+        auto result = run_executable(std::string(STD_MODULES_ARGS) + " -m counter --workers 3",
+                                     "slow\na\nslow\nb\nc\n");
+        CHECK(result.code == 0);
+        CHECK(result.out == "1 slow\n1 a\n1 slow\n1 b\n1 c\n");
+        CHECK(result.err.empty());
+        result = run_executable(std::string(STD_MODULES_ARGS) + " -m counter --workers 2", "a\nfail\nb\n");
+        CHECK(result.code == 1);
+        CHECK(result.out == "1 a\n1 b\n");
+        CHECK_THAT(result.err, Catch::Matchers::Contains("input 1 failed"));
+        std::ofstream(dir / "input0") << "slow\n";
+        std::ofstream(dir / "input1") << "x\n";
+        result = run_executable(std::string(STD_MODULES_ARGS) + " -m counter --workers 2 --input input0 "
+                                                                "--input missing --input input1");
+        CHECK(result.code == 1);
+        CHECK(result.out == "1 slow\n1 x\n");
+        CHECK_THAT(result.err, Catch::Matchers::Contains("missing"));
+        CHECK_THAT(result.err, Catch::Matchers::Contains("input 1 failed"));
+    };
+    SECTION("Daemon") {
+        std::ofstream(dir / "greet.fs") << "exports = {};\n"
+                                           "run = (.name) -> (\n"
+                                           "    .line = input.lines().get_one().unwrap();\n"
+                                           "    string.is_suffix(line, 'fail' + sys.eol) then panic 'failed';\n"
+                                           "    print.with_end('')(name, line);\n"
+                                           ");\n";
+        auto socket_path = dir / "daemon.sock";
+        // Submitted scripts import the standard library, like the main module of the other modes
+        BackgroundExecutable daemon("--daemon " + socket_path.string() + " " + STD_MODULES_ARGS);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!std::filesystem::exists(socket_path) && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(std::filesystem::exists(socket_path));
+        auto connect_args = "--connect " + socket_path.string() + " " + (dir / "greet.fs").string();
+        auto result = run_executable(connect_args + " first", "a\n");
+        CHECK(result.code == 0);
+        CHECK(result.out == "first a\n");
+        CHECK(result.err.empty());
+        result = run_executable(connect_args + " second", "fail\n");
+        CHECK(result.code == 1);
+        CHECK(result.out.empty());
+        CHECK_THAT(result.err, Catch::Matchers::Contains("main module panicked"));
+        result = run_executable(connect_args + " third", "b\n");
+        CHECK(result.code == 0);
+        CHECK(result.out == "third b\n");
+        result = run_executable(connect_args); // The argument of the script is missing
+        CHECK(result.code == 1);
+        CHECK_THAT(result.err, Catch::Matchers::Contains("not enough values"));
+        result = run_executable("--connect " + (dir / "missing.sock").string() + " greet.fs");
+        CHECK(result.code == 1);
+        CHECK(result.out.empty());
+        // Files other than sockets are never replaced by the socket of the daemon
+        std::ofstream(dir / "not-a-socket") << "data";
+        result = run_executable("--daemon " + (dir / "not-a-socket").string() + " " + STD_MODULES_ARGS);
+        CHECK(result.code == 1);
+        CHECK_THAT(result.err, Catch::Matchers::Contains(strerror(EADDRINUSE)));
+        CHECK(std::filesystem::is_regular_file(dir / "not-a-socket"));
+    };
+}
@@ -8,6 +8,14 @@
 
 #include <utility>
 #include <any>
+#include <filesystem>
+#include <fstream>
+#include <cstdio>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern "C" const funscript::native_module_t *funscript_native_module(); // Linked from the standard library
 
 namespace funscript::tests {
 
@@ -93,6 +101,98 @@ namespace funscript::tests {
                 stack(std::move(stack)), std::runtime_error(msg) {}
     };
 
+    /**
+     * Directory of modules used by the tests. The source modules of the standard library are linked from the source
+     * tree, its native part is linked into the tests (and into the directory for the executables run by the tests).
+     */
+    class ModulesDir {
+        std::filesystem::path path;
+
+        ModulesDir() :
+                path(std::filesystem::temp_directory_path() / ("funscript-modules-" + std::to_string(getpid()))) {
+            std::filesystem::remove_all(path);
+            std::filesystem::create_directories(path / "std");
+            for (const auto &entry : std::filesystem::directory_iterator(FUNSCRIPT_STDLIB_DIR)) {
+                std::filesystem::create_symlink(entry.path(), path / "std" / entry.path().filename());
+            }
+            std::filesystem::create_symlink(FUNSCRIPT_STDFS_PATH, path / "std" / "native.so");
+            setenv(MODULES_PATH_ENV_VAR, path.c_str(), 1);
+            register_static_native_module("std.native", funscript_native_module());
+        }
+
+    public:
+        ~ModulesDir() {
+            std::filesystem::remove_all(path);
+        }
+
+        /**
+         * Creates the directory once per process and makes it the modules path of the process.
+         */
+        static const std::filesystem::path &get() {
+            static ModulesDir dir;
+            return dir.path;
+        }
+    };
+
+    struct process_result_t {
+        int code; // The exit code of the process, or -1 if it was killed.
+        std::string out; // The standard output of the process.
+        std::string err; // The standard error of the process.
+    };
+
+    // Options of the executable which load the standard library and import it into the main module.
+    static const char *STD_MODULES_ARGS = "-m std.native -i std.native -m std.lang -i std.lang "
+                                          "-m std.sys -i std.lang -m std.io -i std.lang "
+                                          "-m std.coroutines -i std.lang -m std.events -i std.lang "
+                                          "-m std.channels -i std.lang -m std.parallel -i std.lang -m std -i std";
+
+    /**
+     * Runs the Funscript executable in the modules directory of the tests.
+     * @param args The command line arguments (interpreted by the shell).
+     * @param input The standard input of the process.
+     */
+    static process_result_t run_executable(const std::string &args, const std::string &input = "") {
+        const auto &dir = ModulesDir::get();
+        std::ofstream(dir / "stdin") << input;
+        auto cmd = "cd " + dir.string() + " && " FUNSCRIPT_BIN_PATH " " + args + " < stdin 2> stderr";
+        FILE *pipe = popen(cmd.c_str(), "r");
+        process_result_t result{};
+        char buf[4096];
+        for (size_t cnt; (cnt = fread(buf, 1, sizeof buf, pipe));) result.out.append(buf, cnt);
+        int status = pclose(pipe);
+        result.code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        std::ifstream err(dir / "stderr");
+        result.err.assign(std::istreambuf_iterator<char>(err), std::istreambuf_iterator<char>());
+        return result;
+    }
+
+    /**
+     * The Funscript executable running in the background in the modules directory of the tests, until the object is
+     * destroyed. Its standard streams are not used.
+     */
+    class BackgroundExecutable {
+        pid_t pid;
+    public:
+        /**
+         * @param args The command line arguments (interpreted by the shell).
+         */
+        explicit BackgroundExecutable(const std::string &args) {
+            auto cmd = "cd " + ModulesDir::get().string() + " && exec " FUNSCRIPT_BIN_PATH " " + args +
+                       " < /dev/null > /dev/null 2> /dev/null";
+            pid = fork();
+            if (pid == 0) {
+                execl("/bin/sh", "sh", "-c", cmd.c_str(), nullptr);
+                _exit(127);
+            }
+        }
+
+        ~BackgroundExecutable() {
+            if (pid == -1) return;
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+        }
+    };
+
     class TestEnv {
         DefaultAllocator allocator;
         VM vm;
@@ -107,6 +207,35 @@ namespace funscript::tests {
             scope(vm.mem.gc_new_auto<VM::Scope>(vm.mem.gc_new_auto<VM::Object>(vm).get(), nullptr)) {
         }
 
+        VM &get_vm() {
+            return vm;
+        }
+
+        /**
+         * Loads the standard library and imports its exports into the scope of evaluated expressions.
+         */
+        void import_std() {
+            ModulesDir::get();
+            static const std::pair<std::string, std::vector<std::string>> STD_MODULES[] = {
+                    {"std.native", {}},
+                    {"std.lang", {"std.native"}},
+                    {"std.sys", {"std.lang"}},
+                    {"std.io", {"std.lang"}},
+                    {"std.coroutines", {"std.lang"}},
+                    {"std.events", {"std.lang"}},
+                    {"std.channels", {"std.lang"}},
+                    {"std.parallel", {"std.lang"}},
+                    {"std", {"std.lang"}},
+            };
+            for (const auto &[name, imps] : STD_MODULES) {
+                auto mod = util::load_module(vm, name, imps, {});
+                vm.register_module(FStr(name, vm.mem.str_alloc()), mod.get());
+            }
+            auto std_module = vm.get_module(FStr("std", vm.mem.str_alloc())).value();
+            auto exports = std_module->object->get_field(MODULE_EXPORTS_VAR);
+            for (const auto &[var, val] : exports.value().data.obj->get_fields()) scope->vars->set_field(var, val);
+        }
+
         auto evaluate(const std::string &expr) {
             std::cout << ": " << expr << std::endl;
             auto stack = util::eval_expr(vm, nullptr, scope.get(), "<test>", "'<test>'", expr);